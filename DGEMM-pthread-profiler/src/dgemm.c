@@ -1,41 +1,1277 @@
+#define _GNU_SOURCE     // sched_getcpu, CPU_SET
+
 //--------------------------
 // Including profiler library header
 #include "profiler.h"
 // ------------------------
+#include "nanoclock.h"
+#include "gemm.h"
+#include "roofline.h"
+#include "ooc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <omp.h>
+#ifdef USE_MKL
+#include "mkl.h"
+#endif
+
+#ifdef USE_CBLAS
+#include "cblas.h"
+#endif
+
+#ifdef USE_ESSL
+#include "essl.h"
+#endif
+
+
+#define DGEMM_RESTRICT __restrict__
+
+// ------------------------------------------------------- //
+// Function: get_nanoseconds
+//
+// Monotonic integer nanosecond timestamp (see nanoclock.h),
+// shared with libprofiler so both agree on the time base.
+// Vendor may modify this call to provide higher resolution
+// timing if required
+// ------------------------------------------------------- //
+uint64_t get_nanoseconds() {
+        return nanoclock_now();
+}
+
+// ------------------------------------------------------- //
+// Benchmark options
+//
+// Given as --name=value anywhere on the command line; they
+// are removed from argv before the positional arguments
+// (N, repeats, alpha, beta) are parsed.
+// ------------------------------------------------------- //
+typedef struct {
+        const char* repeat_csv;         // --repeat-csv=FILE : per-repeat timings
+        int batch;                      // --batch=COUNT     : batched small-matrix mode
+        int m, n, k;                    // --shape=MxNxK     : general shape (0 = use N)
+        gemm_trans_t transA, transB;    // --trans=NN|NT|TN|TT
+        int lda, ldb, ldc;              // --lda= --ldb= --ldc= (0 = packed)
+        int naive;                      // --kernel=naive|blocked (native build only)
+        gemm_precision_t precision;     // --precision=fp64|fp32|bf16|fp16
+        int lowp_emulate;               // --lowp=auto|emulated
+        int prepack;                    // --prepack=none|a|b|ab (PREPACK_A | PREPACK_B)
+        int strassen;                   // --strassen[=CROSSOVER|auto] (native build only)
+        int crossover;                  //   0 = default, -1 = tune at startup
+        int abft;                       // --abft : verify every C tile (native build only)
+        int inject_row, inject_col;     // --abft-inject=I,J : corrupt C(I,J) in the first repeat
+        int affinity;                   // --affinity=none|compact|scatter|physical
+        const char* roofline;           // --roofline[=FILE] : probe roofs, append a CSV point
+        const char* sweep;              // --sweep=CORE[/UNCORE] : frequency-cap sweep
+        double sweep_min_gflops;        // --sweep-min-gflops=X  : acceptable rate for the optimum
+        const char* sweep_csv;          // --sweep-csv=FILE      : per-point results
+        const char* ooc;                // --ooc=DIR     : stream A, B and C from files in DIR
+        int ooc_mem;                    // --ooc-mem=MB  : tile buffer budget
+        int pack_pipeline;              // --pack-pipeline : pack the next K panel during compute
+} dgemm_options_t;
+
+#define PREPACK_A 1
+#define PREPACK_B 2
+
+typedef enum {
+        AffinityNone = 0,       // leave placement to the OS / OMP_PROC_BIND
+        AffinityCompact,        // fill the SMT siblings of a core, then the next core
+        AffinityScatter,        // spread over sockets first, then cores, then siblings
+        AffinityPhysical        // one thread per physical core, no SMT siblings
+} dgemm_affinity_t;
+
+static const char* affinity_names[] = { "none", "compact", "scatter", "physical" };
+
+static dgemm_options_t opts = { NULL, 0, 0, 0, 0, GemmNoTrans, GemmNoTrans, 0, 0, 0, 0,
+        GemmFP64, 0, 0, 0, 0, 0, -1, -1, AffinityNone, NULL, NULL, 0.0, NULL, NULL, 1024, 0 };
+
+static const char* precision_names[] = { "fp64", "fp32", "bf16", "fp16" };
+
+static void usage_options(const char* prog) {
+        fprintf(stderr, "Usage: %s [options] [N [repeats [alpha [beta]]]]\n", prog);
+        fprintf(stderr, "  --repeat-csv=FILE   write per-repeat time, GFLOP/s and profiler sample index\n");
+        fprintf(stderr, "  --batch=COUNT       multiply COUNT independent N x N matrices per repeat\n");
+        fprintf(stderr, "  --shape=MxNxK       multiply an M x K by a K x N matrix instead of N x N\n");
+        fprintf(stderr, "  --trans=XY          transpose flags for A and B, each N or T (default NN)\n");
+        fprintf(stderr, "  --lda=, --ldb=, --ldc=  leading dimensions (default: packed)\n");
+        fprintf(stderr, "  --kernel=NAME       native kernel: blocked (default) or naive\n");
+        fprintf(stderr, "  --precision=P       fp64 (default), fp32, bf16 or fp16 (FP32 accumulate)\n");
+        fprintf(stderr, "  --lowp=MODE         bf16/fp16 kernels: auto (default) or emulated\n");
+        fprintf(stderr, "  --prepack=WHICH     pack none (default), a, b or ab once and reuse across repeats\n");
+        fprintf(stderr, "  --strassen[=X]      Strassen-Winograd above crossover X (number or auto)\n");
+        fprintf(stderr, "  --abft              verify every C tile with row/column checksums\n");
+        fprintf(stderr, "  --abft-inject=I,J   corrupt C(I,J) in the first repeat to test detection\n");
+        fprintf(stderr, "  --affinity=MODE     pin threads: none (default), compact, scatter or physical\n");
+        fprintf(stderr, "  --roofline[=FILE]   measure bandwidth/peak roofs and append this run to FILE (roofline.csv)\n");
+        fprintf(stderr, "  --sweep=CORE[/UNCORE]  run under each core / uncore ratio cap (x100 MHz),\n");
+        fprintf(stderr, "                      lists as a,b,c or lo:hi[:step]\n");
+        fprintf(stderr, "  --sweep-min-gflops=X  slowest acceptable rate for the energy optimum\n");
+        fprintf(stderr, "  --sweep-csv=FILE    write per-point time, energy, EDP, GFLOP/s and GFLOP/J\n");
+        fprintf(stderr, "  --ooc=DIR           out-of-core: mmap A, B and C from files in DIR and stream tiles\n");
+        fprintf(stderr, "  --ooc-mem=MB        memory for the out-of-core tile buffers (default 1024)\n");
+        fprintf(stderr, "  --pack-pipeline     native kernel: pack the next panel while the current one computes\n");
+}
+
+static int option_is(const char* arg, size_t len, const char* name) {
+        return len == strlen(name) && strncmp(arg, name, len) == 0;
+}
+
+static gemm_trans_t parse_trans(char c, const char* val) {
+        if(c == 'N' || c == 'n') return GemmNoTrans;
+        if(c == 'T' || c == 't') return GemmTrans;
+        fprintf(stderr, "Error: --trans expects two of N/T, setting is: %s\n", val);
+        exit(-1);
+}
+
+static void parse_options(int* argc, char* argv[]) {
+        int i, out = 1;
+
+        for(i = 1; i < *argc; i++) {
+                const char* arg = argv[i];
+
+                if(strncmp(arg, "--", 2) != 0) {
+                        argv[out++] = argv[i];
+                        continue;
+                }
+
+                const char* eq = strchr(arg, '=');
+                const char* val = (eq != NULL) ? eq + 1 : "";
+                size_t len = (eq != NULL) ? (size_t) (eq - arg) : strlen(arg);
+
+                if(option_is(arg, len, "--repeat-csv")) {
+                        opts.repeat_csv = val;
+                } else if(option_is(arg, len, "--shape")) {
+                        if(sscanf(val, "%dx%dx%d", &opts.m, &opts.n, &opts.k) != 3 ||
+                                opts.m < 1 || opts.n < 1 || opts.k < 1) {
+                                fprintf(stderr, "Error: --shape expects MxNxK, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--trans")) {
+                        if(strlen(val) != 2) parse_trans('?', val);
+                        opts.transA = parse_trans(val[0], val);
+                        opts.transB = parse_trans(val[1], val);
+                } else if(option_is(arg, len, "--lda")) {
+                        opts.lda = atoi(val);
+                } else if(option_is(arg, len, "--ldb")) {
+                        opts.ldb = atoi(val);
+                } else if(option_is(arg, len, "--ldc")) {
+                        opts.ldc = atoi(val);
+                } else if(option_is(arg, len, "--kernel")) {
+                        if(strcmp(val, "naive") == 0) opts.naive = 1;
+                        else if(strcmp(val, "blocked") == 0) opts.naive = 0;
+                        else {
+                                fprintf(stderr, "Error: unknown kernel %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--precision")) {
+                        int p;
+                        for(p = GemmFP64; p <= GemmFP16; p++) {
+                                if(strcmp(val, precision_names[p]) == 0) break;
+                        }
+                        if(p > GemmFP16) {
+                                fprintf(stderr, "Error: unknown precision %s\n", val);
+                                exit(-1);
+                        }
+                        opts.precision = (gemm_precision_t) p;
+                } else if(option_is(arg, len, "--lowp")) {
+                        if(strcmp(val, "emulated") == 0) opts.lowp_emulate = 1;
+                        else if(strcmp(val, "auto") == 0) opts.lowp_emulate = 0;
+                        else {
+                                fprintf(stderr, "Error: --lowp expects auto or emulated, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--prepack")) {
+                        if(strcmp(val, "none") == 0) opts.prepack = 0;
+                        else if(strcmp(val, "a") == 0) opts.prepack = PREPACK_A;
+                        else if(strcmp(val, "b") == 0) opts.prepack = PREPACK_B;
+                        else if(strcmp(val, "ab") == 0) opts.prepack = PREPACK_A | PREPACK_B;
+                        else {
+                                fprintf(stderr, "Error: --prepack expects none, a, b or ab, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--strassen")) {
+                        opts.strassen = 1;
+                        if(strcmp(val, "auto") == 0) opts.crossover = -1;
+                        else if(*val != '\0' && (opts.crossover = atoi(val)) < 1) {
+                                fprintf(stderr, "Error: --strassen expects a crossover >= 1 or auto, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--abft")) {
+                        opts.abft = 1;
+                } else if(option_is(arg, len, "--abft-inject")) {
+                        opts.abft = 1;
+                        if(sscanf(val, "%d,%d", &opts.inject_row, &opts.inject_col) != 2 ||
+                                opts.inject_row < 0 || opts.inject_col < 0) {
+                                fprintf(stderr, "Error: --abft-inject expects I,J, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--affinity")) {
+                        int a;
+                        for(a = AffinityNone; a <= AffinityPhysical; a++) {
+                                if(strcmp(val, affinity_names[a]) == 0) break;
+                        }
+                        if(a > AffinityPhysical) {
+                                fprintf(stderr, "Error: --affinity expects none, compact, scatter or physical, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                        opts.affinity = a;
+                } else if(option_is(arg, len, "--roofline")) {
+                        opts.roofline = (*val != '\0') ? val : "roofline.csv";
+                } else if(option_is(arg, len, "--sweep")) {
+                        opts.sweep = val;
+                } else if(option_is(arg, len, "--sweep-min-gflops")) {
+                        opts.sweep_min_gflops = atof(val);
+                } else if(option_is(arg, len, "--sweep-csv")) {
+                        opts.sweep_csv = val;
+                } else if(option_is(arg, len, "--ooc")) {
+                        opts.ooc = (*val != '\0') ? val : ".";
+                } else if(option_is(arg, len, "--pack-pipeline")) {
+                        opts.pack_pipeline = 1;
+                } else if(option_is(arg, len, "--ooc-mem")) {
+                        opts.ooc_mem = atoi(val);
+                        if(opts.ooc_mem < 1) {
+                                fprintf(stderr, "Error: --ooc-mem must be at least 1 MB, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else if(option_is(arg, len, "--batch")) {
+                        opts.batch = atoi(val);
+                        if(opts.batch < 1) {
+                                fprintf(stderr, "Error: --batch must be at least 1, setting is: %s\n", val);
+                                exit(-1);
+                        }
+                } else {
+                        fprintf(stderr, "Error: unknown option %s\n", arg);
+                        usage_options(argv[0]);
+                        exit(-1);
+                }
+        }
+
+        argv[out] = NULL;
+        *argc = out;
+}
+
+// ------------------------------------------------------- //
+// Thread placement (--affinity)
+//
+// The CPUs in the process affinity mask are ordered by their
+// sysfs topology (socket, core, SMT sibling) and OpenMP
+// thread t is pinned to entry t of that order, wrapping when
+// there are more threads than entries. Every thread then
+// records the CPU it runs on; the map is printed and handed
+// to libprofiler for its per-thread report. Without pinning
+// the map is only a snapshot, threads may migrate later.
+// ------------------------------------------------------- //
+typedef struct {
+        int cpu;
+        int package, core;      // sysfs physical_package_id / core_id
+        int sibling;            // index among the SMT threads of its core
+} dgemm_cpu_t;
+
+static int read_topology(int cpu, const char* name) {
+        char path[128];
+        int value = -1;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+        FILE* f = fopen(path, "r");
+        if(f != NULL) {
+                if(fscanf(f, "%d", &value) != 1) value = -1;
+                fclose(f);
+        }
+        return value;
+}
+
+static int compare_compact(const void* a, const void* b) {
+        const dgemm_cpu_t* x = (const dgemm_cpu_t*) a;
+        const dgemm_cpu_t* y = (const dgemm_cpu_t*) b;
+        if(x->package != y->package) return x->package - y->package;
+        if(x->core != y->core) return x->core - y->core;
+        return x->sibling - y->sibling;
+}
+
+static int compare_scatter(const void* a, const void* b) {
+        const dgemm_cpu_t* x = (const dgemm_cpu_t*) a;
+        const dgemm_cpu_t* y = (const dgemm_cpu_t*) b;
+        if(x->sibling != y->sibling) return x->sibling - y->sibling;
+        if(x->core != y->core) return x->core - y->core;
+        return x->package - y->package;
+}
+
+// Ordered CPU list for the selected mode, returns its length
+static int affinity_order(dgemm_cpu_t* cpus) {
+        cpu_set_t allowed;
+        int count = 0, kept = 0, i, j;
+
+        if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+                perror("sched_getaffinity");
+                return 0;
+        }
+
+        for(i = 0; i < CPU_SETSIZE; i++) {
+                if(!CPU_ISSET(i, &allowed)) continue;
+                cpus[count].cpu     = i;
+                cpus[count].package = read_topology(i, "physical_package_id");
+                cpus[count].core    = read_topology(i, "core_id");
+                if(cpus[count].package < 0) cpus[count].package = 0;
+                if(cpus[count].core < 0) cpus[count].core = i;
+                cpus[count].sibling = 0;
+                for(j = 0; j < count; j++) {
+                        if(cpus[j].package == cpus[count].package && cpus[j].core == cpus[count].core) {
+                                cpus[count].sibling++;
+                        }
+                }
+                count++;
+        }
+
+        for(i = 0; i < count; i++) {
+                if(opts.affinity == AffinityPhysical && cpus[i].sibling > 0) continue;
+                cpus[kept++] = cpus[i];
+        }
+
+        qsort(cpus, kept, sizeof(dgemm_cpu_t),
+                (opts.affinity == AffinityScatter) ? compare_scatter : compare_compact);
+        return kept;
+}
+
+static void setup_affinity(void) {
+        dgemm_cpu_t* cpus = NULL;
+        int count = 0, threads = 0, t;
+        int* map = (int*) malloc(sizeof(int) * omp_get_max_threads());
+
+        if(opts.affinity != AffinityNone) {
+                cpus = (dgemm_cpu_t*) malloc(sizeof(dgemm_cpu_t) * CPU_SETSIZE);
+                count = affinity_order(cpus);
+                printf("Affinity:             %s over %d CPUs\n", affinity_names[opts.affinity], count);
+                if(count > 0 && omp_get_max_threads() > count) {
+                        printf("Warning: %d threads share %d CPUs\n", omp_get_max_threads(), count);
+                }
+        }
+
+        #pragma omp parallel
+        {
+                const int tid = omp_get_thread_num();
+
+                if(count > 0) {
+                        cpu_set_t set;
+                        CPU_ZERO(&set);
+                        CPU_SET(cpus[tid % count].cpu, &set);
+                        if(sched_setaffinity(0, sizeof(set), &set) != 0) perror("sched_setaffinity");
+                }
+                map[tid] = sched_getcpu();
+
+                #pragma omp single
+                threads = omp_get_num_threads();
+        }
+
+        printf("Thread map (thread:cpu):");
+        for(t = 0; t < threads; t++) {
+                printf(" %d:%d", t, map[t]);
+        }
+        printf("%s\n", (opts.affinity == AffinityNone) ? " (not pinned)" : "");
+
+        // unpinned threads can migrate, so libprofiler keeps its idle/busy core filter
+        if(count > 0) profiler_set_thread_map(map, threads);
+
+        free(cpus);
+        free(map);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+        const double x = *(const double*) a;
+        const double y = *(const double*) b;
+        return (x > y) - (x < y);
+}
+
+// ------------------------------------------------------- //
+// Function: report_repeats
+//
+// Distribution of the per-repeat GFLOP/s rate from the
+// timestamps taken at the start of each repeat (stamps has
+// repeats + 1 entries), optionally dumped to a CSV file
+// together with the profiler sample index at each repeat.
+// ------------------------------------------------------- //
+static void report_repeats(const uint64_t* stamps, const int* samples, int repeats,
+        double flops_per_repeat) {
+
+        double* rate   = (double*) malloc(sizeof(double) * repeats);
+        double* sorted = (double*) malloc(sizeof(double) * repeats);
+        double mean = 0, var = 0;
+        int r;
+
+        for(r = 0; r < repeats; r++) {
+                const double t = nanoclock_to_sec(stamps[r + 1] - stamps[r]);
+                rate[r] = (t > 0) ? (flops_per_repeat / t) / 1000000000.0 : 0;
+                sorted[r] = rate[r];
+                mean += rate[r];
+        }
+        mean /= repeats;
+
+        for(r = 0; r < repeats; r++) {
+                var += (rate[r] - mean) * (rate[r] - mean);
+        }
+        var = (repeats > 1) ? var / (repeats - 1) : 0;
+
+        qsort(sorted, repeats, sizeof(double), compare_doubles);
+
+        const double median = (repeats % 2) ? sorted[repeats / 2] :
+                0.5 * (sorted[repeats / 2 - 1] + sorted[repeats / 2]);
+        const int p95 = (int) ceil(0.95 * repeats) - 1;
+
+        printf("Repeat GF/s min:      %f GF/s\n", sorted[0]);
+        printf("Repeat GF/s median:   %f GF/s\n", median);
+        printf("Repeat GF/s p95:      %f GF/s\n", sorted[p95 < 0 ? 0 : p95]);
+        printf("Repeat GF/s max:      %f GF/s\n", sorted[repeats - 1]);
+        printf("Repeat GF/s CV:       %f\n", (mean > 0) ? sqrt(var) / mean : 0);
+
+        if(opts.repeat_csv != NULL) {
+                FILE* csv = fopen(opts.repeat_csv, "w");
+
+                if(csv == NULL) {
+                        perror(opts.repeat_csv);
+                } else {
+                        fprintf(csv, "repeat,start_ns,time_ns,gflops,profiler_sample\n");
+                        for(r = 0; r < repeats; r++) {
+                                fprintf(csv, "%d,%" PRIu64 ",%" PRIu64 ",%f,%d\n", r,
+                                        stamps[r] - stamps[0], stamps[r + 1] - stamps[r],
+                                        rate[r], samples[r]);
+                        }
+                        fclose(csv);
+                        printf("Per-repeat timings written to %s\n", opts.repeat_csv);
+                }
+        }
+
+        free(rate);
+        free(sorted);
+}
+
+// ------------------------------------------------------- //
+// Function: run_batched
+//
+// Batched small-matrix mode (--batch=COUNT): every repeat
+// multiplies COUNT independent N x N matrices stored
+// contiguously, parallelized across the batch. Reports the
+// usual summary plus time and energy per GEMM.
+// ------------------------------------------------------- //
+static int run_batched(int N, int count, int repeats, double alpha, double beta) {
+        const size_t stride = (size_t) N * N;
+        const size_t elements = stride * count;
+        int b, r;
+
+        if(N < 1) {
+                printf("Error: N (%d) must be at least 1.\n", N);
+                exit(-1);
+        }
+
+        printf("Batched mode:         %d matrices of %d x %d (%s kernel)\n", count, N, N,
+                gemm_batch_specialized(N) ? "specialized" : "generic");
+
+        printf("Allocating Matrices...\n");
+
+        double* DGEMM_RESTRICT matrixA = (double*) malloc(sizeof(double) * elements);
+        double* DGEMM_RESTRICT matrixB = (double*) malloc(sizeof(double) * elements);
+        double* DGEMM_RESTRICT matrixC = (double*) malloc(sizeof(double) * elements);
+
+        if(matrixA == NULL || matrixB == NULL || matrixC == NULL) {
+                fprintf(stderr, "Error: unable to allocate %d matrices of size %d\n", count, N);
+                exit(-1);
+        }
+
+        printf("Allocation complete, populating with values...\n");
+
+        // first touch by the same static schedule the kernels use
+        #pragma omp parallel for schedule(static)
+        for(b = 0; b < count; b++) {
+                size_t e;
+                for(e = b * stride; e < (b + 1) * stride; e++) {
+                        matrixA[e] = 2.0;
+                        matrixB[e] = 0.5;
+                        matrixC[e] = 1.0;
+                }
+        }
+
+        uint64_t* repeat_stamps = (uint64_t*) malloc(sizeof(uint64_t) * (repeats + 1));
+        int* repeat_samples     = (int*) malloc(sizeof(int) * repeats);
+
+        printf("Performing multiplication...\n");
+        profiler_start();
+
+        const uint64_t start = get_nanoseconds();
+        repeat_stamps[0] = start;
+
+        for(r = 0; r < repeats; r++) {
+                repeat_samples[r] = profiler_sample_index();
+#if defined(USE_MKL) || defined(USE_CBLAS) || defined(USE_ESSL)
+                #pragma omp parallel for schedule(static)
+                for(b = 0; b < count; b++) {
+#ifdef USE_ESSL
+                        dgemm("N", "N", N, N, N, alpha, matrixA + b * stride, N,
+                                matrixB + b * stride, N, beta, matrixC + b * stride, N);
+#else
+                        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                                N, N, N, alpha, matrixA + b * stride, N,
+                                matrixB + b * stride, N, beta, matrixC + b * stride, N);
+#endif
+                }
+#else
+                gemm_batch_small(N, count, alpha, matrixA, matrixB, beta, matrixC);
+#endif
+                repeat_stamps[r + 1] = get_nanoseconds();
+        }
+
+        const uint64_t end = get_nanoseconds();
+        profiler_stop();
+
+        printf("Calculating matrix check...\n");
+
+        double final_sum = 0;
+        size_t e;
+
+        #pragma omp parallel for reduction(+:final_sum)
+        for(e = 0; e < elements; e++) {
+                final_sum += matrixC[e];
+        }
+
+        const double N_dbl = (double) N;
+        const double gemms = (double) count * (double) repeats;
+        const double matrix_memory = 3.0 * (double) elements * ((double) sizeof(double));
+        const double time_taken = nanoclock_to_sec(end - start);
+        const double flops_per_gemm = (N_dbl * N_dbl * N_dbl * 2.0) + (N_dbl * N_dbl * 2.0);
+        const double flops_computed = flops_per_gemm * gemms;
+        const double energy = profiler_energy();
+
+        printf("\n");
+        printf("===============================================================\n");
+
+        printf("Final Sum is:         %f\n", (final_sum / ((double) elements * repeats)));
+        printf("Memory for Matrices:  %f MB\n", (matrix_memory / (1024 * 1024)));
+        printf("Multiply time:        %f seconds\n", time_taken);
+        printf("FLOPs computed:       %f\n", flops_computed);
+        printf("GFLOP/s rate:         %f GF/s\n", (flops_computed / time_taken) / 1000000000.0);
+        printf("GEMMs computed:       %.0f\n", gemms);
+        printf("Time per GEMM:        %f us\n", (time_taken / gemms) * 1.0e6);
+        printf("Energy per GEMM:      %f mJ\n", (energy / gemms) * 1.0e3);
+
+        report_repeats(repeat_stamps, repeat_samples, repeats, flops_per_gemm * count);
+
+        printf("===============================================================\n");
+        printf("\n");
+
+        free(matrixA);
+        free(matrixB);
+        free(matrixC);
+        free(repeat_stamps);
+        free(repeat_samples);
+        return 0;
+}
+
+// ------------------------------------------------------- //
+// Frequency sweep (--sweep=CORE[/UNCORE])
+//
+// For every pair of core ratio cap and uncore ratio (units
+// of 100 MHz) the caps are written through libprofiler's
+// MSR layer (PROFILER_MSR_DEVICE selects a simulated device
+// for testing), one untimed multiply lets the clocks settle,
+// and the timed repeats run under the profiler. The uncore
+// is pinned by setting its min and max limit to the same
+// ratio. Each point reports time, energy, EDP, GFLOP/s and
+// GFLOP/J; points no other point beats on both time and
+// energy form the Pareto front; point i keeps its logs as
+// perflog.sweep<i>.txt and finalRes.sweep<i>.txt. The
+// original caps are restored afterwards, also on exit or
+// SIGINT/SIGTERM.
+// ------------------------------------------------------- //
+#define SWEEP_MAX_RATIOS 64
+
+typedef struct {
+        int core, uncore;               // ratios, 0 = left as is
+        double time, energy, gflops;    // time and energy over the same profiler window
+} sweep_point_t;
+
+// "a,b,c" or "lo:hi[:step]" items, comma separated; returns the count
+static int parse_ratio_list(const char* list, int* out) {
+        char buf[256];
+        char* save = NULL;
+        char* item;
+        int n = 0;
+
+        snprintf(buf, sizeof(buf), "%s", list);
+        for(item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+                int lo, hi, step = 1, fields = sscanf(item, "%d:%d:%d", &lo, &hi, &step);
+                if(fields == 1) hi = lo;
+                if(fields < 1 || lo < 1 || hi < lo || step < 1) {
+                        fprintf(stderr, "Error: --sweep expects ratios as a,b,c or lo:hi[:step], setting is: %s\n", list);
+                        exit(-1);
+                }
+                for(; lo <= hi && n < SWEEP_MAX_RATIOS; lo += step) out[n++] = lo;
+        }
+        return n;
+}
+
+static void sweep_signal(int sig) {
+        profiler_restore_frequency_caps_async();
+        _exit(128 + sig);
+}
+
+static void sweep_multiply(int N, double alpha, const double* A, const double* B,
+        double beta, double* C) {
+#if defined(USE_MKL) || defined(USE_CBLAS)
+        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, N, N, N, alpha, A, N, B, N, beta, C, N);
+#elif defined(USE_ESSL)
+        dgemm("N", "N", N, N, N, alpha, (double*) B, N, (double*) A, N, beta, C, N);
+#else
+        gemm_dgemm(GemmNoTrans, GemmNoTrans, N, N, N, alpha, A, N, B, N, beta, C, N);
+#endif
+}
+
+static int run_sweep(int N, int repeats, double alpha, double beta) {
+        int cores[SWEEP_MAX_RATIOS], uncores[SWEEP_MAX_RATIOS];
+        int ncore, nuncore = 1, c, u, p, q, r;
+        const size_t elements = (size_t) N * N;
+        const double N_dbl = (double) N;
+        const double flops = (N_dbl * N_dbl * N_dbl * 2.0 + N_dbl * N_dbl * 2.0) * (double) repeats;
+        char list[256];
+        char* slash;
+        size_t e;
+
+        snprintf(list, sizeof(list), "%s", opts.sweep);
+        slash = strchr(list, '/');
+        if(slash != NULL) *slash = '\0';
+        ncore = parse_ratio_list(list, cores);
+        uncores[0] = 0;
+        if(slash != NULL) nuncore = parse_ratio_list(slash + 1, uncores);
+
+        const int npoints = ncore * nuncore;
+        sweep_point_t* points = (sweep_point_t*) calloc(npoints, sizeof(sweep_point_t));
+
+        printf("Frequency sweep:      %d core x %d uncore ratios, %d repeats per point\n",
+                ncore, nuncore, repeats);
+        printf("Allocating Matrices...\n");
+
+        double* DGEMM_RESTRICT matrixA = (double*) malloc(sizeof(double) * elements);
+        double* DGEMM_RESTRICT matrixB = (double*) malloc(sizeof(double) * elements);
+        double* DGEMM_RESTRICT matrixC = (double*) malloc(sizeof(double) * elements);
+
+        if(points == NULL || matrixA == NULL || matrixB == NULL || matrixC == NULL) {
+                fprintf(stderr, "Error: unable to allocate matrices\n");
+                exit(-1);
+        }
+
+        #pragma omp parallel for
+        for(e = 0; e < elements; e++) {
+                matrixA[e] = 2.0;
+                matrixB[e] = 0.5;
+        }
+
+        signal(SIGINT, sweep_signal);
+        signal(SIGTERM, sweep_signal);
+
+        for(c = 0; c < ncore; c++) {
+                for(u = 0; u < nuncore; u++) {
+                        sweep_point_t* pt = &points[c * nuncore + u];
+                        pt->core = cores[c];
+                        pt->uncore = uncores[u];
+
+                        if(profiler_set_frequency_caps(pt->core, pt->uncore, pt->uncore) != 0) {
+                                fprintf(stderr, "Error: cannot set frequency caps (check PROFILER_MSR_DEVICE)\n");
+                                exit(-1);
+                        }
+
+                        #pragma omp parallel for
+                        for(e = 0; e < elements; e++) matrixC[e] = 1.0;
+
+                        sweep_multiply(N, alpha, matrixA, matrixB, beta, matrixC);  // settle
+
+                        profiler_start();
+                        const uint64_t start = get_nanoseconds();
+                        for(r = 0; r < repeats; r++) {
+                                profiler_phase_begin("multiply");
+                                sweep_multiply(N, alpha, matrixA, matrixB, beta, matrixC);
+                                profiler_phase_end();
+                        }
+                        const uint64_t end = get_nanoseconds();
+                        profiler_stop();
+
+                        // EDP, GFLOP/J and the Pareto front pair energy with time, so both
+                        // cover the profiler window; GFLOP/s rates the multiplies alone
+                        pt->time = profiler_window_sec();
+                        pt->energy = profiler_energy();
+                        pt->gflops = flops / nanoclock_to_sec(end - start) / 1.0e9;
+
+                        // keep each point's logs, the next profiler_start() overwrites them
+                        char logname[64];
+                        snprintf(logname, sizeof(logname), "perflog.sweep%d.txt", c * nuncore + u + 1);
+                        rename("perflog.txt", logname);
+                        snprintf(logname, sizeof(logname), "finalRes.sweep%d.txt", c * nuncore + u + 1);
+                        rename("finalRes.txt", logname);
+                        printf("Point %3d: core %5d MHz, uncore %5d MHz: %f s, %f J\n",
+                                c * nuncore + u + 1, pt->core * 100, pt->uncore * 100, pt->time, pt->energy);
+                }
+        }
+
+        profiler_restore_frequency_caps();
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        FILE* csv = NULL;
+        if(opts.sweep_csv != NULL && (csv = fopen(opts.sweep_csv, "w")) == NULL) perror(opts.sweep_csv);
+        if(csv != NULL) fprintf(csv, "core_mhz,uncore_mhz,time_s,energy_j,edp_js,gflops,gflop_per_j,pareto\n");
+
+        int best = -1, best_edp = -1;
+
+        printf("\n");
+        printf("===============================================================\n");
+        printf("Matrix size:          %d (%d threads)\n", N, omp_get_max_threads());
+        printf("%9s %11s %10s %11s %12s %9s %9s %s\n", "CORE(MHz)", "UNCORE(MHz)", "TIME(s)",
+                "ENERGY(J)", "EDP(J*s)", "GFLOP/s", "GFLOP/J", "PARETO");
+
+        for(p = 0; p < npoints; p++) {
+                const sweep_point_t* pt = &points[p];
+                const double edp = pt->energy * pt->time;
+                int pareto = 1;
+
+                for(q = 0; q < npoints && pareto; q++) {
+                        const sweep_point_t* o = &points[q];
+                        if(q != p && o->time <= pt->time && o->energy <= pt->energy &&
+                                (o->time < pt->time || o->energy < pt->energy)) pareto = 0;
+                }
+                if(pt->gflops >= opts.sweep_min_gflops &&
+                        (best < 0 || pt->energy < points[best].energy)) best = p;
+                if(best_edp < 0 || edp < points[best_edp].energy * points[best_edp].time) best_edp = p;
+
+                printf("%9d %11d %10.4f %11.3f %12.4f %9.3f %9.4f %s\n", pt->core * 100, pt->uncore * 100,
+                        pt->time, pt->energy, edp, pt->gflops,
+                        (pt->energy > 0) ? flops / pt->energy / 1.0e9 : 0, pareto ? "*" : "");
+                if(csv != NULL) {
+                        fprintf(csv, "%d,%d,%f,%f,%f,%f,%f,%d\n", pt->core * 100, pt->uncore * 100,
+                                pt->time, pt->energy, edp, pt->gflops,
+                                (pt->energy > 0) ? flops / pt->energy / 1.0e9 : 0, pareto);
+                }
+        }
+        if(csv != NULL) fclose(csv);
+
+        for(p = 0; p < npoints && points[p].energy > 0; p++);
+        if(p < npoints) {
+                printf("Warning: a point recorded no energy, raise the repeats so each point spans\n");
+                printf("         several profiler samples\n");
+        }
+        if(best >= 0) {
+                printf("Energy-optimal:       core %d MHz, uncore %d MHz (%f J, %f GF/s)\n",
+                        points[best].core * 100, points[best].uncore * 100,
+                        points[best].energy, points[best].gflops);
+        } else {
+                printf("Energy-optimal:       no point reaches %f GF/s\n", opts.sweep_min_gflops);
+        }
+        printf("Minimum EDP:          core %d MHz, uncore %d MHz (%f J*s)\n",
+                points[best_edp].core * 100, points[best_edp].uncore * 100,
+                points[best_edp].energy * points[best_edp].time);
+        printf("(uncore 0 MHz: limit left as is; * marks the time/energy Pareto front)\n");
+        printf("===============================================================\n");
+        printf("\n");
+
+        free(points);
+        free(matrixA);
+        free(matrixB);
+        free(matrixC);
+        return 0;
+}
+
+// ------------------------------------------------------- //
+// Out-of-core mode (--ooc=DIR)
+//
+// A, B and C live in files under DIR and are streamed
+// through tile buffers of at most --ooc-mem MB (ooc.h), so
+// N can exceed physical memory. Each repeat is one streamed
+// multiply. Besides the usual summary this reports the I/O
+// volume and bandwidth, the kernel rate inside the tiles
+// (what an in-core run of the same tiles would reach) and
+// how much of the I/O time the kernel hid.
+// ------------------------------------------------------- //
+static void ooc_tile_multiply(int m, int n, int k, double alpha, const double* A,
+        const double* B, double beta, double* C) {
+#if defined(USE_MKL) || defined(USE_CBLAS)
+        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, alpha, A, k, B, n, beta, C, n);
+#elif defined(USE_ESSL)
+        dgemm("N", "N", n, m, k, alpha, (double*) B, n, (double*) A, k, beta, C, n);
+#else
+        gemm_dgemm(GemmNoTrans, GemmNoTrans, m, n, k, alpha, A, k, B, n, beta, C, n);
+#endif
+}
+
+static int run_ooc(int N, int repeats, double alpha, double beta) {
+        const int tile = ooc_tile_size(N, (size_t) opts.ooc_mem << 20);
+        const int nt = (N + tile - 1) / tile;
+        ooc_matrices_t mats;
+        ooc_stats_t stats;
+        int r;
+
+        printf("Out-of-core mode:     %s, %d x %d tiles of %d (%f MB buffers)\n", opts.ooc, nt, nt, tile,
+                6.0 * tile * tile * sizeof(double) / (1024 * 1024));
+        printf("Creating matrix files...\n");
+
+        if(ooc_open(&mats, opts.ooc, N, tile, 2.0, 0.5, 1.0) != 0) {
+                exit(-1);
+        }
+
+        memset(&stats, 0, sizeof(stats));
+
+        uint64_t* repeat_stamps = (uint64_t*) malloc(sizeof(uint64_t) * (repeats + 1));
+        int* repeat_samples     = (int*) malloc(sizeof(int) * repeats);
+
+        printf("Performing multiplication...\n");
+        profiler_start();
+
+        const uint64_t start = get_nanoseconds();
+        repeat_stamps[0] = start;
+
+        for(r = 0; r < repeats; r++) {
+                repeat_samples[r] = profiler_sample_index();
+                profiler_phase_begin("multiply");
+                ooc_multiply(&mats, alpha, beta, ooc_tile_multiply, &stats);
+                repeat_stamps[r + 1] = get_nanoseconds();
+                profiler_phase_end();
+        }
+
+        const uint64_t end = get_nanoseconds();
+        profiler_stop();
+
+        printf("Calculating matrix check...\n");
+
+        const double final_sum = ooc_sum_c(&mats);
+        const double N_dbl = (double) N;
+        const double matrix_memory = 3.0 * N_dbl * N_dbl * sizeof(double);
+        const double time_taken = nanoclock_to_sec(end - start);
+        const double flops_computed = (N_dbl * N_dbl * N_dbl * 2.0 + N_dbl * N_dbl * 2.0) * (double) repeats;
+        const double io_time = nanoclock_to_sec(stats.io_ns);
+        const double io_bytes = stats.bytes_read + stats.bytes_written;
+        const double energy = profiler_energy();
+
+        printf("\n");
+        printf("===============================================================\n");
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <sys/time.h>
-#include <unistd.h>
+        printf("Final Sum is:         %f\n", (final_sum / (N_dbl * N_dbl * repeats)));
+        printf("Memory for Matrices:  %f MB (on disk)\n", (matrix_memory / (1024 * 1024)));
+        printf("Multiply time:        %f seconds\n", time_taken);
+        printf("FLOPs computed:       %f\n", flops_computed);
+        printf("GFLOP/s rate:         %f GF/s\n", (flops_computed / time_taken) / 1000000000.0);
+        printf("Energy:               %f J\n", energy);
+        printf("GFLOP/J rate:         %f GF/J\n", (energy > 0) ? flops_computed / energy / 1.0e9 : 0);
+        printf("In-tile GF/s rate:    %f GF/s (kernel time %f s)\n",
+                (stats.compute_ns > 0) ? flops_computed / nanoclock_to_sec(stats.compute_ns) / 1.0e9 : 0,
+                nanoclock_to_sec(stats.compute_ns));
+        printf("I/O volume:           %f MB read, %f MB written\n",
+                stats.bytes_read / (1024 * 1024), stats.bytes_written / (1024 * 1024));
+        printf("I/O bandwidth:        %f MB/s (I/O thread busy %f s)\n",
+                (io_time > 0) ? io_bytes / io_time / (1024 * 1024) : 0, io_time);
+        printf("Compute stall:        %f s\n", nanoclock_to_sec(stats.stall_ns));
+        printf("I/O hidden:           %f %%\n", (stats.io_ns > 0 && stats.io_ns > stats.stall_ns) ?
+                100.0 * (1.0 - (double) stats.stall_ns / stats.io_ns) : 0);
+
+        report_repeats(repeat_stamps, repeat_samples, repeats, flops_computed / repeats);
+
+        printf("===============================================================\n");
+        printf("\n");
+
+        ooc_close(&mats);
+        free(repeat_stamps);
+        free(repeat_samples);
+        return 0;
+}
+
+// ------------------------------------------------------- //
+// Reduced precision mode (--precision=fp32|bf16|fp16)
+// ------------------------------------------------------- //
+typedef struct {
+        int M, N, K;                    // op(A) is M x K, op(B) is K x N
+        int rowsA, rowsB;               // stored rows of A and B
+        int lda, ldb, ldc;
+} dgemm_shape_t;
+
+// Deterministic pseudo-random value in [-1, 1) for element e,
+// so rounding to the input precision actually loses bits
+static float lowp_value(size_t e, unsigned int salt) {
+        const unsigned int x = (unsigned int) (e * 2654435761u) ^ (salt * 0x9E3779B9u);
+        const unsigned int h = (x ^ (x >> 15)) * 0x2C1B3C6Du;
+        return (float) ((h >> 8) & 0xFFFFFF) / 8388608.0f - 1.0f;
+}
+
+static void lowp_store(void* p, size_t e, float v) {
+        switch(opts.precision) {
+        case GemmBF16: ((uint16_t*) p)[e] = gemm_float_to_bf16(v); break;
+        case GemmFP16: ((uint16_t*) p)[e] = gemm_float_to_fp16(v); break;
+        default:       ((float*) p)[e] = v; break;
+        }
+}
+
+static const char* lowp_kernel_label(void) {
 #ifdef USE_MKL
-#include "mkl.h"
+        return "mkl";
+#elif defined(USE_CBLAS)
+        if(opts.precision == GemmFP32) return "cblas";
+#elif defined(USE_ESSL)
+        if(opts.precision == GemmFP32) return "essl";
 #endif
+        return gemm_lowp_kernel_name(opts.precision);
+}
 
-#ifdef USE_CBLAS
-#include "cblas.h"
+// C = alpha * op(A) * op(B) + beta * C in the selected precision,
+// through the vendor library where it has the routine
+static void lowp_multiply(const dgemm_shape_t* s, float alpha, const void* A,
+        const void* B, float beta, float* C) {
+
+#if defined(USE_MKL) || defined(USE_CBLAS)
+        const CBLAS_TRANSPOSE ta = (opts.transA == GemmTrans) ? CblasTrans : CblasNoTrans;
+        const CBLAS_TRANSPOSE tb = (opts.transB == GemmTrans) ? CblasTrans : CblasNoTrans;
 #endif
 
-#ifdef USE_ESSL
-#include "essl.h"
+        switch(opts.precision) {
+        case GemmFP32:
+#if defined(USE_MKL) || defined(USE_CBLAS)
+                cblas_sgemm(CblasRowMajor, ta, tb, s->M, s->N, s->K, alpha,
+                        (const float*) A, s->lda, (const float*) B, s->ldb, beta, C, s->ldc);
+#elif defined(USE_ESSL)
+                sgemm(opts.transB == GemmTrans ? "T" : "N", opts.transA == GemmTrans ? "T" : "N",
+                        s->N, s->M, s->K, alpha, (float*) B, s->ldb, (float*) A, s->lda,
+                        beta, C, s->ldc);
+#else
+                gemm_sgemm(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                        (const float*) A, s->lda, (const float*) B, s->ldb, beta, C, s->ldc);
+#endif
+                break;
+        case GemmBF16:
+#ifdef USE_MKL
+                cblas_gemm_bf16bf16f32(CblasRowMajor, ta, tb, s->M, s->N, s->K, alpha,
+                        (const MKL_BF16*) A, s->lda, (const MKL_BF16*) B, s->ldb, beta, C, s->ldc);
+#else
+                gemm_bf16_gemm(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                        (const uint16_t*) A, s->lda, (const uint16_t*) B, s->ldb, beta, C, s->ldc);
 #endif
+                break;
+        case GemmFP16:
+#ifdef USE_MKL
+                cblas_gemm_f16f16f32(CblasRowMajor, ta, tb, s->M, s->N, s->K, alpha,
+                        (const MKL_F16*) A, s->lda, (const MKL_F16*) B, s->ldb, beta, C, s->ldc);
+#else
+                gemm_fp16_gemm(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                        (const uint16_t*) A, s->lda, (const uint16_t*) B, s->ldb, beta, C, s->ldc);
+#endif
+                break;
+        default:
+                break;
+        }
+}
+
+// ------------------------------------------------------- //
+// Function: run_lowp
+//
+// Multiplies pseudo-random inputs in the selected precision.
+// One untimed multiply is checked against an FP64 reference
+// computed from the unrounded inputs, then the timed repeats
+// run from a fresh C and report time, energy and GFLOP/J so
+// precisions can be compared run against run.
+// ------------------------------------------------------- //
+static int run_lowp(const dgemm_shape_t* s, int repeats, double alpha, double beta) {
+        const size_t elementsA = (size_t) s->rowsA * s->lda;
+        const size_t elementsB = (size_t) s->rowsB * s->ldb;
+        const size_t elementsC = (size_t) s->M * s->ldc;
+        const size_t in_size = (opts.precision == GemmFP32) ? sizeof(float) : sizeof(uint16_t);
+        size_t e;
+        int i, j, r;
 
+        gemm_lowp_emulate(opts.lowp_emulate);
 
-#define DGEMM_RESTRICT __restrict__
+        printf("Precision:            %s (kernel %s)\n", precision_names[opts.precision],
+                lowp_kernel_label());
+        printf("Allocating Matrices...\n");
+
+        void* matrixA = malloc(in_size * elementsA);
+        void* matrixB = malloc(in_size * elementsB);
+        float* matrixC = (float*) malloc(sizeof(float) * elementsC);
+
+        double* refA = (double*) malloc(sizeof(double) * elementsA);
+        double* refB = (double*) malloc(sizeof(double) * elementsB);
+        double* refC = (double*) malloc(sizeof(double) * elementsC);
+
+        if(matrixA == NULL || matrixB == NULL || matrixC == NULL ||
+                refA == NULL || refB == NULL || refC == NULL) {
+                fprintf(stderr, "Error: unable to allocate matrices\n");
+                exit(-1);
+        }
+
+        printf("Allocation complete, populating with values...\n");
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsA; e++) {
+                const float v = lowp_value(e, 1);
+                lowp_store(matrixA, e, v);
+                refA[e] = v;
+        }
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsB; e++) {
+                const float v = lowp_value(e, 2);
+                lowp_store(matrixB, e, v);
+                refB[e] = v;
+        }
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsC; e++) {
+                matrixC[e] = 1.0f;
+                refC[e] = 1.0;
+        }
+
+        printf("Checking accuracy against FP64...\n");
+
+        gemm_dgemm(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                refA, s->lda, refB, s->ldb, beta, refC, s->ldc);
+        lowp_multiply(s, (float) alpha, matrixA, matrixB, (float) beta, matrixC);
+
+        double max_err = 0, err_sq = 0, ref_sq = 0;
+
+        #pragma omp parallel for reduction(max:max_err) reduction(+:err_sq, ref_sq) private(j)
+        for(i = 0; i < s->M; i++) {
+                for(j = 0; j < s->N; j++) {
+                        const size_t at = (size_t) i * s->ldc + j;
+                        const double d = (double) matrixC[at] - refC[at];
+                        if(fabs(d) > max_err) max_err = fabs(d);
+                        err_sq += d * d;
+                        ref_sq += refC[at] * refC[at];
+                }
+        }
+
+        free(refA);
+        free(refB);
+        free(refC);
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsC; e++) matrixC[e] = 1.0f;
+
+        uint64_t* repeat_stamps = (uint64_t*) malloc(sizeof(uint64_t) * (repeats + 1));
+        int* repeat_samples     = (int*) malloc(sizeof(int) * repeats);
+
+        printf("Performing multiplication...\n");
+        profiler_start();
+
+        const uint64_t start = get_nanoseconds();
+        repeat_stamps[0] = start;
+
+        for(r = 0; r < repeats; r++) {
+                repeat_samples[r] = profiler_sample_index();
+                lowp_multiply(s, (float) alpha, matrixA, matrixB, (float) beta, matrixC);
+                repeat_stamps[r + 1] = get_nanoseconds();
+        }
+
+        const uint64_t end = get_nanoseconds();
+        profiler_stop();
+
+        printf("Calculating matrix check...\n");
+
+        double final_sum = 0;
+
+        #pragma omp parallel for reduction(+:final_sum) private(j)
+        for(i = 0; i < s->M; i++) {
+                for(j = 0; j < s->N; j++) {
+                        final_sum += matrixC[(size_t) i * s->ldc + j];
+                }
+        }
+
+        const double M_dbl = (double) s->M;
+        const double N_dbl = (double) s->N;
+        const double K_dbl = (double) s->K;
+        const double matrix_memory = (double) (in_size * (elementsA + elementsB) +
+                sizeof(float) * elementsC);
+        const double time_taken = nanoclock_to_sec(end - start);
+        const double flops_computed = (M_dbl * N_dbl * K_dbl * 2.0 * (double) repeats) +
+                (M_dbl * N_dbl * 2.0 * (double) repeats);
+        const double energy = profiler_energy();
+
+        printf("\n");
+        printf("===============================================================\n");
+
+        printf("Final Sum is:         %f\n", final_sum / (M_dbl * N_dbl * repeats));
+        printf("Memory for Matrices:  %f MB\n", (matrix_memory / (1024 * 1024)));
+        printf("Multiply time:        %f seconds\n", time_taken);
+        printf("FLOPs computed:       %f\n", flops_computed);
+        printf("GFLOP/s rate:         %f GF/s\n", (flops_computed / time_taken) / 1000000000.0);
+        printf("Energy:               %f J\n", energy);
+        printf("GFLOP/J rate:         %f GF/J\n", (energy > 0) ? flops_computed / energy / 1.0e9 : 0);
+        printf("Max abs error:        %e\n", max_err);
+        printf("Rel Frobenius error:  %e\n", (ref_sq > 0) ? sqrt(err_sq / ref_sq) : sqrt(err_sq));
+
+        report_repeats(repeat_stamps, repeat_samples, repeats, flops_computed / repeats);
+
+        printf("===============================================================\n");
+        printf("\n");
+
+        free(matrixA);
+        free(matrixB);
+        free(matrixC);
+        free(repeat_stamps);
+        free(repeat_samples);
+        return 0;
+}
 
 // ------------------------------------------------------- //
-// Function: get_seconds
+// Function: check_strassen
 //
-// Vendor may modify this call to provide higher resolution
-// timing if required
+// Strassen mode: multiplies pseudo-random inputs once with
+// the Strassen and the classical kernel from the same C and
+// reports the difference. The benchmark's constant inputs
+// are exact in either order of operations, so the check uses
+// its own values in the benchmark buffers before they are
+// populated. Returns the crossover actually used.
+// ------------------------------------------------------- //
+static int check_strassen(const dgemm_shape_t* s, double alpha, double beta,
+        double* A, double* B, double* C, double* max_err, double* rel_err) {
+
+        const size_t elementsA = (size_t) s->M * s->lda;
+        const size_t elementsB = (size_t) s->K * s->ldb;
+        const size_t elementsC = (size_t) s->M * s->ldc;
+        int crossover = opts.crossover;
+        int min_dim = s->M;
+        double err_sq = 0, ref_sq = 0, err = 0;
+        size_t e;
+        int i, j;
+
+        if(s->N < min_dim) min_dim = s->N;
+        if(s->K < min_dim) min_dim = s->K;
+
+        if(crossover < 0) {
+                printf("Tuning Strassen crossover...\n");
+                crossover = gemm_strassen_tune(min_dim);
+                // classical never lost: recurse no further than the top
+                if(crossover == 0) crossover = min_dim;
+        }
+
+        double* ref = (double*) malloc(sizeof(double) * elementsC);
+        if(ref == NULL) {
+                fprintf(stderr, "Error: unable to allocate the Strassen reference matrix\n");
+                exit(-1);
+        }
+
+        printf("Checking Strassen accuracy against classical...\n");
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsA; e++) A[e] = lowp_value(e, 1);
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsB; e++) B[e] = lowp_value(e, 2);
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsC; e++) C[e] = ref[e] = lowp_value(e, 3);
+
+        gemm_dgemm_strassen(s->M, s->N, s->K, alpha, A, s->lda, B, s->ldb, beta, C, s->ldc, crossover);
+        gemm_dgemm(GemmNoTrans, GemmNoTrans, s->M, s->N, s->K, alpha, A, s->lda, B, s->ldb,
+                beta, ref, s->ldc);
+
+        #pragma omp parallel for reduction(max:err) reduction(+:err_sq, ref_sq) private(j)
+        for(i = 0; i < s->M; i++) {
+                for(j = 0; j < s->N; j++) {
+                        const size_t at = (size_t) i * s->ldc + j;
+                        const double d = C[at] - ref[at];
+                        if(fabs(d) > err) err = fabs(d);
+                        err_sq += d * d;
+                        ref_sq += ref[at] * ref[at];
+                }
+        }
+
+        free(ref);
+
+        *max_err = err;
+        *rel_err = (ref_sq > 0) ? sqrt(err_sq / ref_sq) : sqrt(err_sq);
+        return crossover;
+}
+
+// ------------------------------------------------------- //
+// Function: measure_abft
+//
+// Cost of the ABFT checks: alternates unchecked and checked
+// multiplies on the benchmark operands (best of two each).
+// C is modified; the caller repopulates it.
+// ------------------------------------------------------- //
+static void measure_abft(const dgemm_shape_t* s, double alpha, double beta,
+        const double* A, const double* B, double* C, uint64_t* unchecked, uint64_t* checked) {
+
+        gemm_abft_t scratch;
+        int r;
+
+        gemm_abft_init(&scratch);
+        *unchecked = *checked = UINT64_MAX;
+
+        for(r = 0; r < 2; r++) {
+                uint64_t t = get_nanoseconds();
+                gemm_dgemm(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                        A, s->lda, B, s->ldb, beta, C, s->ldc);
+                t = get_nanoseconds() - t;
+                if(t < *unchecked) *unchecked = t;
+
+                t = get_nanoseconds();
+                gemm_dgemm_abft(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                        A, s->lda, B, s->ldb, beta, C, s->ldc, &scratch);
+                t = get_nanoseconds() - t;
+                if(t < *checked) *checked = t;
+        }
+}
+
+// ------------------------------------------------------- //
+// Function: measure_pack
+//
+// Share of the blocked kernel's thread time spent packing,
+// without and with the packing pipeline, from one timed
+// multiply of each schedule on the benchmark operands. The
+// times per multiply are the best of two further untimed
+// runs of each, alternated, so the clock reads around the
+// pack calls do not bias the comparison. C is modified; the
+// caller repopulates it.
 // ------------------------------------------------------- //
-double get_seconds() {
-        struct timeval now;
-        gettimeofday(&now, NULL);
+static void measure_pack(const dgemm_shape_t* s, double alpha, double beta,
+        const double* A, const double* B, double* C,
+        gemm_pack_stats_t* serial, gemm_pack_stats_t* pipelined,
+        uint64_t* serial_ns, uint64_t* pipelined_ns) {
 
-        const double seconds = (double) now.tv_sec;
-        const double usec    = (double) now.tv_usec;
+        int r, p;
 
-        return seconds + (usec * 1.0e-6);
+        memset(serial, 0, sizeof(*serial));
+        memset(pipelined, 0, sizeof(*pipelined));
+        *serial_ns = *pipelined_ns = UINT64_MAX;
+
+        gemm_dgemm_pipelined(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                A, s->lda, B, s->ldb, beta, C, s->ldc, 0, serial);
+        gemm_dgemm_pipelined(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                A, s->lda, B, s->ldb, beta, C, s->ldc, 1, pipelined);
+
+        for(r = 0; r < 2; r++) {
+                for(p = 0; p < 2; p++) {
+                        uint64_t* best = p ? pipelined_ns : serial_ns;
+                        uint64_t t = get_nanoseconds();
+                        gemm_dgemm_pipelined(opts.transA, opts.transB, s->M, s->N, s->K, alpha,
+                                A, s->lda, B, s->ldb, beta, C, s->ldc, p, NULL);
+                        t = get_nanoseconds() - t;
+                        if(t < *best) *best = t;
+                }
+        }
+}
+
+// Name of the multiply the timed loop runs, for the roofline CSV
+static const char* roofline_kernel_label(void) {
+#if defined(USE_MKL)
+        return opts.prepack ? "mkl-packed" : "mkl";
+#elif defined(USE_CBLAS)
+        return "cblas";
+#elif defined(USE_ESSL)
+        return "essl";
+#else
+        if(opts.naive) return "naive";
+        if(opts.strassen) return "strassen";
+        if(opts.abft) return "blocked-abft";
+        if(opts.prepack) return "blocked-packed";
+        if(opts.pack_pipeline) return "blocked-pipelined";
+        return "blocked";
+#endif
 }
 
 // ------------------------------------------------------- //
@@ -48,6 +1284,9 @@ double get_seconds() {
 //#include "dummy_main.h"
 
 int main(int argc, char* argv[]) {
+        parse_options(&argc, argv);
+        nanoclock_init(); // calibrate the shared clock once, before any timed region
+
         // ------------------------------------------------------- //
         // DO NOT CHANGE CODE BELOW
         // ------------------------------------------------------- //
@@ -89,28 +1328,248 @@ int main(int argc, char* argv[]) {
         printf("Alpha =    %f\n", alpha);
         printf("Beta  =    %f\n", beta);
 
-        if(N < 128) {
+        setup_affinity();
+
+        if(opts.sweep != NULL) {
+                if(opts.batch > 0 || opts.m > 0 || opts.transA != GemmNoTrans || opts.transB != GemmNoTrans ||
+                        opts.lda || opts.ldb || opts.ldc || opts.precision != GemmFP64 || opts.prepack ||
+                        opts.strassen || opts.abft || opts.roofline || opts.naive || opts.pack_pipeline) {
+                        fprintf(stderr, "Error: --sweep supports only the default fp64 N x N multiply\n");
+                        exit(-1);
+                }
+                return run_sweep(N, repeats, alpha, beta);
+        }
+
+        if(opts.ooc != NULL) {
+                if(opts.batch > 0 || opts.m > 0 || opts.transA != GemmNoTrans || opts.transB != GemmNoTrans ||
+                        opts.lda || opts.ldb || opts.ldc || opts.precision != GemmFP64 || opts.prepack ||
+                        opts.strassen || opts.abft || opts.roofline || opts.naive || opts.pack_pipeline) {
+                        fprintf(stderr, "Error: --ooc supports only the default fp64 N x N multiply\n");
+                        exit(-1);
+                }
+                return run_ooc(N, repeats, alpha, beta);
+        }
+
+        if(opts.batch > 0) {
+                if(opts.precision != GemmFP64 || opts.prepack || opts.strassen || opts.abft || opts.roofline ||
+                        opts.pack_pipeline) {
+                        fprintf(stderr, "Error: --batch supports only fp64 without --prepack, --strassen, --abft, --roofline or --pack-pipeline\n");
+                        exit(-1);
+                }
+                return run_batched(N, opts.batch, repeats, alpha, beta);
+        }
+
+        // General shape: op(A) is M x K, op(B) is K x N, C is M x N.
+        // Without --shape every dimension is N as in the original benchmark.
+        const int M   = (opts.m > 0) ? opts.m : N;
+        const int K   = (opts.k > 0) ? opts.k : N;
+        const int Ncol = (opts.n > 0) ? opts.n : N;
+
+        if(opts.m == 0 && N < 128) {
                 printf("Error: N (%d) is less than 128, the matrix is too small.\n", N);
                 exit(-1);
         }
 
+        // stored shapes: A is rowsA x lda, B is rowsB x ldb, C is M x ldc
+        const int rowsA = (opts.transA == GemmNoTrans) ? M : K;
+        const int colsA = (opts.transA == GemmNoTrans) ? K : M;
+        const int rowsB = (opts.transB == GemmNoTrans) ? K : Ncol;
+        const int colsB = (opts.transB == GemmNoTrans) ? Ncol : K;
+        const int lda = (opts.lda > 0) ? opts.lda : colsA;
+        const int ldb = (opts.ldb > 0) ? opts.ldb : colsB;
+        const int ldc = (opts.ldc > 0) ? opts.ldc : Ncol;
+
+        if(lda < colsA || ldb < colsB || ldc < Ncol) {
+                printf("Error: leading dimensions (%d, %d, %d) must be at least (%d, %d, %d).\n",
+                        lda, ldb, ldc, colsA, colsB, Ncol);
+                exit(-1);
+        }
+
+        if(opts.m > 0) {
+                printf("Shape M x N x K =     %d x %d x %d\n", M, Ncol, K);
+        }
+        printf("Transpose A, B =      %c%c\n", opts.transA == GemmTrans ? 'T' : 'N',
+                opts.transB == GemmTrans ? 'T' : 'N');
+        printf("Leading dimensions =  %d, %d, %d\n", lda, ldb, ldc);
+
+        if(opts.strassen) {
+#if defined(USE_MKL) || defined(USE_CBLAS) || defined(USE_ESSL)
+                fprintf(stderr, "Error: --strassen needs the native build\n");
+                exit(-1);
+#endif
+                if(opts.transA != GemmNoTrans || opts.transB != GemmNoTrans ||
+                        opts.precision != GemmFP64 || opts.prepack || opts.naive) {
+                        fprintf(stderr, "Error: --strassen supports only fp64 NN without --prepack or --kernel=naive\n");
+                        exit(-1);
+                }
+        }
+
+        if(opts.abft) {
+#if defined(USE_MKL) || defined(USE_CBLAS) || defined(USE_ESSL)
+                fprintf(stderr, "Error: --abft needs the native build\n");
+                exit(-1);
+#endif
+                if(opts.precision != GemmFP64 || opts.prepack || opts.naive || opts.strassen) {
+                        fprintf(stderr, "Error: --abft supports only the fp64 blocked kernel without --prepack or --strassen\n");
+                        exit(-1);
+                }
+        }
+
+        if(opts.pack_pipeline) {
+#if defined(USE_MKL) || defined(USE_CBLAS) || defined(USE_ESSL)
+                fprintf(stderr, "Error: --pack-pipeline needs the native build\n");
+                exit(-1);
+#endif
+                if(opts.precision != GemmFP64 || opts.prepack || opts.naive || opts.strassen || opts.abft) {
+                        fprintf(stderr, "Error: --pack-pipeline supports only the fp64 blocked kernel without --prepack, --strassen or --abft\n");
+                        exit(-1);
+                }
+        }
+
+        if(opts.precision != GemmFP64) {
+                if(opts.prepack || opts.roofline) {
+                        fprintf(stderr, "Error: --prepack and --roofline support only fp64\n");
+                        exit(-1);
+                }
+                const dgemm_shape_t shape = { M, Ncol, K, rowsA, rowsB, lda, ldb, ldc };
+                return run_lowp(&shape, repeats, alpha, beta);
+        }
+
+        // Roofs are measured before the matrices exist so the bandwidth
+        // probe has the memory to itself
+        roofline_machine_t roofs;
+        int imc_counters = 0;
+
+        if(opts.roofline) {
+                printf("Probing roofline...\n");
+                roofline_probe(&roofs);
+                imc_counters = roofline_imc_open();
+                printf("Roofline traffic:     %s\n", (imc_counters > 0) ?
+                        "IMC CAS counters" : "no IMC counters, estimated");
+        }
+
         printf("Allocating Matrices...\n");
 
-        double* DGEMM_RESTRICT matrixA = (double*) malloc(sizeof(double) * N * N);
-        double* DGEMM_RESTRICT matrixB = (double*) malloc(sizeof(double) * N * N);
-        double* DGEMM_RESTRICT matrixC = (double*) malloc(sizeof(double) * N * N);
+        const size_t elementsA = (size_t) rowsA * lda;
+        const size_t elementsB = (size_t) rowsB * ldb;
+        const size_t elementsC = (size_t) M * ldc;
+
+        double* DGEMM_RESTRICT matrixA = (double*) malloc(sizeof(double) * elementsA);
+        double* DGEMM_RESTRICT matrixB = (double*) malloc(sizeof(double) * elementsB);
+        double* DGEMM_RESTRICT matrixC = (double*) malloc(sizeof(double) * elementsC);
+
+        if(matrixA == NULL || matrixB == NULL || matrixC == NULL) {
+                fprintf(stderr, "Error: unable to allocate matrices\n");
+                exit(-1);
+        }
+
+        double strassen_max_err = 0, strassen_rel_err = 0;
+
+        if(opts.strassen) {
+                const dgemm_shape_t shape = { M, Ncol, K, rowsA, rowsB, lda, ldb, ldc };
+                opts.crossover = check_strassen(&shape, alpha, beta, matrixA, matrixB, matrixC,
+                        &strassen_max_err, &strassen_rel_err);
+        }
 
         printf("Allocation complete, populating with values...\n");
 
-        int i, j, k, r;
+        int i, j, r;
+        size_t e;
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsA; e++) matrixA[e] = 2.0;
+
+        #pragma omp parallel for
+        for(e = 0; e < elementsB; e++) matrixB[e] = 0.5;
 
         #pragma omp parallel for
-        for(i = 0; i < N; i++) {
-                for(j = 0; j < N; j++) {
-                        matrixA[i*N + j] = 2.0;
-                        matrixB[i*N + j] = 0.5;
-                        matrixC[i*N + j] = 1.0;
+        for(e = 0; e < elementsC; e++) matrixC[e] = 1.0;
+
+        gemm_abft_t abft;
+        uint64_t abft_unchecked = 0, abft_checked = 0;
+
+        gemm_abft_init(&abft);
+        if(opts.abft) {
+                const dgemm_shape_t shape = { M, Ncol, K, rowsA, rowsB, lda, ldb, ldc };
+
+                printf("Measuring ABFT overhead...\n");
+                measure_abft(&shape, alpha, beta, matrixA, matrixB, matrixC,
+                        &abft_unchecked, &abft_checked);
+
+                #pragma omp parallel for
+                for(e = 0; e < elementsC; e++) matrixC[e] = 1.0;
+
+                abft.inject_row = opts.inject_row;
+                abft.inject_col = opts.inject_col;
+        }
+
+        gemm_pack_stats_t pack_serial, pack_pipelined;
+        uint64_t pack_serial_ns = 0, pack_pipelined_ns = 0;
+
+        if(opts.pack_pipeline) {
+                const dgemm_shape_t shape = { M, Ncol, K, rowsA, rowsB, lda, ldb, ldc };
+
+                printf("Measuring packing...\n");
+                measure_pack(&shape, alpha, beta, matrixA, matrixB, matrixC,
+                        &pack_serial, &pack_pipelined, &pack_serial_ns, &pack_pipelined_ns);
+
+                #pragma omp parallel for
+                for(e = 0; e < elementsC; e++) matrixC[e] = 1.0;
+        }
+
+        // Per-repeat timestamps and profiler sample indices, allocated
+        // up front so the timed loop does no allocation or I/O
+        uint64_t* repeat_stamps = (uint64_t*) malloc(sizeof(uint64_t) * (repeats + 1));
+        int* repeat_samples     = (int*) malloc(sizeof(int) * repeats);
+
+        // Operands that stay fixed across repeats can be packed once
+        // into the kernel panel layout (--prepack); the one-time cost
+        // is reported separately from the timed loop
+#ifdef USE_MKL
+        double* packedA = NULL;
+        double* packedB = NULL;
+        const CBLAS_TRANSPOSE cblasA = (opts.transA == GemmTrans) ? CblasTrans : CblasNoTrans;
+        const CBLAS_TRANSPOSE cblasB = (opts.transB == GemmTrans) ? CblasTrans : CblasNoTrans;
+#elif !defined(USE_CBLAS) && !defined(USE_ESSL)
+        gemm_packed_t* packedA = NULL;
+        gemm_packed_t* packedB = NULL;
+#endif
+        double packed_bytes = 0;
+        uint64_t pack_time = 0;
+
+        if(opts.prepack) {
+                const uint64_t pack_start = get_nanoseconds();
+#ifdef USE_MKL
+                // MKL folds alpha into the packed copy: into A if it is
+                // packed, otherwise into B
+                if(opts.prepack & PREPACK_A) {
+                        const size_t bytes = cblas_dgemm_pack_get_size(CblasAMatrix, M, Ncol, K);
+                        packedA = (double*) mkl_malloc(bytes, 64);
+                        cblas_dgemm_pack(CblasRowMajor, CblasAMatrix, cblasA, M, Ncol, K,
+                                alpha, matrixA, lda, packedA);
+                        packed_bytes += (double) bytes;
+                }
+                if(opts.prepack & PREPACK_B) {
+                        const size_t bytes = cblas_dgemm_pack_get_size(CblasBMatrix, M, Ncol, K);
+                        packedB = (double*) mkl_malloc(bytes, 64);
+                        cblas_dgemm_pack(CblasRowMajor, CblasBMatrix, cblasB, M, Ncol, K,
+                                (opts.prepack & PREPACK_A) ? 1.0 : alpha, matrixB, ldb, packedB);
+                        packed_bytes += (double) bytes;
+                }
+#elif defined(USE_CBLAS) || defined(USE_ESSL)
+                fprintf(stderr, "Error: --prepack needs an MKL or native build\n");
+                exit(-1);
+#else
+                if(opts.prepack & PREPACK_A) {
+                        packedA = gemm_dgemm_pack(GemmMatrixA, opts.transA, M, Ncol, K, matrixA, lda);
+                        packed_bytes += (double) gemm_packed_bytes(packedA);
+                }
+                if(opts.prepack & PREPACK_B) {
+                        packedB = gemm_dgemm_pack(GemmMatrixB, opts.transB, M, Ncol, K, matrixB, ldb);
+                        packed_bytes += (double) gemm_packed_bytes(packedB);
                 }
+#endif
+                pack_time = get_nanoseconds() - pack_start;
         }
 
         printf("Performing multiplication...\n");
@@ -119,7 +1578,10 @@ int main(int argc, char* argv[]) {
         profiler_start();
         // ------------------------------------------------------- //
 
-        const double start = get_seconds();
+        if(imc_counters > 0) roofline_imc_start();
+
+        const uint64_t start = get_nanoseconds();
+        repeat_stamps[0] = start;
 
         // ------------------------------------------------------- //
         // VENDOR NOTIFICATION: START MODIFIABLE REGION
@@ -129,30 +1591,54 @@ int main(int argc, char* argv[]) {
         // change any lines above this statement.
         // ------------------------------------------------------- //
 
-        double sum = 0;
-
         // Repeat multiple times
         for(r = 0; r < repeats; r++) {
-#if defined(USE_MKL) || defined(USE_CBLAS)
-        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-            N, N, N, alpha, matrixA, N, matrixB, N, beta, matrixC, N);
+                repeat_samples[r] = profiler_sample_index();
+                profiler_phase_begin("multiply");
+#ifdef USE_MKL
+                if(opts.prepack) {
+                        cblas_dgemm_compute(CblasRowMajor,
+                                (opts.prepack & PREPACK_A) ? CblasPacked : cblasA,
+                                (opts.prepack & PREPACK_B) ? CblasPacked : cblasB,
+                                M, Ncol, K, (opts.prepack & PREPACK_A) ? packedA : matrixA, lda,
+                                (opts.prepack & PREPACK_B) ? packedB : matrixB, ldb, beta, matrixC, ldc);
+                } else {
+                        cblas_dgemm(CblasRowMajor, cblasA, cblasB,
+                                M, Ncol, K, alpha, matrixA, lda, matrixB, ldb, beta, matrixC, ldc);
+                }
+#elif defined(USE_CBLAS)
+        cblas_dgemm(CblasRowMajor,
+            opts.transA == GemmTrans ? CblasTrans : CblasNoTrans,
+            opts.transB == GemmTrans ? CblasTrans : CblasNoTrans,
+            M, Ncol, K, alpha, matrixA, lda, matrixB, ldb, beta, matrixC, ldc);
 #elif USE_ESSL
-        dgemm("N", "N",
-            N, N, N, alpha, matrixA, N, matrixB, N, beta, matrixC, N);
+        // column-major: compute C^T = op(B)^T * op(A)^T
+        dgemm(opts.transB == GemmTrans ? "T" : "N", opts.transA == GemmTrans ? "T" : "N",
+            Ncol, M, K, alpha, matrixB, ldb, matrixA, lda, beta, matrixC, ldc);
 #else
-                #pragma omp parallel for private(sum)
-                for(i = 0; i < N; i++) {
-                        for(j = 0; j < N; j++) {
-                                sum = 0;
-
-                                for(k = 0; k < N; k++) {
-                                        sum += matrixA[i*N + k] * matrixB[k*N + j];
-                                }
-
-                                matrixC[i*N + j] = (alpha * sum) + (beta * matrixC[i*N + j]);
-                        }
+                if(opts.naive) {
+                        gemm_dgemm_naive(opts.transA, opts.transB, M, Ncol, K,
+                                alpha, matrixA, lda, matrixB, ldb, beta, matrixC, ldc);
+                } else if(opts.strassen) {
+                        gemm_dgemm_strassen(M, Ncol, K, alpha, matrixA, lda, matrixB, ldb,
+                                beta, matrixC, ldc, opts.crossover);
+                } else if(opts.abft) {
+                        gemm_dgemm_abft(opts.transA, opts.transB, M, Ncol, K,
+                                alpha, matrixA, lda, matrixB, ldb, beta, matrixC, ldc, &abft);
+                        abft.inject_row = abft.inject_col = -1;         // first repeat only
+                } else if(opts.pack_pipeline) {
+                        gemm_dgemm_pipelined(opts.transA, opts.transB, M, Ncol, K,
+                                alpha, matrixA, lda, matrixB, ldb, beta, matrixC, ldc, 1, NULL);
+                } else if(opts.prepack) {
+                        gemm_dgemm_packed(opts.transA, opts.transB, M, Ncol, K, alpha,
+                                packedA, matrixA, lda, packedB, matrixB, ldb, beta, matrixC, ldc);
+                } else {
+                        gemm_dgemm(opts.transA, opts.transB, M, Ncol, K,
+                                alpha, matrixA, lda, matrixB, ldb, beta, matrixC, ldc);
                 }
 #endif
+                repeat_stamps[r + 1] = get_nanoseconds();
+                profiler_phase_end();
         }
 
         // ------------------------------------------------------- //
@@ -163,7 +1649,8 @@ int main(int argc, char* argv[]) {
         // DO NOT CHANGE CODE BELOW
         // ------------------------------------------------------- //
 
-        const double end = get_seconds();
+        const uint64_t end = get_nanoseconds();
+        const double imc_bytes = (imc_counters > 0) ? roofline_imc_bytes() : 0;
         
         // ------------------------------------------------------- //
         // ENDING THE PROFILER HERE 
@@ -175,16 +1662,18 @@ int main(int argc, char* argv[]) {
         double final_sum = 0;
         double count     = 0;
 
-        #pragma omp parallel for reduction(+:final_sum, count)
-        for(i = 0; i < N; i++) {
-                for(j = 0; j < N; j++) {
-                        final_sum += matrixC[i*N + j];
+        #pragma omp parallel for reduction(+:final_sum, count) private(j)
+        for(i = 0; i < M; i++) {
+                for(j = 0; j < Ncol; j++) {
+                        final_sum += matrixC[(size_t) i*ldc + j];
                         count += 1.0;
                 }
         }
 
-        double N_dbl = (double) N;
-        double matrix_memory = (3 * N_dbl * N_dbl) * ((double) sizeof(double));
+        const double M_dbl = (double) M;
+        const double N_dbl = (double) Ncol;
+        const double K_dbl = (double) K;
+        double matrix_memory = ((double) (elementsA + elementsB + elementsC)) * ((double) sizeof(double));
 
         printf("\n");
         printf("===============================================================\n");
@@ -193,23 +1682,106 @@ int main(int argc, char* argv[]) {
         printf("Memory for Matrices:  %f MB\n",
                 (matrix_memory / (1024 * 1024)));
 
-        const double time_taken = (end - start);
+        const double time_taken = nanoclock_to_sec(end - start);
 
         printf("Multiply time:        %f seconds\n", time_taken);
 
-        // O(N**3) elements each with one add and three multiplies
+        // O(M*N*K) elements each with one add and three multiplies
         // (alpha, beta and A_i*B_i).
-        const double flops_computed = (N_dbl * N_dbl * N_dbl * 2.0 * (double)(repeats)) +
-        (N_dbl * N_dbl * 2 * (double)(repeats));
+        const double flops_computed = (M_dbl * N_dbl * K_dbl * 2.0 * (double)(repeats)) +
+        (M_dbl * N_dbl * 2 * (double)(repeats));
 
         printf("FLOPs computed:       %f\n", flops_computed);
         printf("GFLOP/s rate:         %f GF/s\n", (flops_computed / time_taken) / 1000000000.0);
 
+        const double energy = profiler_energy();
+
+        printf("Energy:               %f J\n", energy);
+        printf("GFLOP/J rate:         %f GF/J\n", (energy > 0) ? flops_computed / energy / 1.0e9 : 0);
+
+        if(opts.strassen) {
+                printf("Strassen crossover:   %d (%d levels)\n", opts.crossover,
+                        gemm_strassen_levels(M, Ncol, K, opts.crossover));
+                printf("Effective GF/s rate:  %f GF/s (classical FLOP count)\n",
+                        (flops_computed / time_taken) / 1000000000.0);
+                printf("Max abs error:        %e\n", strassen_max_err);
+                printf("Rel Frobenius error:  %e\n", strassen_rel_err);
+        }
+
+        if(opts.abft) {
+                printf("ABFT tiles checked:   %ld\n", abft.tiles);
+                printf("ABFT bad tiles:       %ld\n", abft.bad_tiles);
+                if(abft.bad_tiles > 0) {
+                        printf("ABFT first mismatch:  C(%d, %d) in tile at (%d, %d), %d x %d, error %e\n",
+                                abft.row, abft.col, abft.tile_row, abft.tile_col,
+                                abft.tile_m, abft.tile_n, abft.error);
+                }
+                printf("ABFT overhead:        %f %% (%f s checked, %f s unchecked per multiply)\n",
+                        (abft_unchecked > 0) ? 100.0 * ((double) abft_checked / abft_unchecked - 1.0) : 0,
+                        nanoclock_to_sec(abft_checked), nanoclock_to_sec(abft_unchecked));
+        }
+
+        if(opts.pack_pipeline) {
+                printf("Pack fraction:        %f %% unpipelined (%f s per multiply)\n",
+                        (pack_serial.thread_ns > 0) ? 100.0 * pack_serial.pack_ns / pack_serial.thread_ns : 0,
+                        nanoclock_to_sec(pack_serial_ns));
+                printf("Pack fraction:        %f %% exposed + %f %% overlapped pipelined (%f s per multiply)\n",
+                        (pack_pipelined.thread_ns > 0) ? 100.0 * pack_pipelined.pack_ns / pack_pipelined.thread_ns : 0,
+                        (pack_pipelined.thread_ns > 0) ? 100.0 * pack_pipelined.overlapped_ns / pack_pipelined.thread_ns : 0,
+                        nanoclock_to_sec(pack_pipelined_ns));
+                printf("Pipeline speedup:     %f\n", (pack_pipelined_ns > 0) ?
+                        (double) pack_serial_ns / pack_pipelined_ns : 0);
+        }
+
+        if(opts.prepack) {
+                printf("Prepacked operands:   %s%s (%f MB)\n", (opts.prepack & PREPACK_A) ? "A" : "",
+                        (opts.prepack & PREPACK_B) ? "B" : "", packed_bytes / (1024 * 1024));
+                printf("Pack time:            %f seconds\n", nanoclock_to_sec(pack_time));
+                printf("GF/s including pack:  %f GF/s\n",
+                        (flops_computed / (time_taken + nanoclock_to_sec(pack_time))) / 1000000000.0);
+        }
+
+        report_repeats(repeat_stamps, repeat_samples, repeats, flops_computed / repeats);
+
+        if(opts.roofline) {
+                roofline_point_t point = { roofline_kernel_label(), M, Ncol, K,
+                        omp_get_max_threads(), repeats, time_taken, flops_computed,
+                        imc_bytes, "imc", energy };
+
+                if(imc_counters == 0) {
+#if defined(USE_MKL) || defined(USE_CBLAS) || defined(USE_ESSL)
+                        point.bytes = 0;
+#else
+                        point.bytes = (opts.naive || opts.strassen) ? 0 :
+                                gemm_dgemm_traffic(M, Ncol, K) * repeats;
+#endif
+                        point.traffic = "model";
+                        // no blocking model for this kernel: every operand
+                        // moves once per repeat (a lower bound)
+                        if(point.bytes == 0) {
+                                point.bytes = (M_dbl * K_dbl + K_dbl * N_dbl + 2.0 * M_dbl * N_dbl) *
+                                        sizeof(double) * repeats;
+                                point.traffic = "compulsory";
+                        }
+                }
+                roofline_report(opts.roofline, &roofs, &point);
+                roofline_imc_close();
+        }
+
         printf("===============================================================\n");
         printf("\n");
 
+#ifdef USE_MKL
+        mkl_free(packedA);
+        mkl_free(packedB);
+#elif !defined(USE_CBLAS) && !defined(USE_ESSL)
+        gemm_packed_free(packedA);
+        gemm_packed_free(packedB);
+#endif
         free(matrixA);
         free(matrixB);
         free(matrixC);
+        free(repeat_stamps);
+        free(repeat_samples);
         return 0;
 }
@@ -0,0 +1,943 @@
+// ------------------------------------------------------- //
+// Native matrix multiply kernels (see gemm.h)
+// ------------------------------------------------------- //
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <omp.h>
+#include "nanoclock.h"
+#include "gemm_internal.h"
+
+// ------------------------------------------------------- //
+// Blocking parameters
+//
+// KC is the depth of a packed panel (an MR x KC sliver of A
+// plus a KC x NR sliver of B stay in L1), MC x NC the largest
+// C tile a thread owns (packed A block in L2). Tiles shrink
+// down to the MIN sizes when there are too few to keep
+// threads busy. MR x NR is the register block of the FP64
+// micro-kernel; other precisions define their own.
+// ------------------------------------------------------- //
+#define GEMM_MR         4
+#define GEMM_NR         8
+#define GEMM_KC         256
+#define GEMM_MC_MAX     128
+#define GEMM_NC_MAX     512
+#define GEMM_MC_MIN     32
+#define GEMM_NC_MIN     64
+#define GEMM_ALIGN      64
+
+typedef struct {
+        int mc, nc;             // tile size
+        int mt, nt;             // number of tiles in M and N
+        int ksplit;             // number of K partitions (1 = no split)
+} gemm_plan_t;
+
+void* gemm_alloc(size_t bytes) {
+        bytes = (bytes + GEMM_ALIGN - 1) / GEMM_ALIGN * GEMM_ALIGN;
+        return aligned_alloc(GEMM_ALIGN, bytes > 0 ? bytes : GEMM_ALIGN);
+}
+
+static int ceil_div(int a, int b) {
+        return (a + b - 1) / b;
+}
+
+static void gemm_make_plan(int M, int N, int K, int threads, gemm_plan_t* p) {
+        p->mc = GEMM_MC_MAX;
+        p->nc = GEMM_NC_MAX;
+        p->ksplit = 1;
+
+        // shrink N first (B panels are the cheaper operand to repack),
+        // then M, until there are at least two tiles per thread
+        while(ceil_div(M, p->mc) * ceil_div(N, p->nc) < 2 * threads) {
+                if(p->nc > GEMM_NC_MIN && p->nc < N * 2) p->nc /= 2;
+                else if(p->mc > GEMM_MC_MIN && p->mc < M * 2) p->mc /= 2;
+                else break;
+        }
+
+        p->mt = ceil_div(M, p->mc);
+        p->nt = ceil_div(N, p->nc);
+
+        // still not enough tiles: split a long K dimension across threads
+        const int tiles = p->mt * p->nt;
+        if(tiles < threads && K > 2 * GEMM_KC) {
+                p->ksplit = threads / tiles;
+                if(p->ksplit > ceil_div(K, GEMM_KC)) p->ksplit = ceil_div(K, GEMM_KC);
+        }
+}
+
+// ------------------------------------------------------- //
+// FP64 packing
+//
+// A block (mc x kc of op(A)) is stored as MR-row slivers, each
+// kc x MR with the MR values of one k contiguous. B panel
+// (kc x nc of op(B)) as NR-column slivers, each kc x NR.
+// Edges are zero padded so the micro-kernel always runs full.
+// ------------------------------------------------------- //
+static void gemm_pack_A(const gemm_args_t* g, int i0, int mc, int k0, int kc, void* out) {
+        const double* A = (const double*) g->A;
+        double* GEMM_RESTRICT buf = (double*) out;
+        int ir, ii, k;
+
+        for(ir = 0; ir < mc; ir += GEMM_MR) {
+                double* GEMM_RESTRICT dst = buf + (size_t) ir * kc;
+                const int mr = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+
+                if(g->transA == GemmNoTrans) {
+                        for(ii = 0; ii < mr; ii++) {
+                                const double* src = A + (size_t) (i0 + ir + ii) * g->lda + k0;
+                                for(k = 0; k < kc; k++) dst[k * GEMM_MR + ii] = src[k];
+                        }
+                } else {
+                        for(k = 0; k < kc; k++) {
+                                const double* src = A + (size_t) (k0 + k) * g->lda + i0 + ir;
+                                for(ii = 0; ii < mr; ii++) dst[k * GEMM_MR + ii] = src[ii];
+                        }
+                }
+                for(ii = mr; ii < GEMM_MR; ii++) {
+                        for(k = 0; k < kc; k++) dst[k * GEMM_MR + ii] = 0.0;
+                }
+        }
+}
+
+static void gemm_pack_B(const gemm_args_t* g, int j0, int nc, int k0, int kc, void* out) {
+        const double* B = (const double*) g->B;
+        double* GEMM_RESTRICT buf = (double*) out;
+        int jr, jj, k;
+
+        for(jr = 0; jr < nc; jr += GEMM_NR) {
+                double* GEMM_RESTRICT dst = buf + (size_t) jr * kc;
+                const int nr = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+
+                if(g->transB == GemmNoTrans) {
+                        for(k = 0; k < kc; k++) {
+                                const double* src = B + (size_t) (k0 + k) * g->ldb + j0 + jr;
+                                for(jj = 0; jj < nr; jj++) dst[k * GEMM_NR + jj] = src[jj];
+                                for(jj = nr; jj < GEMM_NR; jj++) dst[k * GEMM_NR + jj] = 0.0;
+                        }
+                } else {
+                        for(jj = 0; jj < nr; jj++) {
+                                const double* src = B + (size_t) (j0 + jr + jj) * g->ldb + k0;
+                                for(k = 0; k < kc; k++) dst[k * GEMM_NR + jj] = src[k];
+                        }
+                        for(jj = nr; jj < GEMM_NR; jj++) {
+                                for(k = 0; k < kc; k++) dst[k * GEMM_NR + jj] = 0.0;
+                        }
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// FP64 micro-kernel: C[mr x nr] += alpha * a-sliver * b-sliver
+//
+// The MR x NR accumulator is held in registers; the fixed
+// trip counts let the compiler vectorize over NR.
+// ------------------------------------------------------- //
+static void gemm_micro(int kc, const void* ap, const void* bp,
+        double alpha, void* Cp, int ldc, int mr, int nr) {
+
+        const double* GEMM_RESTRICT a = (const double*) ap;
+        const double* GEMM_RESTRICT b = (const double*) bp;
+        double* GEMM_RESTRICT C = (double*) Cp;
+        double acc[GEMM_MR][GEMM_NR];
+        int i, j, k;
+
+        for(i = 0; i < GEMM_MR; i++)
+                for(j = 0; j < GEMM_NR; j++) acc[i][j] = 0.0;
+
+        for(k = 0; k < kc; k++) {
+                for(i = 0; i < GEMM_MR; i++) {
+                        const double av = a[k * GEMM_MR + i];
+                        for(j = 0; j < GEMM_NR; j++) acc[i][j] += av * b[k * GEMM_NR + j];
+                }
+        }
+
+        if(mr == GEMM_MR && nr == GEMM_NR) {
+                for(i = 0; i < GEMM_MR; i++)
+                        for(j = 0; j < GEMM_NR; j++) C[(size_t) i * ldc + j] += alpha * acc[i][j];
+        } else {
+                for(i = 0; i < mr; i++)
+                        for(j = 0; j < nr; j++) C[(size_t) i * ldc + j] += alpha * acc[i][j];
+        }
+}
+
+static const gemm_kernel_t gemm_kernel_fp64 = {
+        "fp64", GEMM_MR, GEMM_NR, 1, sizeof(double), sizeof(double),
+        gemm_pack_A, gemm_pack_B, gemm_micro
+};
+
+// ------------------------------------------------------- //
+// C helpers for either element type (double or float)
+// ------------------------------------------------------- //
+
+// Scale an m x n block of C by beta (beta == 0 clears, so NaNs in C are not propagated)
+static void gemm_scale(size_t c_size, double beta, void* C, int ldc, int m, int n) {
+        int i, j;
+
+        if(beta == 1.0) return;
+        for(i = 0; i < m; i++) {
+                if(c_size == sizeof(double)) {
+                        double* c = (double*) C + (size_t) i * ldc;
+                        if(beta == 0.0) memset(c, 0, sizeof(double) * n);
+                        else for(j = 0; j < n; j++) c[j] *= beta;
+                } else {
+                        float* c = (float*) C + (size_t) i * ldc;
+                        if(beta == 0.0) memset(c, 0, sizeof(float) * n);
+                        else for(j = 0; j < n; j++) c[j] *= (float) beta;
+                }
+        }
+}
+
+// dst[0..n) += src[0..n)
+static void gemm_add_row(size_t c_size, void* dst, const void* src, int n) {
+        int j;
+
+        if(c_size == sizeof(double)) {
+                for(j = 0; j < n; j++) ((double*) dst)[j] += ((const double*) src)[j];
+        } else {
+                for(j = 0; j < n; j++) ((float*) dst)[j] += ((const float*) src)[j];
+        }
+}
+
+static void* gemm_c_at(size_t c_size, void* C, int ldc, int i, int j) {
+        return (char*) C + ((size_t) i * ldc + j) * c_size;
+}
+
+// ------------------------------------------------------- //
+// Whole-operand packed layout (see gemm_internal.h): the
+// sliver starting at row r0 of the K block starting at k0.
+// Every block before k0 is a full KC deep, so its packed
+// depth is KC as long as KC is a multiple of the kernel kunit.
+// ------------------------------------------------------- //
+static size_t gemm_packed_offset(int rows, int unit, int k0, int kcp, int r0, size_t pack_size) {
+        const size_t rows_p = (size_t) ceil_div(rows, unit) * unit;
+        return (rows_p * k0 + (size_t) r0 * kcp) * pack_size;
+}
+
+gemm_packed_t* gemm_pack_operand(const gemm_args_t* g, gemm_operand_t which) {
+        const gemm_kernel_t* kern = g->kernel;
+        const int rows = (which == GemmMatrixA) ? g->M : g->N;
+        const int unit = (which == GemmMatrixA) ? kern->mr : kern->nr;
+        const int K = g->K;
+        const int blocks = ceil_div(K, GEMM_KC);
+        const int chunks = ceil_div(rows, GEMM_MC_MAX);
+        const int tail = K - (blocks - 1) * GEMM_KC;
+        const size_t depth = (size_t) (blocks - 1) * GEMM_KC + gemm_kc_packed(kern, tail);
+        gemm_packed_t* p = (gemm_packed_t*) malloc(sizeof(gemm_packed_t));
+        int t;
+
+        if(p == NULL || rows <= 0 || K <= 0) {
+                free(p);
+                return NULL;
+        }
+
+        p->kernel = kern;
+        p->which = which;
+        p->rows = rows;
+        p->K = K;
+        p->bytes = (size_t) ceil_div(rows, unit) * unit * depth * kern->pack_size;
+        p->data = gemm_alloc(p->bytes);
+
+        if(p->data == NULL) {
+                free(p);
+                return NULL;
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for(t = 0; t < blocks * chunks; t++) {
+                const int k0 = (t / chunks) * GEMM_KC;
+                const int r0 = (t % chunks) * GEMM_MC_MAX;
+                const int kc = (K - k0 < GEMM_KC) ? K - k0 : GEMM_KC;
+                const int n = (rows - r0 < GEMM_MC_MAX) ? rows - r0 : GEMM_MC_MAX;
+                char* dst = (char*) p->data + gemm_packed_offset(rows, unit, k0,
+                        gemm_kc_packed(kern, kc), r0, kern->pack_size);
+
+                if(which == GemmMatrixA) kern->pack_A(g, r0, n, k0, kc, dst);
+                else kern->pack_B(g, r0, n, k0, kc, dst);
+        }
+
+        return p;
+}
+
+// ------------------------------------------------------- //
+// ABFT checksums of one tile (FP64 kernel only)
+//
+// Per K block the packed A block gets one extra sliver holding
+// its column sums and the packed B panel one extra sliver
+// holding its row sums. Running the micro-kernel on these
+// against the regular panels yields the expected column and
+// row sums of the tile at kernel speed (MR / mc + NR / nc
+// extra work). The rounding bound comes from the sums of
+// absolute values of the same operands.
+// ------------------------------------------------------- //
+typedef struct {
+        double col[GEMM_NC_MAX];                // expected column sums (a 1 x nc C block)
+        double row[GEMM_MC_MAX * GEMM_NR];      // expected row sums (column 0 of an mc x NR block)
+        double chk_a[GEMM_MR * GEMM_KC];        // A checksum sliver, column sums in lane 0
+        double chk_b[GEMM_NR * GEMM_KC];        // B checksum sliver, row sums in lane 0
+        double lanes[2 * GEMM_NR * GEMM_KC];    // per-lane partial sums
+        double sa_abs[GEMM_KC];                 // column sums of |A block|
+        double bound;                           // sum of |A||B| terms plus |C| before the update
+        double cs[GEMM_NC_MAX], cs_abs[GEMM_NC_MAX];    // actual column sums
+} gemm_abft_sums_t;
+
+// Sum the packed slivers of one operand lane by lane (vectorizes
+// over a sliver), then across the lanes: sum[k] / sum_abs[k]
+static void gemm_abft_lanes(double* GEMM_RESTRICT lanes, const double* p, int n, int lanes_n, int kc,
+        double* sum, int sum_stride, double* sum_abs) {
+
+        double* GEMM_RESTRICT l_abs = lanes + (size_t) lanes_n * kc;
+        int r, k, l;
+
+        memset(lanes, 0, sizeof(double) * 2 * lanes_n * kc);
+        for(r = 0; r < n; r += lanes_n) {
+                const double* GEMM_RESTRICT v = p + (size_t) r * kc;
+                for(k = 0; k < kc * lanes_n; k++) {
+                        lanes[k] += v[k];
+                        l_abs[k] += fabs(v[k]);
+                }
+        }
+        for(k = 0; k < kc; k++) {
+                double t = 0.0, ta = 0.0;
+                for(l = 0; l < lanes_n; l++) {
+                        t += lanes[k * lanes_n + l];
+                        ta += l_abs[k * lanes_n + l];
+                }
+                sum[k * sum_stride] = t;
+                sum_abs[k] = ta;
+        }
+}
+
+// Add alpha * (A block x B panel) checksums for one packed K block
+static void gemm_abft_block(gemm_abft_sums_t* s, const double* Ap, const double* Bp,
+        int mc, int nc, int kc, double alpha) {
+
+        double sb_abs[GEMM_KC];
+        double bound = 0.0;
+        int ir, jr, k;
+
+        memset(s->chk_a, 0, sizeof(double) * GEMM_MR * kc);
+        memset(s->chk_b, 0, sizeof(double) * GEMM_NR * kc);
+        gemm_abft_lanes(s->lanes, Ap, mc, GEMM_MR, kc, s->chk_a, GEMM_MR, s->sa_abs);
+        gemm_abft_lanes(s->lanes, Bp, nc, GEMM_NR, kc, s->chk_b, GEMM_NR, sb_abs);
+
+        for(k = 0; k < kc; k++) bound += s->sa_abs[k] * sb_abs[k];
+        s->bound += fabs(alpha) * bound;
+
+        for(jr = 0; jr < nc; jr += GEMM_NR) {
+                const int nr = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+                gemm_micro(kc, s->chk_a, Bp + (size_t) jr * kc, alpha, s->col + jr, GEMM_NC_MAX, 1, nr);
+        }
+        for(ir = 0; ir < mc; ir += GEMM_MR) {
+                const int mr = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+                gemm_micro(kc, Ap + (size_t) ir * kc, s->chk_b, alpha, s->row + (size_t) ir * GEMM_NR,
+                        GEMM_NR, mr, 1);
+        }
+}
+
+// Row sum (and sum of absolute values) of n values, NR lanes at a time
+static void gemm_abft_row_sum(const double* GEMM_RESTRICT c, int n, double* sum, double* sum_abs) {
+        double r[GEMM_NR] = { 0 }, ra[GEMM_NR] = { 0 };
+        double t = 0.0, ta = 0.0;
+        int j, l;
+
+        for(j = 0; j + GEMM_NR <= n; j += GEMM_NR) {
+                for(l = 0; l < GEMM_NR; l++) {
+                        r[l] += c[j + l];
+                        ra[l] += fabs(c[j + l]);
+                }
+        }
+        for(; j < n; j++) {
+                t += c[j];
+                ta += fabs(c[j]);
+        }
+        for(l = 0; l < GEMM_NR; l++) {
+                t += r[l];
+                ta += ra[l];
+        }
+        *sum = t;
+        *sum_abs = ta;
+}
+
+// Actual row sums (returned in row_sum / row_abs) and column sums
+// (into s->cs / s->cs_abs) of an mc x nc block of C
+static void gemm_abft_sum_tile(gemm_abft_sums_t* s, const double* C, int ldc, int mc, int nc,
+        double* row_sum, int row_stride, double* row_abs) {
+
+        int i, j;
+
+        for(j = 0; j < nc; j++) s->cs[j] = s->cs_abs[j] = 0.0;
+        for(i = 0; i < mc; i++) {
+                const double* GEMM_RESTRICT c = C + (size_t) i * ldc;
+                double ra;
+                gemm_abft_row_sum(c, nc, &row_sum[(size_t) i * row_stride], &ra);
+                if(row_abs != NULL) row_abs[i] = ra;
+                for(j = 0; j < nc; j++) {
+                        s->cs[j] += c[j];
+                        s->cs_abs[j] += fabs(c[j]);
+                }
+        }
+}
+
+// Start from the current (beta scaled) contents of the tile
+static void gemm_abft_begin(gemm_abft_sums_t* s, const double* C, int ldc, int mc, int nc) {
+        int j;
+
+        gemm_abft_sum_tile(s, C, ldc, mc, nc, s->row, GEMM_NR, NULL);
+        s->bound = 0.0;
+        for(j = 0; j < nc; j++) {
+                s->col[j] = s->cs[j];
+                s->bound += s->cs_abs[j];
+        }
+}
+
+// Compare the finished tile (origin i0, j0 of C) with its checksums
+static void gemm_abft_check(gemm_abft_sums_t* s, gemm_abft_t* abft, const double* C, int ldc,
+        int i0, int mc, int j0, int nc, int kdepth) {
+
+        // worst-case accumulated rounding of the tile and checksum sums
+        const double gamma = (double) (kdepth + mc + nc + 8) * DBL_EPSILON;
+        double row_sum[GEMM_MC_MAX], row_abs[GEMM_MC_MAX];
+        double worst = 0.0;
+        int bad_row = -1, bad_col = -1;
+        int i, j;
+
+        gemm_abft_sum_tile(s, C, ldc, mc, nc, row_sum, 1, row_abs);
+
+        for(i = 0; i < mc; i++) {
+                const double d = fabs(row_sum[i] - s->row[(size_t) i * GEMM_NR]);
+                if(!(d <= gamma * (s->bound + row_abs[i]))) {
+                        if(bad_row < 0) bad_row = i;
+                        if(d > worst || d != d) worst = d;
+                }
+        }
+        for(j = 0; j < nc; j++) {
+                const double d = fabs(s->cs[j] - s->col[j]);
+                if(!(d <= gamma * (s->bound + s->cs_abs[j]))) {
+                        if(bad_col < 0) bad_col = j;
+                        if(d > worst || d != d) worst = d;
+                }
+        }
+
+        #pragma omp atomic
+        abft->tiles++;
+
+        if(bad_row >= 0 || bad_col >= 0) {
+                #pragma omp critical(gemm_abft)
+                {
+                        if(abft->bad_tiles++ == 0) {
+                                abft->row = (bad_row >= 0) ? i0 + bad_row : -1;
+                                abft->col = (bad_col >= 0) ? j0 + bad_col : -1;
+                                abft->tile_row = i0;
+                                abft->tile_col = j0;
+                                abft->tile_m = mc;
+                                abft->tile_n = nc;
+                        }
+                        if(worst > abft->error || worst != worst) abft->error = worst;
+                }
+        }
+}
+
+// Runs a packing call, adding its duration to *ns unless ns is NULL
+#define GEMM_TIMED_PACK(ns, call)                                               \
+        do {                                                                    \
+                if((ns) != NULL) {                                              \
+                        const uint64_t pack_start_ = nanoclock_now();           \
+                        call;                                                   \
+                        *(ns) += nanoclock_now() - pack_start_;                 \
+                } else {                                                        \
+                        call;                                                   \
+                }                                                               \
+        } while(0)
+
+// ------------------------------------------------------- //
+// Packs slivers [first, last) of the K block [k0, k0 + kc)
+// of one tile: the A block's MR-row slivers are numbered
+// first, then the B panel's NR-column slivers. Operands
+// with whole-operand panels have no slivers to pack.
+// ------------------------------------------------------- //
+static void gemm_pack_slivers(const gemm_args_t* g, int i0, int mc, int j0, int nc, int k0, int kc,
+        char* Apack, char* Bpack, int first, int last, uint64_t* pack_ns) {
+
+        const gemm_kernel_t* kern = g->kernel;
+        const size_t sliver = (size_t) gemm_kc_packed(kern, kc) * kern->pack_size;
+        const int a_slivers = (g->Apacked != NULL) ? 0 : ceil_div(mc, kern->mr);
+
+        if(first < a_slivers) {
+                const int end = (last < a_slivers) ? last : a_slivers;
+                const int r0 = first * kern->mr;
+                const int r1 = (end * kern->mr < mc) ? end * kern->mr : mc;
+                GEMM_TIMED_PACK(pack_ns, kern->pack_A(g, i0 + r0, r1 - r0, k0, kc,
+                        Apack + (size_t) r0 * sliver));
+                first = end;
+        }
+        if(first < last && g->Bpacked == NULL) {
+                const int c0 = (first - a_slivers) * kern->nr;
+                const int c1 = ((last - a_slivers) * kern->nr < nc) ? (last - a_slivers) * kern->nr : nc;
+                GEMM_TIMED_PACK(pack_ns, kern->pack_B(g, j0 + c0, c1 - c0, k0, kc,
+                        Bpack + (size_t) c0 * sliver));
+        }
+}
+
+// ------------------------------------------------------- //
+// gemm_tile with the packing pipelined: Apack and Bpack hold
+// two buffers each, block p computes from one while the
+// slivers of block p + 1 are packed into the other, a share
+// after every NR column of micro-kernels.
+// ------------------------------------------------------- //
+static void gemm_tile_pipelined(const gemm_args_t* g, int i0, int mc, int j0, int nc, int k0, int k1,
+        void* C, int ldc, char* Apack, char* Bpack, gemm_abft_sums_t* sums, gemm_pack_stats_t* timing) {
+
+        const gemm_kernel_t* kern = g->kernel;
+        const size_t kc_max = (size_t) gemm_kc_packed(kern, GEMM_KC);
+        char* Abuf[2] = { Apack, Apack + (size_t) ceil_div(mc, kern->mr) * kern->mr * kc_max * kern->pack_size };
+        char* Bbuf[2] = { Bpack, Bpack + (size_t) ceil_div(nc, kern->nr) * kern->nr * kc_max * kern->pack_size };
+        const int slivers = ((g->Apacked != NULL) ? 0 : ceil_div(mc, kern->mr)) +
+                ((g->Bpacked != NULL) ? 0 : ceil_div(nc, kern->nr));
+        const int share = ceil_div(slivers, ceil_div(nc, kern->nr));
+        int pc, ir, jr, cur = 0;
+
+        gemm_pack_slivers(g, i0, mc, j0, nc, k0, (k1 - k0 < GEMM_KC) ? k1 - k0 : GEMM_KC,
+                Abuf[0], Bbuf[0], 0, slivers, (timing != NULL) ? &timing->pack_ns : NULL);
+
+        for(pc = k0; pc < k1; pc += GEMM_KC, cur ^= 1) {
+                const int kc = (k1 - pc < GEMM_KC) ? k1 - pc : GEMM_KC;
+                const int kcp = gemm_kc_packed(kern, kc);
+                const int next = pc + GEMM_KC;
+                const int kc_next = (next >= k1) ? 0 : (k1 - next < GEMM_KC) ? k1 - next : GEMM_KC;
+                const char* Ap = (g->Apacked != NULL) ? (const char*) g->Apacked +
+                        gemm_packed_offset(g->M, kern->mr, pc, kcp, i0, kern->pack_size) : Abuf[cur];
+                const char* Bp = (g->Bpacked != NULL) ? (const char*) g->Bpacked +
+                        gemm_packed_offset(g->N, kern->nr, pc, kcp, j0, kern->pack_size) : Bbuf[cur];
+                int done = 0;
+
+                if(sums != NULL) {
+                        gemm_abft_block(sums, (const double*) Ap, (const double*) Bp, mc, nc, kcp, g->alpha);
+                }
+
+                for(jr = 0; jr < nc; jr += kern->nr) {
+                        const int nr = (nc - jr < kern->nr) ? nc - jr : kern->nr;
+                        for(ir = 0; ir < mc; ir += kern->mr) {
+                                const int mr = (mc - ir < kern->mr) ? mc - ir : kern->mr;
+                                kern->micro(kcp, Ap + (size_t) ir * kcp * kern->pack_size,
+                                        Bp + (size_t) jr * kcp * kern->pack_size, g->alpha,
+                                        gemm_c_at(kern->c_size, C, ldc, i0 + ir, j0 + jr), ldc, mr, nr);
+                        }
+                        if(kc_next > 0 && done < slivers) {
+                                const int last = (done + share < slivers) ? done + share : slivers;
+                                gemm_pack_slivers(g, i0, mc, j0, nc, next, kc_next,
+                                        Abuf[cur ^ 1], Bbuf[cur ^ 1], done, last,
+                                        (timing != NULL) ? &timing->overlapped_ns : NULL);
+                                done = last;
+                        }
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// One C tile over the K range [k0, k1): C is the origin of the
+// output matrix, the tile starts at (i0, j0).
+// ------------------------------------------------------- //
+static void gemm_tile(const gemm_args_t* g, int i0, int mc, int j0, int nc, int k0, int k1,
+        void* C, int ldc, char* Apack, char* Bpack, gemm_abft_sums_t* sums, gemm_pack_stats_t* timing) {
+
+        const gemm_kernel_t* kern = g->kernel;
+        uint64_t* pack_ns = (timing != NULL) ? &timing->pack_ns : NULL;
+        int pc, ir, jr;
+
+        if(g->pipeline) {
+                gemm_tile_pipelined(g, i0, mc, j0, nc, k0, k1, C, ldc, Apack, Bpack, sums, timing);
+                return;
+        }
+
+        for(pc = k0; pc < k1; pc += GEMM_KC) {
+                const int kc = (k1 - pc < GEMM_KC) ? k1 - pc : GEMM_KC;
+                const int kcp = gemm_kc_packed(kern, kc);
+                const char* Ap = Apack;
+                const char* Bp = Bpack;
+
+                if(g->Bpacked != NULL) {
+                        Bp = (const char*) g->Bpacked +
+                                gemm_packed_offset(g->N, kern->nr, pc, kcp, j0, kern->pack_size);
+                } else {
+                        GEMM_TIMED_PACK(pack_ns, kern->pack_B(g, j0, nc, pc, kc, Bpack));
+                }
+
+                if(g->Apacked != NULL) {
+                        Ap = (const char*) g->Apacked +
+                                gemm_packed_offset(g->M, kern->mr, pc, kcp, i0, kern->pack_size);
+                } else {
+                        GEMM_TIMED_PACK(pack_ns, kern->pack_A(g, i0, mc, pc, kc, Apack));
+                }
+
+                if(sums != NULL) {
+                        gemm_abft_block(sums, (const double*) Ap, (const double*) Bp, mc, nc, kcp, g->alpha);
+                }
+
+                for(jr = 0; jr < nc; jr += kern->nr) {
+                        const int nr = (nc - jr < kern->nr) ? nc - jr : kern->nr;
+                        for(ir = 0; ir < mc; ir += kern->mr) {
+                                const int mr = (mc - ir < kern->mr) ? mc - ir : kern->mr;
+                                kern->micro(kcp, Ap + (size_t) ir * kcp * kern->pack_size,
+                                        Bp + (size_t) jr * kcp * kern->pack_size, g->alpha,
+                                        gemm_c_at(kern->c_size, C, ldc, i0 + ir, j0 + jr), ldc, mr, nr);
+                        }
+                }
+        }
+}
+
+// gemm_tile, verified with ABFT checksums when g->abft is set
+static void gemm_tile_checked(const gemm_args_t* g, int i0, int mc, int j0, int nc, int k0, int k1,
+        void* C, int ldc, char* Apack, char* Bpack, gemm_pack_stats_t* timing) {
+
+        gemm_abft_sums_t sums;
+        gemm_abft_t* abft = g->abft;
+        double* tile = (double*) gemm_c_at(sizeof(double), C, ldc, i0, j0);
+
+        if(abft == NULL) {
+                gemm_tile(g, i0, mc, j0, nc, k0, k1, C, ldc, Apack, Bpack, NULL, timing);
+                return;
+        }
+
+        gemm_abft_begin(&sums, tile, ldc, mc, nc);
+        gemm_tile(g, i0, mc, j0, nc, k0, k1, C, ldc, Apack, Bpack, &sums, timing);
+
+        // fault injection for testing, once per call (K part 0 only)
+        if(k0 == 0 && abft->inject_row >= i0 && abft->inject_row < i0 + mc &&
+                abft->inject_col >= j0 && abft->inject_col < j0 + nc) {
+                double* c = tile + (size_t) (abft->inject_row - i0) * ldc + (abft->inject_col - j0);
+                *c += 1.0 + fabs(*c);
+        }
+
+        gemm_abft_check(&sums, abft, tile, ldc, i0, mc, j0, nc, k1 - k0);
+}
+
+// Adds one thread's packing times and tile loop time to the totals
+static void gemm_pack_stats_add(gemm_pack_stats_t* stats, const gemm_pack_stats_t* timing,
+        uint64_t thread_start) {
+
+        const uint64_t thread_ns = nanoclock_now() - thread_start;
+
+        #pragma omp atomic
+        stats->pack_ns += timing->pack_ns;
+        #pragma omp atomic
+        stats->overlapped_ns += timing->overlapped_ns;
+        #pragma omp atomic
+        stats->thread_ns += thread_ns;
+}
+
+void gemm_blocked(const gemm_args_t* g, double beta, void* C, int ldc) {
+        const gemm_kernel_t* kern = g->kernel;
+        const size_t cs = kern->c_size;
+        const int M = g->M, N = g->N, K = g->K;
+        gemm_plan_t plan;
+
+        if(M <= 0 || N <= 0) return;
+        if(K <= 0 || g->alpha == 0.0) {
+                #pragma omp parallel for
+                for(int i = 0; i < M; i++) gemm_scale(cs, beta, gemm_c_at(cs, C, ldc, i, 0), ldc, 1, N);
+                return;
+        }
+
+        // called from inside a parallel region that cannot nest (e.g. a
+        // Strassen task), the team below is a single thread
+        const int threads = (omp_get_active_level() >= omp_get_max_active_levels()) ?
+                1 : omp_get_max_threads();
+        gemm_make_plan(M, N, K, threads, &plan);
+
+        const int tiles = plan.mt * plan.nt;
+        const size_t kc_max = (size_t) gemm_kc_packed(kern, GEMM_KC);
+        const size_t buffers = g->pipeline ? 2 : 1;
+        const size_t a_bytes = (g->Apacked != NULL) ? 0 : buffers * plan.mc * kc_max * kern->pack_size;
+        const size_t b_bytes = (g->Bpacked != NULL) ? 0 : buffers * plan.nc * kc_max * kern->pack_size;
+
+        if(plan.ksplit == 1) {
+                #pragma omp parallel
+                {
+                        char* Apack = (char*) gemm_alloc(a_bytes);
+                        char* Bpack = (char*) gemm_alloc(b_bytes);
+                        gemm_pack_stats_t timing = { 0, 0, 0 };
+                        const uint64_t thread_start = (g->pack_stats != NULL) ? nanoclock_now() : 0;
+                        int t;
+
+                        // consecutive tiles share a B panel column
+                        #pragma omp for schedule(dynamic)
+                        for(t = 0; t < tiles; t++) {
+                                const int i0 = (t % plan.mt) * plan.mc;
+                                const int j0 = (t / plan.mt) * plan.nc;
+                                const int mc = (M - i0 < plan.mc) ? M - i0 : plan.mc;
+                                const int nc = (N - j0 < plan.nc) ? N - j0 : plan.nc;
+
+                                gemm_scale(cs, beta, gemm_c_at(cs, C, ldc, i0, j0), ldc, mc, nc);
+                                gemm_tile_checked(g, i0, mc, j0, nc, 0, K, C, ldc, Apack, Bpack,
+                                        (g->pack_stats != NULL) ? &timing : NULL);
+                        }
+
+                        if(g->pack_stats != NULL) gemm_pack_stats_add(g->pack_stats, &timing, thread_start);
+
+                        free(Apack);
+                        free(Bpack);
+                }
+                return;
+        }
+
+        // K split: every (tile, K part) pair accumulates into a private
+        // M x N buffer of its part, then the parts are reduced into C
+        const int parts = plan.ksplit;
+        const int kchunk = ceil_div(ceil_div(K, parts), GEMM_KC) * GEMM_KC;
+        char* partial = (char*) gemm_alloc((size_t) parts * M * N * cs);
+
+        #pragma omp parallel
+        {
+                char* Apack = (char*) gemm_alloc(a_bytes);
+                char* Bpack = (char*) gemm_alloc(b_bytes);
+                gemm_pack_stats_t timing = { 0, 0, 0 };
+                const uint64_t thread_start = (g->pack_stats != NULL) ? nanoclock_now() : 0;
+                int t, i, p;
+
+                #pragma omp for schedule(static)
+                for(i = 0; i < parts * M; i++) memset(partial + (size_t) i * N * cs, 0, cs * N);
+
+                #pragma omp for schedule(dynamic)
+                for(t = 0; t < tiles * parts; t++) {
+                        const int part = t / tiles;
+                        const int i0 = (t % tiles % plan.mt) * plan.mc;
+                        const int j0 = (t % tiles / plan.mt) * plan.nc;
+                        const int mc = (M - i0 < plan.mc) ? M - i0 : plan.mc;
+                        const int nc = (N - j0 < plan.nc) ? N - j0 : plan.nc;
+                        const int k0 = part * kchunk;
+                        const int k1 = (k0 + kchunk < K) ? k0 + kchunk : K;
+
+                        if(k0 < k1) {
+                                gemm_tile_checked(g, i0, mc, j0, nc, k0, k1,
+                                        partial + (size_t) part * M * N * cs, N, Apack, Bpack,
+                                        (g->pack_stats != NULL) ? &timing : NULL);
+                        }
+                }
+
+                if(g->pack_stats != NULL) gemm_pack_stats_add(g->pack_stats, &timing, thread_start);
+
+                #pragma omp for schedule(static)
+                for(i = 0; i < M; i++) {
+                        void* c = gemm_c_at(cs, C, ldc, i, 0);
+                        gemm_scale(cs, beta, c, ldc, 1, N);
+                        for(p = 0; p < parts; p++) {
+                                gemm_add_row(cs, c, partial + ((size_t) p * M + i) * N * cs, N);
+                        }
+                }
+
+                free(Apack);
+                free(Bpack);
+        }
+
+        free(partial);
+}
+
+void gemm_dgemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc) {
+
+        const gemm_args_t g = { &gemm_kernel_fp64, transA, transB, M, N, K, alpha, A, lda, B, ldb };
+        gemm_blocked(&g, beta, C, ldc);
+}
+
+void gemm_dgemm_pipelined(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc, int pipelined, gemm_pack_stats_t* stats) {
+
+        const gemm_args_t g = { &gemm_kernel_fp64, transA, transB, M, N, K, alpha, A, lda, B, ldb,
+                NULL, NULL, NULL, pipelined, stats };
+        gemm_blocked(&g, beta, C, ldc);
+}
+
+double gemm_dgemm_traffic(int M, int N, int K) {
+        const int threads = (omp_get_active_level() >= omp_get_max_active_levels()) ?
+                1 : omp_get_max_threads();
+        gemm_plan_t plan;
+
+        if(M <= 0 || N <= 0 || K <= 0) return 0;
+        gemm_make_plan(M, N, K, threads, &plan);
+
+        // every tile streams its rows of A and columns of B; C (or the
+        // K-split partial buffers plus C) is read and written once
+        double elements = (double) M * K * plan.nt + (double) K * N * plan.mt + 2.0 * M * N;
+        if(plan.ksplit > 1) elements += 2.0 * plan.ksplit * M * N;
+        return elements * sizeof(double);
+}
+
+void gemm_abft_init(gemm_abft_t* abft) {
+        memset(abft, 0, sizeof(*abft));
+        abft->inject_row = abft->inject_col = -1;
+        abft->row = abft->col = -1;
+}
+
+void gemm_dgemm_abft(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc, gemm_abft_t* abft) {
+
+        const gemm_args_t g = { &gemm_kernel_fp64, transA, transB, M, N, K, alpha, A, lda, B, ldb,
+                NULL, NULL, abft };
+        gemm_blocked(&g, beta, C, ldc);
+}
+
+gemm_packed_t* gemm_dgemm_pack(gemm_operand_t which, gemm_trans_t trans,
+        int M, int N, int K, const double* src, int ld) {
+
+        gemm_args_t g = { &gemm_kernel_fp64, trans, trans, M, N, K, 1.0, src, ld, src, ld };
+        return gemm_pack_operand(&g, which);
+}
+
+static void gemm_packed_check(const gemm_packed_t* p, gemm_operand_t which, int rows, int K) {
+        if(p != NULL && (p->kernel != &gemm_kernel_fp64 || p->which != which ||
+                p->rows != rows || p->K != K)) {
+                fprintf(stderr, "Error: packed %c does not match the %d x %d operand\n",
+                        which == GemmMatrixA ? 'A' : 'B', which == GemmMatrixA ? rows : K,
+                        which == GemmMatrixA ? K : rows);
+                exit(-1);
+        }
+}
+
+void gemm_dgemm_packed(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const gemm_packed_t* Ap, const double* A, int lda,
+        const gemm_packed_t* Bp, const double* B, int ldb,
+        double beta, double* C, int ldc) {
+
+        gemm_packed_check(Ap, GemmMatrixA, M, K);
+        gemm_packed_check(Bp, GemmMatrixB, N, K);
+
+        const gemm_args_t g = { &gemm_kernel_fp64, transA, transB, M, N, K, alpha, A, lda, B, ldb,
+                Ap != NULL ? Ap->data : NULL, Bp != NULL ? Bp->data : NULL };
+        gemm_blocked(&g, beta, C, ldc);
+}
+
+size_t gemm_packed_bytes(const gemm_packed_t* p) {
+        return (p != NULL) ? p->bytes : 0;
+}
+
+void gemm_packed_free(gemm_packed_t* p) {
+        if(p != NULL) {
+                free(p->data);
+                free(p);
+        }
+}
+
+void gemm_dgemm_naive(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc) {
+
+        const size_t a_row = (transA == GemmNoTrans) ? (size_t) lda : 1;
+        const size_t a_col = (transA == GemmNoTrans) ? 1 : (size_t) lda;
+        const size_t b_row = (transB == GemmNoTrans) ? (size_t) ldb : 1;
+        const size_t b_col = (transB == GemmNoTrans) ? 1 : (size_t) ldb;
+        int i, j, k;
+
+        #pragma omp parallel for private(j, k)
+        for(i = 0; i < M; i++) {
+                for(j = 0; j < N; j++) {
+                        double sum = 0;
+
+                        for(k = 0; k < K; k++) {
+                                sum += A[i * a_row + k * a_col] * B[k * b_row + j * b_col];
+                        }
+
+                        C[(size_t) i * ldc + j] = (alpha * sum) + (beta * C[(size_t) i * ldc + j]);
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// Small-matrix kernel for a fixed size SZ.
+//
+// i-k-j order with a row accumulator: the inner j loop is
+// unit stride over B and C with a trip count known at compile
+// time, so it is fully unrolled and vectorized.
+// ------------------------------------------------------- //
+#define GEMM_SMALL_KERNEL(SZ)                                                   \
+static void gemm_small_##SZ(double alpha, const double* GEMM_RESTRICT A,        \
+        const double* GEMM_RESTRICT B, double beta, double* GEMM_RESTRICT C) {  \
+        int i, j, k;                                                            \
+        for(i = 0; i < SZ; i++) {                                               \
+                double acc[SZ];                                                 \
+                for(j = 0; j < SZ; j++) acc[j] = 0.0;                           \
+                for(k = 0; k < SZ; k++) {                                       \
+                        const double a = A[i*SZ + k];                           \
+                        for(j = 0; j < SZ; j++) acc[j] += a * B[k*SZ + j];      \
+                }                                                               \
+                for(j = 0; j < SZ; j++)                                         \
+                        C[i*SZ + j] = (alpha * acc[j]) + (beta * C[i*SZ + j]);  \
+        }                                                                       \
+}
+
+GEMM_SMALL_KERNEL(4)
+GEMM_SMALL_KERNEL(8)
+GEMM_SMALL_KERNEL(16)
+GEMM_SMALL_KERNEL(24)
+GEMM_SMALL_KERNEL(32)
+GEMM_SMALL_KERNEL(48)
+GEMM_SMALL_KERNEL(64)
+
+typedef void (*gemm_small_fn)(double, const double*, const double*, double, double*);
+
+static gemm_small_fn gemm_small_lookup(int n) {
+        switch(n) {
+                case 4:  return gemm_small_4;
+                case 8:  return gemm_small_8;
+                case 16: return gemm_small_16;
+                case 24: return gemm_small_24;
+                case 32: return gemm_small_32;
+                case 48: return gemm_small_48;
+                case 64: return gemm_small_64;
+                default: return NULL;
+        }
+}
+
+int gemm_batch_specialized(int n) {
+        return gemm_small_lookup(n) != NULL;
+}
+
+// Generic small kernel: scale C by beta first, then accumulate
+// alpha * A(i,k) * B(k,:) row by row
+static void gemm_small_generic(int n, double alpha, const double* GEMM_RESTRICT A,
+        const double* GEMM_RESTRICT B, double beta, double* GEMM_RESTRICT C) {
+        int i, j, k;
+
+        for(i = 0; i < n; i++) {
+                double* GEMM_RESTRICT c = C + (size_t) i * n;
+
+                for(j = 0; j < n; j++) c[j] *= beta;
+
+                for(k = 0; k < n; k++) {
+                        const double a = alpha * A[(size_t) i * n + k];
+                        const double* GEMM_RESTRICT b = B + (size_t) k * n;
+                        for(j = 0; j < n; j++) c[j] += a * b[j];
+                }
+        }
+}
+
+void gemm_batch_small(int n, int count, double alpha,
+        const double* A, const double* B, double beta, double* C) {
+
+        const size_t stride = (size_t) n * n;
+        const gemm_small_fn kernel = gemm_small_lookup(n);
+        int b;
+
+        if(kernel != NULL) {
+                #pragma omp parallel for schedule(static)
+                for(b = 0; b < count; b++) {
+                        kernel(alpha, A + b * stride, B + b * stride, beta, C + b * stride);
+                }
+        } else {
+                #pragma omp parallel for schedule(static)
+                for(b = 0; b < count; b++) {
+                        gemm_small_generic(n, alpha, A + b * stride, B + b * stride, beta, C + b * stride);
+                }
+        }
+}
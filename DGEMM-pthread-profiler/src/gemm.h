@@ -0,0 +1,226 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ------------------------------------------------------- //
+// Native matrix multiply kernels used by the dgemm
+// benchmark when no vendor BLAS is compiled in.
+//
+// All routines compute C = alpha * A * B + beta * C on
+// row-major matrices.
+// ------------------------------------------------------- //
+
+typedef enum {
+        GemmNoTrans = 0,
+        GemmTrans   = 1
+} gemm_trans_t;
+
+typedef enum {
+        GemmFP64 = 0,
+        GemmFP32,
+        GemmBF16,               // BF16 inputs, FP32 accumulate and output
+        GemmFP16                // FP16 inputs, FP32 accumulate and output
+} gemm_precision_t;
+
+// ------------------------------------------------------- //
+// General multiply, mirroring cblas_dgemm(CblasRowMajor, ...)
+//
+// C (M x N, leading dimension ldc) = alpha * op(A) * op(B)
+// + beta * C where op(A) is M x K and op(B) is K x N. With
+// GemmNoTrans A is stored M x lda (lda >= K); with GemmTrans
+// A is stored K x lda (lda >= M). B likewise with N/K.
+//
+// Cache-blocked and packed with an MR x NR register
+// micro-kernel. C is split into 2D tiles that threads take
+// dynamically; tile sizes shrink until every thread has work,
+// and small-M/N shapes with a long K dimension (inner-product
+// like, e.g. A^T * B of two tall-skinny panels) split K across
+// threads instead and reduce the partial results.
+// ------------------------------------------------------- //
+void gemm_dgemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc);
+
+// Estimated memory traffic in bytes of one gemm_dgemm call,
+// from the blocking plan it would use with the current thread
+// count (for roofline placement when no IMC counters exist)
+double gemm_dgemm_traffic(int M, int N, int K);
+
+// ------------------------------------------------------- //
+// Pre-packed operands
+//
+// gemm_dgemm_pack converts op(A) (M x K, which = GemmMatrixA)
+// or op(B) (K x N, GemmMatrixB) once into the panel layout of
+// the blocked kernel. gemm_dgemm_packed then multiplies like
+// gemm_dgemm but takes A and/or B from the packed handles
+// (the raw pointer and leading dimension are ignored when the
+// handle is not NULL), so operands that do not change between
+// calls are not repacked every time. alpha is applied at
+// compute time, not folded into the packed values.
+// ------------------------------------------------------- //
+typedef enum {
+        GemmMatrixA = 0,
+        GemmMatrixB = 1
+} gemm_operand_t;
+
+typedef struct gemm_packed gemm_packed_t;
+
+gemm_packed_t* gemm_dgemm_pack(gemm_operand_t which, gemm_trans_t trans,
+        int M, int N, int K, const double* src, int ld);
+
+void gemm_dgemm_packed(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const gemm_packed_t* Ap, const double* A, int lda,
+        const gemm_packed_t* Bp, const double* B, int ldb,
+        double beta, double* C, int ldc);
+
+// Size of the packed buffer in bytes
+size_t gemm_packed_bytes(const gemm_packed_t* p);
+
+void gemm_packed_free(gemm_packed_t* p);
+
+// ------------------------------------------------------- //
+// Pipelined packing
+//
+// With pipelined set, gemm_dgemm_pipelined multiplies like
+// gemm_dgemm but each thread packs the A block and B panel
+// of K block p + 1 into a second pair of buffers while it
+// runs block p: after every NR column of micro-kernels it
+// packs its share of the next panel's slivers, so the
+// strided pack loads overlap the FMA work instead of
+// stalling ahead of it. Only the first panel of a tile is
+// packed up front. Threads pipeline their own tiles, so no
+// buffer changes hands and nothing is synchronized.
+// pipelined = 0 runs the gemm_dgemm schedule.
+//
+// stats (may be NULL) accumulates, summed over threads, the
+// time spent packing and in the tile loop.
+// ------------------------------------------------------- //
+typedef struct {
+        uint64_t pack_ns;       // packing ahead of the micro-kernels (all of it unpipelined)
+        uint64_t overlapped_ns; // packing between micro-kernel columns (pipelined)
+        uint64_t thread_ns;     // tile loop
+} gemm_pack_stats_t;
+
+void gemm_dgemm_pipelined(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc, int pipelined, gemm_pack_stats_t* stats);
+
+// ------------------------------------------------------- //
+// Reference triple loop with the same signature, one row of
+// C per OpenMP iteration (the original benchmark kernel)
+// ------------------------------------------------------- //
+void gemm_dgemm_naive(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc);
+
+// ------------------------------------------------------- //
+// Algorithm-based fault tolerance
+//
+// gemm_dgemm_abft multiplies like gemm_dgemm and verifies
+// every C tile against row and column checksums carried
+// through the packed panels: per K block, the column sums of
+// the packed A block times the B panel give the expected
+// column sums of the tile, the A block times the row sums of
+// the B panel the expected row sums. A mismatch beyond the
+// rounding bound flags the tile, and the mismatching row and
+// column locate the element. Results accumulate across calls
+// until gemm_abft_init.
+// ------------------------------------------------------- //
+typedef struct {
+        int inject_row, inject_col;     // in: corrupt this element of C before its check (-1 = off)
+        long tiles;                     // tiles verified
+        long bad_tiles;                 // tiles whose checksums did not match
+        int row, col;                   // first mismatching element of C (-1 if none)
+        int tile_row, tile_col;         // origin of its tile
+        int tile_m, tile_n;             // size of its tile
+        double error;                   // largest checksum difference over the bound
+} gemm_abft_t;
+
+void gemm_abft_init(gemm_abft_t* abft);
+
+void gemm_dgemm_abft(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc, gemm_abft_t* abft);
+
+// ------------------------------------------------------- //
+// Strassen-Winograd multiply (gemm_strassen.c), A and B not
+// transposed. Recurses on 2 x 2 quadrants while all of M, N
+// and K exceed the crossover (<= 0 selects the default), then
+// runs gemm_dgemm. Temporaries come from one arena allocated
+// per call; the top levels run their products as OpenMP
+// tasks. Results differ from the classical product by
+// rounding (the error grows with the number of levels).
+// ------------------------------------------------------- //
+void gemm_dgemm_strassen(int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc, int crossover);
+
+// Number of Strassen levels used for the given shape
+int gemm_strassen_levels(int M, int N, int K, int crossover);
+
+// Times the classical kernel against one Strassen level for
+// doubling sizes up to max_n and returns the smallest
+// crossover that pays off, or 0 if none does
+int gemm_strassen_tune(int max_n);
+
+// ------------------------------------------------------- //
+// Reduced precision variants (gemm_lowp.c)
+//
+// Same blocking and threading as gemm_dgemm. SGEMM is FP32
+// throughout; the BF16/FP16 variants take 16-bit inputs and
+// accumulate into an FP32 C. BF16 uses AVX512_BF16 dot
+// products and FP16 uses AVX512_FP16 (else F16C) conversions
+// when CPUID reports them, otherwise portable emulation
+// (convert to FP32 while packing).
+// ------------------------------------------------------- //
+void gemm_sgemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, float alpha,
+        const float* A, int lda, const float* B, int ldb,
+        float beta, float* C, int ldc);
+
+void gemm_bf16_gemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, float alpha,
+        const uint16_t* A, int lda, const uint16_t* B, int ldb,
+        float beta, float* C, int ldc);
+
+void gemm_fp16_gemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, float alpha,
+        const uint16_t* A, int lda, const uint16_t* B, int ldb,
+        float beta, float* C, int ldc);
+
+// Name of the kernel the given precision dispatches to on this CPU
+const char* gemm_lowp_kernel_name(gemm_precision_t precision);
+
+// Force the portable emulated BF16/FP16 kernels (for comparison)
+void gemm_lowp_emulate(int on);
+
+// Round-to-nearest-even conversions between FP32 and BF16/FP16
+uint16_t gemm_float_to_bf16(float f);
+float gemm_bf16_to_float(uint16_t h);
+uint16_t gemm_float_to_fp16(float f);
+float gemm_fp16_to_float(uint16_t h);
+
+// ------------------------------------------------------- //
+// Batched small-matrix multiply
+//
+// count independent n x n multiplies stored back to back
+// (matrix b starts at offset b * n * n in A, B and C). The
+// batch is split across OpenMP threads; each multiply runs
+// on a single thread. Sizes 4, 8, 16, 24, 32, 48 and 64 use
+// kernels specialized at compile time, other sizes use a
+// generic kernel.
+// ------------------------------------------------------- //
+void gemm_batch_small(int n, int count, double alpha,
+        const double* A, const double* B, double beta, double* C);
+
+// Returns 1 if n has a compile-time specialized batch kernel
+int gemm_batch_specialized(int n);
+
+#endif // GEMM_H
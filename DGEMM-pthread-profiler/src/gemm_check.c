@@ -0,0 +1,451 @@
+// ------------------------------------------------------- //
+// gemm_check: correctness checks of the native kernels
+// (make check)
+//
+// Every kernel is compared element by element against
+// gemm_dgemm_naive on pseudo-random inputs in [-1, 1]. With
+// |a|, |b|, |c| <= 1 an element of alpha * op(A) * op(B) +
+// beta * C may differ from the reference by at most
+//
+//     CHECK_ULPS * eps * (|alpha| * K + |beta|)
+//
+// (K products and sums, each rounding once, in an order the
+// blocked kernels are free to choose). Strassen-Winograd
+// trades stability for speed: every level adds and subtracts
+// quadrants around the half-size products, and its error
+// bound grows by a constant factor per level, taken as
+// STRASSEN_GROWTH (Higham, Accuracy and Stability of
+// Numerical Algorithms, gives 18 for Winograd's variant).
+// Reports every failing case and exits non-zero if there
+// was one.
+// ------------------------------------------------------- //
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include "gemm.h"
+
+#define CHECK_ULPS      4.0
+#define STRASSEN_GROWTH 18.0
+
+static int failures = 0;
+static int cases = 0;
+
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ULL;
+
+static double next_value(void) {
+        rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (double) (rng_state >> 11) / (double) (1ULL << 53) * 2.0 - 1.0;
+}
+
+static double* random_matrix(int rows, int ld) {
+        double* m = (double*) malloc(sizeof(double) * (size_t) rows * ld);
+        size_t e;
+        for(e = 0; e < (size_t) rows * ld; e++) m[e] = next_value();
+        return m;
+}
+
+// ------------------------------------------------------- //
+// One multiply shape with its own operands and a reference
+// result; C starts from the same values for every kernel
+// ------------------------------------------------------- //
+typedef struct {
+        gemm_trans_t transA, transB;
+        int M, N, K;
+        int lda, ldb, ldc;
+        double alpha, beta;
+        double *A, *B, *C0, *ref;
+} check_case_t;
+
+static void case_init(check_case_t* c, gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, int pad, double alpha, double beta) {
+        const int rowsA = (transA == GemmNoTrans) ? M : K;
+        const int colsA = (transA == GemmNoTrans) ? K : M;
+        const int rowsB = (transB == GemmNoTrans) ? K : N;
+        const int colsB = (transB == GemmNoTrans) ? N : K;
+
+        c->transA = transA;
+        c->transB = transB;
+        c->M = M;
+        c->N = N;
+        c->K = K;
+        c->lda = colsA + pad;
+        c->ldb = colsB + pad;
+        c->ldc = N + pad;
+        c->alpha = alpha;
+        c->beta = beta;
+        c->A = random_matrix(rowsA, c->lda);
+        c->B = random_matrix(rowsB, c->ldb);
+        c->C0 = random_matrix(M, c->ldc);
+        c->ref = (double*) malloc(sizeof(double) * (size_t) M * c->ldc);
+        memcpy(c->ref, c->C0, sizeof(double) * (size_t) M * c->ldc);
+        gemm_dgemm_naive(transA, transB, M, N, K, alpha, c->A, c->lda, c->B, c->ldb,
+                beta, c->ref, c->ldc);
+}
+
+static void case_free(check_case_t* c) {
+        free(c->A);
+        free(c->B);
+        free(c->C0);
+        free(c->ref);
+}
+
+// Fresh copy of the initial C
+static double* case_c(const check_case_t* c) {
+        double* C = (double*) malloc(sizeof(double) * (size_t) c->M * c->ldc);
+        memcpy(C, c->C0, sizeof(double) * (size_t) c->M * c->ldc);
+        return C;
+}
+
+static double case_bound(const check_case_t* c, double ulps) {
+        return ulps * DBL_EPSILON * (fabs(c->alpha) * c->K + fabs(c->beta));
+}
+
+// Compares C with the reference within bound; padding columns
+// of C (j >= N) must not have been written
+static void case_compare(const check_case_t* c, const char* kernel, const double* C, double bound) {
+        double worst = 0.0;
+        int wi = -1, wj = -1, padding = 0, i, j;
+
+        for(i = 0; i < c->M; i++) {
+                for(j = 0; j < c->ldc; j++) {
+                        const size_t e = (size_t) i * c->ldc + j;
+                        if(j >= c->N) {
+                                if(C[e] != c->C0[e]) padding++;
+                                continue;
+                        }
+                        const double diff = fabs(C[e] - c->ref[e]);
+                        if(!(diff <= worst)) {
+                                worst = diff;
+                                wi = i;
+                                wj = j;
+                        }
+                }
+        }
+
+        cases++;
+        if(worst > bound || padding > 0 || worst != worst) {
+                failures++;
+                printf("FAIL %-12s %c%c M=%d N=%d K=%d ld=%d/%d/%d alpha=%g beta=%g: "
+                        "max error %g at (%d,%d), bound %g, %d padding elements written\n",
+                        kernel, c->transA == GemmTrans ? 'T' : 'N', c->transB == GemmTrans ? 'T' : 'N',
+                        c->M, c->N, c->K, c->lda, c->ldb, c->ldc, c->alpha, c->beta,
+                        worst, wi, wj, bound, padding);
+        }
+}
+
+// ------------------------------------------------------- //
+// Blocked kernel: edge tiles, transposes, leading dimensions
+// ------------------------------------------------------- //
+static const int shapes[][3] = {
+        { 1, 1, 1 },            // single element
+        { 7, 13, 5 },           // below one register block
+        { 33, 65, 257 },        // ragged MR/NR edges, K one past a panel
+        { 129, 67, 300 },       // two MC tiles, partial last panel
+        { 300, 530, 70 },       // several MC x NC tiles
+        { 5, 3, 600 },          // small M/N with long K (K split across threads)
+};
+
+static const double scales[][2] = {
+        { 1.0, 0.0 },
+        { 1.0, 1.0 },
+        { -1.5, 0.75 },
+};
+
+static void check_blocked(void) {
+        size_t s, a;
+        int ta, tb, pad;
+
+        for(s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+                for(ta = 0; ta < 2; ta++) {
+                        for(tb = 0; tb < 2; tb++) {
+                                for(pad = 0; pad <= 3; pad += 3) {
+                                        for(a = 0; a < sizeof(scales) / sizeof(scales[0]); a++) {
+                                                check_case_t c;
+                                                case_init(&c, (gemm_trans_t) ta, (gemm_trans_t) tb,
+                                                        shapes[s][0], shapes[s][1], shapes[s][2], pad,
+                                                        scales[a][0], scales[a][1]);
+                                                double* C = case_c(&c);
+                                                gemm_dgemm(c.transA, c.transB, c.M, c.N, c.K, c.alpha,
+                                                        c.A, c.lda, c.B, c.ldb, c.beta, C, c.ldc);
+                                                case_compare(&c, "blocked", C, case_bound(&c, CHECK_ULPS));
+                                                free(C);
+                                                case_free(&c);
+                                        }
+                                }
+                        }
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// Pre-packed operands: A, B or both from gemm_dgemm_pack
+// ------------------------------------------------------- //
+static void check_prepacked(void) {
+        static const int packed_shapes[][3] = { { 7, 13, 5 }, { 129, 67, 300 }, { 300, 530, 70 } };
+        size_t s;
+        int ta, tb, which;
+
+        for(s = 0; s < sizeof(packed_shapes) / sizeof(packed_shapes[0]); s++) {
+                for(ta = 0; ta < 2; ta++) {
+                        for(tb = 0; tb < 2; tb++) {
+                                check_case_t c;
+                                case_init(&c, (gemm_trans_t) ta, (gemm_trans_t) tb, packed_shapes[s][0],
+                                        packed_shapes[s][1], packed_shapes[s][2], 3, -1.5, 0.75);
+                                gemm_packed_t* Ap = gemm_dgemm_pack(GemmMatrixA, c.transA, c.M, c.N, c.K, c.A, c.lda);
+                                gemm_packed_t* Bp = gemm_dgemm_pack(GemmMatrixB, c.transB, c.M, c.N, c.K, c.B, c.ldb);
+
+                                // 1 = A packed, 2 = B packed, 3 = both
+                                for(which = 1; which <= 3; which++) {
+                                        double* C = case_c(&c);
+                                        gemm_dgemm_packed(c.transA, c.transB, c.M, c.N, c.K, c.alpha,
+                                                (which & 1) ? Ap : NULL, c.A, c.lda,
+                                                (which & 2) ? Bp : NULL, c.B, c.ldb, c.beta, C, c.ldc);
+                                        case_compare(&c, which == 1 ? "packed-A" : which == 2 ? "packed-B" : "packed-AB",
+                                                C, case_bound(&c, CHECK_ULPS));
+                                        free(C);
+                                }
+                                gemm_packed_free(Ap);
+                                gemm_packed_free(Bp);
+                                case_free(&c);
+                        }
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// Strassen-Winograd: level count, odd-size peeling, alpha /
+// beta through the product buffer
+// ------------------------------------------------------- //
+static void check_level_count(int M, int N, int K, int crossover, int expected) {
+        const int levels = gemm_strassen_levels(M, N, K, crossover);
+        cases++;
+        if(levels != expected) {
+                failures++;
+                printf("FAIL strassen levels M=%d N=%d K=%d crossover=%d: %d, expected %d\n",
+                        M, N, K, crossover, levels, expected);
+        }
+}
+
+static void check_strassen(void) {
+        // M, N, K, crossover: small crossovers force several levels on small operands
+        static const int strassen_shapes[][4] = {
+                { 64, 64, 64, 8 },      // power of two, 3 levels
+                { 100, 75, 130, 16 },   // odd N peeled at the second level
+                { 257, 129, 65, 20 },   // odd M, N, K at the top
+                { 99, 101, 103, 12 },   // odd at every level
+        };
+        size_t s, a;
+
+        check_level_count(16, 16, 16, 16, 0);
+        check_level_count(100, 100, 100, 16, 3);
+        check_level_count(100, 75, 130, 16, 3);
+        check_level_count(4096, 4096, 64, 16, 2);       // the smallest dimension decides
+        check_level_count(2048, 2048, 2048, 0, 1);      // default crossover 1024
+
+        for(s = 0; s < sizeof(strassen_shapes) / sizeof(strassen_shapes[0]); s++) {
+                const int* sh = strassen_shapes[s];
+                const int levels = gemm_strassen_levels(sh[0], sh[1], sh[2], sh[3]);
+                for(a = 0; a < sizeof(scales) / sizeof(scales[0]); a++) {
+                        check_case_t c;
+                        case_init(&c, GemmNoTrans, GemmNoTrans, sh[0], sh[1], sh[2], 3, scales[a][0], scales[a][1]);
+                        double* C = case_c(&c);
+                        gemm_dgemm_strassen(c.M, c.N, c.K, c.alpha, c.A, c.lda, c.B, c.ldb, c.beta, C, c.ldc, sh[3]);
+                        case_compare(&c, "strassen", C, case_bound(&c, CHECK_ULPS) * pow(STRASSEN_GROWTH, levels));
+                        free(C);
+                        case_free(&c);
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// ABFT: no detection on clean multiplies with the default
+// rounding bound, and a single corrupted element of C is
+// flagged once and located by row and column
+// ------------------------------------------------------- //
+static void check_abft_result(const char* what, const check_case_t* c, const gemm_abft_t* abft,
+        long bad_tiles, int row, int col) {
+        int ok = abft->tiles > 0 && abft->bad_tiles == bad_tiles && abft->row == row && abft->col == col;
+        if(row >= 0) {
+                ok = ok && row >= abft->tile_row && row < abft->tile_row + abft->tile_m &&
+                        col >= abft->tile_col && col < abft->tile_col + abft->tile_n;
+        }
+        cases++;
+        if(!ok) {
+                failures++;
+                printf("FAIL abft %-7s %c%c M=%d N=%d K=%d: %ld of %ld tiles flagged at (%d,%d) "
+                        "in tile (%d,%d) %dx%d, expected %ld at (%d,%d)\n",
+                        what, c->transA == GemmTrans ? 'T' : 'N', c->transB == GemmTrans ? 'T' : 'N',
+                        c->M, c->N, c->K, abft->bad_tiles, abft->tiles, abft->row, abft->col,
+                        abft->tile_row, abft->tile_col, abft->tile_m, abft->tile_n, bad_tiles, row, col);
+        }
+}
+
+static void check_abft(void) {
+        size_t s, a;
+        int ta, tb, f;
+
+        for(s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+                for(ta = 0; ta < 2; ta++) {
+                        for(tb = 0; tb < 2; tb++) {
+                                for(a = 0; a < sizeof(scales) / sizeof(scales[0]); a++) {
+                                        check_case_t c;
+                                        gemm_abft_t abft;
+                                        case_init(&c, (gemm_trans_t) ta, (gemm_trans_t) tb, shapes[s][0],
+                                                shapes[s][1], shapes[s][2], 3, scales[a][0], scales[a][1]);
+                                        double* C = case_c(&c);
+                                        gemm_abft_init(&abft);
+                                        gemm_dgemm_abft(c.transA, c.transB, c.M, c.N, c.K, c.alpha,
+                                                c.A, c.lda, c.B, c.ldb, c.beta, C, c.ldc, &abft);
+                                        case_compare(&c, "abft", C, case_bound(&c, CHECK_ULPS));
+                                        check_abft_result("clean", &c, &abft, 0, -1, -1);
+                                        free(C);
+                                        case_free(&c);
+                                }
+                        }
+                }
+        }
+
+        // first element, last element (edge tile), an interior element of a later tile
+        static const int faults[][2] = { { 0, 0 }, { 299, 529 }, { 200, 300 } };
+        for(f = 0; f < 3; f++) {
+                check_case_t c;
+                gemm_abft_t abft;
+                case_init(&c, GemmNoTrans, GemmTrans, 300, 530, 70, 3, -1.5, 0.75);
+                double* C = case_c(&c);
+                gemm_abft_init(&abft);
+                abft.inject_row = faults[f][0];
+                abft.inject_col = faults[f][1];
+                gemm_dgemm_abft(c.transA, c.transB, c.M, c.N, c.K, c.alpha,
+                        c.A, c.lda, c.B, c.ldb, c.beta, C, c.ldc, &abft);
+                check_abft_result("fault", &c, &abft, 1, faults[f][0], faults[f][1]);
+                free(C);
+                case_free(&c);
+        }
+}
+
+// ------------------------------------------------------- //
+// Pipelined packing: the next K panel is packed between
+// micro-kernel columns, but every panel holds the same values
+// and the micro-kernels run in the same order, so the result
+// must equal the unpipelined schedule bit for bit. K values
+// that are not a multiple of the panel depth (256) end in a
+// partial stage.
+// ------------------------------------------------------- //
+static void check_pipeline(void) {
+        static const int pipeline_shapes[][3] = {
+                { 7, 13, 5 },           // one partial panel, nothing to prefetch
+                { 33, 65, 257 },        // full panel, then a 1-deep stage
+                { 129, 67, 300 },       // two MC tiles, partial second stage
+                { 200, 530, 700 },      // three stages, the last partial
+                { 64, 64, 512 },        // stages end exactly on the panel depth
+        };
+        gemm_pack_stats_t stats;
+        size_t s, e;
+        int ta, tb;
+
+        for(s = 0; s < sizeof(pipeline_shapes) / sizeof(pipeline_shapes[0]); s++) {
+                for(ta = 0; ta < 2; ta++) {
+                        for(tb = 0; tb < 2; tb++) {
+                                check_case_t c;
+                                size_t mismatches = 0;
+                                case_init(&c, (gemm_trans_t) ta, (gemm_trans_t) tb, pipeline_shapes[s][0],
+                                        pipeline_shapes[s][1], pipeline_shapes[s][2], 3, -1.5, 0.75);
+                                double* serial = case_c(&c);
+                                double* pipelined = case_c(&c);
+                                memset(&stats, 0, sizeof(stats));
+                                gemm_dgemm_pipelined(c.transA, c.transB, c.M, c.N, c.K, c.alpha, c.A, c.lda,
+                                        c.B, c.ldb, c.beta, serial, c.ldc, 0, NULL);
+                                gemm_dgemm_pipelined(c.transA, c.transB, c.M, c.N, c.K, c.alpha, c.A, c.lda,
+                                        c.B, c.ldb, c.beta, pipelined, c.ldc, 1, &stats);
+                                case_compare(&c, "pipelined", pipelined, case_bound(&c, CHECK_ULPS));
+                                for(e = 0; e < (size_t) c.M * c.ldc; e++) {
+                                        if(memcmp(&serial[e], &pipelined[e], sizeof(double)) != 0) mismatches++;
+                                }
+                                cases++;
+                                if(mismatches > 0 || stats.thread_ns == 0) {
+                                        failures++;
+                                        printf("FAIL pipelined %c%c M=%d N=%d K=%d: %zu elements differ from "
+                                                "the unpipelined kernel, %s\n", ta ? 'T' : 'N', tb ? 'T' : 'N',
+                                                c.M, c.N, c.K, mismatches, stats.thread_ns ? "timed" : "no stats");
+                                }
+                                free(serial);
+                                free(pipelined);
+                                case_free(&c);
+                        }
+                }
+        }
+}
+
+// ------------------------------------------------------- //
+// FP16 inputs, FP32 accumulate: the kernel CPUID picks and
+// the emulated one. Operands are rounded to FP16 (C to FP32)
+// first and the reference recomputed from the rounded values,
+// so only the FP32 sums are measured, against the same bound
+// in FP32 ulps.
+// ------------------------------------------------------- //
+static void check_fp16(void) {
+        size_t s, e;
+        int ta, tb, emulated;
+
+        for(s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+                for(ta = 0; ta < 2; ta++) {
+                        for(tb = 0; tb < 2; tb++) {
+                                check_case_t c;
+                                case_init(&c, (gemm_trans_t) ta, (gemm_trans_t) tb,
+                                        shapes[s][0], shapes[s][1], shapes[s][2], 3, -1.5, 0.75);
+                                const size_t sizeA = (size_t) (ta ? c.K : c.M) * c.lda;
+                                const size_t sizeB = (size_t) (tb ? c.N : c.K) * c.ldb;
+                                const size_t sizeC = (size_t) c.M * c.ldc;
+                                uint16_t* A16 = (uint16_t*) malloc(sizeof(uint16_t) * sizeA);
+                                uint16_t* B16 = (uint16_t*) malloc(sizeof(uint16_t) * sizeB);
+                                float* C32 = (float*) malloc(sizeof(float) * sizeC);
+                                double* C = (double*) malloc(sizeof(double) * sizeC);
+
+                                for(e = 0; e < sizeA; e++) {
+                                        A16[e] = gemm_float_to_fp16((float) c.A[e]);
+                                        c.A[e] = gemm_fp16_to_float(A16[e]);
+                                }
+                                for(e = 0; e < sizeB; e++) {
+                                        B16[e] = gemm_float_to_fp16((float) c.B[e]);
+                                        c.B[e] = gemm_fp16_to_float(B16[e]);
+                                }
+                                for(e = 0; e < sizeC; e++) c.C0[e] = c.ref[e] = (float) c.C0[e];
+                                gemm_dgemm_naive(c.transA, c.transB, c.M, c.N, c.K, c.alpha, c.A, c.lda,
+                                        c.B, c.ldb, c.beta, c.ref, c.ldc);
+
+                                for(emulated = 0; emulated < 2; emulated++) {
+                                        gemm_lowp_emulate(emulated);
+                                        for(e = 0; e < sizeC; e++) C32[e] = (float) c.C0[e];
+                                        gemm_fp16_gemm(c.transA, c.transB, c.M, c.N, c.K, (float) c.alpha,
+                                                A16, c.lda, B16, c.ldb, (float) c.beta, C32, c.ldc);
+                                        for(e = 0; e < sizeC; e++) C[e] = C32[e];
+                                        case_compare(&c, gemm_lowp_kernel_name(GemmFP16), C,
+                                                case_bound(&c, CHECK_ULPS) / DBL_EPSILON * FLT_EPSILON);
+                                }
+                                gemm_lowp_emulate(0);
+
+                                free(A16);
+                                free(B16);
+                                free(C32);
+                                free(C);
+                                case_free(&c);
+                        }
+                }
+        }
+}
+
+int main(void) {
+        check_blocked();
+        check_prepacked();
+        check_strassen();
+        check_abft();
+        check_pipeline();
+        check_fp16();
+
+        printf("gemm_check: %d cases, %d failed\n", cases, failures);
+        return failures > 0;
+}
@@ -0,0 +1,86 @@
+#ifndef GEMM_INTERNAL_H
+#define GEMM_INTERNAL_H
+
+// ------------------------------------------------------- //
+// Blocking infrastructure shared by the native kernels of
+// every precision (gemm.c, gemm_lowp.c).
+//
+// A precision plugs into the blocked driver by providing a
+// gemm_kernel_t: packing routines that convert its input
+// element type into the kernel-native panel layout and an
+// MR x NR micro-kernel that accumulates into C.
+// ------------------------------------------------------- //
+
+#include <stddef.h>
+#include "gemm.h"
+
+#define GEMM_RESTRICT __restrict__
+
+typedef struct gemm_kernel gemm_kernel_t;
+
+typedef struct {
+        const gemm_kernel_t* kernel;
+        gemm_trans_t transA, transB;
+        int M, N, K;
+        double alpha;
+        const void* A;
+        int lda;
+        const void* B;
+        int ldb;
+        const void* Apacked;    // whole-operand panels from gemm_pack_operand,
+        const void* Bpacked;    // NULL = pack A / B on the fly
+        gemm_abft_t* abft;      // verify every tile with checksums (FP64 only), NULL = off
+        int pipeline;           // pack the next K panel between micro-kernel columns
+        gemm_pack_stats_t* pack_stats;  // time the packing, NULL = off
+} gemm_args_t;
+
+struct gemm_kernel {
+        const char* name;
+        int mr, nr;             // register block, MC/NC tile sizes are multiples of these
+        int kunit;              // packed K depth is rounded up to a multiple of this
+        size_t pack_size;       // bytes per packed element
+        size_t c_size;          // bytes per C element: sizeof(double) or sizeof(float)
+
+        // Pack rows [i0, i0+mc) / columns [j0, j0+nc) of op(A) / op(B)
+        // over k in [k0, k0+kc) into mr-row / nr-column slivers, each
+        // kcp = round_up(kc, kunit) deep, zero padding the edges
+        void (*pack_A)(const gemm_args_t* g, int i0, int mc, int k0, int kc, void* buf);
+        void (*pack_B)(const gemm_args_t* g, int j0, int nc, int k0, int kc, void* buf);
+
+        // C[mr x nr] += alpha * a-sliver * b-sliver over kcp packed values
+        void (*micro)(int kcp, const void* a, const void* b, double alpha,
+                void* C, int ldc, int mr, int nr);
+};
+
+// Packed K depth of a panel of kc values for kernel k
+static inline int gemm_kc_packed(const gemm_kernel_t* k, int kc) {
+        return (kc + k->kunit - 1) / k->kunit * k->kunit;
+}
+
+// ------------------------------------------------------- //
+// Whole-operand packing
+//
+// op(A) is stored as consecutive KC-deep blocks, each holding
+// every MR-row sliver of that K range (op(B) likewise with
+// NR-column slivers), so any tile of any blocking plan finds
+// its panel at a fixed offset and the driver skips packing.
+// ------------------------------------------------------- //
+struct gemm_packed {
+        const gemm_kernel_t* kernel;
+        gemm_operand_t which;
+        int rows;               // M for A, N for B
+        int K;
+        size_t bytes;
+        void* data;
+};
+
+gemm_packed_t* gemm_pack_operand(const gemm_args_t* g, gemm_operand_t which);
+
+// C (M x N, ldc, element type given by the kernel) =
+//   alpha * op(A) * op(B) + beta * C
+void gemm_blocked(const gemm_args_t* g, double beta, void* C, int ldc);
+
+// 64-byte aligned scratch allocation, release with free()
+void* gemm_alloc(size_t bytes);
+
+#endif // GEMM_INTERNAL_H
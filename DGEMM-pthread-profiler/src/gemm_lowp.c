@@ -0,0 +1,471 @@
+// ------------------------------------------------------- //
+// Reduced precision native kernels (see gemm.h)
+//
+// SGEMM, BF16 x BF16 -> FP32 and FP16 x FP16 -> FP32 on top
+// of the shared blocked driver (gemm_internal.h). Inputs are
+// converted to FP32 while packing and multiplied by an FP32
+// micro-kernel, except where the CPU can do better:
+//   - AVX512_BF16: BF16 pairs stay packed and are multiplied
+//     with VDPBF16PS (FP32 accumulate)
+//   - AVX512_FP16: FP16 panels are widened 16 at a time with
+//     VCVTPH2PSX and multiplied by a 512-bit FP32 FMA micro-
+//     kernel. Its FP16 arithmetic (VFMADDPH) would accumulate
+//     in FP16 and is not used: the API promises FP32 sums.
+//   - F16C: FP16 panels are widened with VCVTPH2PS instead of
+//     the portable bit-manipulation conversion
+// ------------------------------------------------------- //
+
+#include <stdint.h>
+#include <string.h>
+#include "gemm_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_LOWP_X86 1
+#endif
+
+#define GEMM_LOWP_MR    4
+#define GEMM_LOWP_NR    16
+
+static int gemm_lowp_emulated = 0;
+
+void gemm_lowp_emulate(int on) {
+        gemm_lowp_emulated = on;
+}
+
+// ------------------------------------------------------- //
+// Portable conversions
+// ------------------------------------------------------- //
+static inline uint32_t float_bits(float f) {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        return u;
+}
+
+static inline float bits_float(uint32_t u) {
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+}
+
+uint16_t gemm_float_to_bf16(float f) {
+        uint32_t u = float_bits(f);
+        if((u & 0x7fffffffu) > 0x7f800000u) return (uint16_t) ((u >> 16) | 0x40); // quiet NaN
+        u += 0x7fffu + ((u >> 16) & 1u);                                        // round to nearest even
+        return (uint16_t) (u >> 16);
+}
+
+float gemm_bf16_to_float(uint16_t h) {
+        return bits_float((uint32_t) h << 16);
+}
+
+uint16_t gemm_float_to_fp16(float f) {
+        const uint32_t u = float_bits(f);
+        const uint32_t sign = (u >> 16) & 0x8000u;
+        const uint32_t absu = u & 0x7fffffffu;
+
+        if(absu >= 0x7f800000u) {                       // Inf / NaN
+                return (uint16_t) (sign | 0x7c00u | (absu > 0x7f800000u ? 0x200u : 0));
+        }
+        if(absu >= 0x477ff000u) return (uint16_t) (sign | 0x7c00u); // overflows to Inf
+
+        if(absu < 0x38800000u) {                        // subnormal or zero in FP16
+                if(absu < 0x33000000u) return (uint16_t) sign;
+                const uint32_t mant = (absu & 0x007fffffu) | 0x00800000u;
+                const int shift = 126 - (int) (absu >> 23);   // 14..24
+                uint32_t h = mant >> shift;
+                const uint32_t rem = mant & ((1u << shift) - 1);
+                const uint32_t half = 1u << (shift - 1);
+                if(rem > half || (rem == half && (h & 1u))) h++;
+                return (uint16_t) (sign | h);
+        }
+
+        uint32_t h = ((absu >> 13) - (112u << 10));      // rebias exponent 127 -> 15
+        const uint32_t rem = absu & 0x1fffu;
+        if(rem > 0x1000u || (rem == 0x1000u && (h & 1u))) h++;
+        return (uint16_t) (sign | h);
+}
+
+float gemm_fp16_to_float(uint16_t h) {
+        const uint32_t sign = ((uint32_t) h & 0x8000u) << 16;
+        const uint32_t exp = (h >> 10) & 0x1fu;
+        uint32_t mant = h & 0x3ffu;
+
+        if(exp == 0x1fu) return bits_float(sign | 0x7f800000u | (mant << 13));
+        if(exp != 0) return bits_float(sign | ((exp + 112u) << 23) | (mant << 13));
+        if(mant == 0) return bits_float(sign);
+
+        // subnormal: normalize
+        int e = -1;
+        do {
+                mant <<= 1;
+                e++;
+        } while(!(mant & 0x400u));
+        return bits_float(sign | ((uint32_t) (112 - e) << 23) | ((mant & 0x3ffu) << 13));
+}
+
+// ------------------------------------------------------- //
+// FP32 packing from any input element type
+//
+// Same sliver layout as the FP64 kernel with MR = 4, NR = 16;
+// LOAD converts one input element to float.
+// ------------------------------------------------------- //
+#define GEMM_LOWP_PACK(NAME, IN_T, LOAD, ATTR)                                          \
+ATTR static void NAME##_pack_A(const gemm_args_t* g, int i0, int mc, int k0, int kc, void* out) { \
+        const IN_T* A = (const IN_T*) g->A;                                             \
+        float* GEMM_RESTRICT buf = (float*) out;                                        \
+        int ir, ii, k;                                                                  \
+        for(ir = 0; ir < mc; ir += GEMM_LOWP_MR) {                                      \
+                float* GEMM_RESTRICT dst = buf + (size_t) ir * kc;                      \
+                const int mr = (mc - ir < GEMM_LOWP_MR) ? mc - ir : GEMM_LOWP_MR;       \
+                if(g->transA == GemmNoTrans) {                                          \
+                        for(ii = 0; ii < mr; ii++) {                                    \
+                                const IN_T* src = A + (size_t) (i0 + ir + ii) * g->lda + k0; \
+                                for(k = 0; k < kc; k++) dst[k * GEMM_LOWP_MR + ii] = LOAD(src[k]); \
+                        }                                                               \
+                } else {                                                                \
+                        for(k = 0; k < kc; k++) {                                       \
+                                const IN_T* src = A + (size_t) (k0 + k) * g->lda + i0 + ir; \
+                                for(ii = 0; ii < mr; ii++) dst[k * GEMM_LOWP_MR + ii] = LOAD(src[ii]); \
+                        }                                                               \
+                }                                                                       \
+                for(ii = mr; ii < GEMM_LOWP_MR; ii++)                                   \
+                        for(k = 0; k < kc; k++) dst[k * GEMM_LOWP_MR + ii] = 0.0f;      \
+        }                                                                               \
+}                                                                                       \
+ATTR static void NAME##_pack_B(const gemm_args_t* g, int j0, int nc, int k0, int kc, void* out) { \
+        const IN_T* B = (const IN_T*) g->B;                                             \
+        float* GEMM_RESTRICT buf = (float*) out;                                        \
+        int jr, jj, k;                                                                  \
+        for(jr = 0; jr < nc; jr += GEMM_LOWP_NR) {                                      \
+                float* GEMM_RESTRICT dst = buf + (size_t) jr * kc;                      \
+                const int nr = (nc - jr < GEMM_LOWP_NR) ? nc - jr : GEMM_LOWP_NR;       \
+                if(g->transB == GemmNoTrans) {                                          \
+                        for(k = 0; k < kc; k++) {                                       \
+                                const IN_T* src = B + (size_t) (k0 + k) * g->ldb + j0 + jr; \
+                                for(jj = 0; jj < nr; jj++) dst[k * GEMM_LOWP_NR + jj] = LOAD(src[jj]); \
+                                for(jj = nr; jj < GEMM_LOWP_NR; jj++) dst[k * GEMM_LOWP_NR + jj] = 0.0f; \
+                        }                                                               \
+                } else {                                                                \
+                        for(jj = 0; jj < nr; jj++) {                                    \
+                                const IN_T* src = B + (size_t) (j0 + jr + jj) * g->ldb + k0; \
+                                for(k = 0; k < kc; k++) dst[k * GEMM_LOWP_NR + jj] = LOAD(src[k]); \
+                        }                                                               \
+                        for(jj = nr; jj < GEMM_LOWP_NR; jj++)                           \
+                                for(k = 0; k < kc; k++) dst[k * GEMM_LOWP_NR + jj] = 0.0f; \
+                }                                                                       \
+        }                                                                               \
+}
+
+#define GEMM_LOAD_FP32(x) (x)
+
+GEMM_LOWP_PACK(fp32, float, GEMM_LOAD_FP32, )
+GEMM_LOWP_PACK(bf16, uint16_t, gemm_bf16_to_float, )
+GEMM_LOWP_PACK(fp16, uint16_t, gemm_fp16_to_float, )
+
+#ifdef GEMM_LOWP_X86
+GEMM_LOWP_PACK(fp16_f16c, uint16_t, _cvtsh_ss, __attribute__((target("f16c"))))
+#endif
+
+// FP32 micro-kernel, C is float
+static void fp32_micro(int kc, const void* ap, const void* bp,
+        double alpha, void* Cp, int ldc, int mr, int nr) {
+
+        const float* GEMM_RESTRICT a = (const float*) ap;
+        const float* GEMM_RESTRICT b = (const float*) bp;
+        float* GEMM_RESTRICT C = (float*) Cp;
+        const float falpha = (float) alpha;
+        float acc[GEMM_LOWP_MR][GEMM_LOWP_NR];
+        int i, j, k;
+
+        for(i = 0; i < GEMM_LOWP_MR; i++)
+                for(j = 0; j < GEMM_LOWP_NR; j++) acc[i][j] = 0.0f;
+
+        for(k = 0; k < kc; k++) {
+                for(i = 0; i < GEMM_LOWP_MR; i++) {
+                        const float av = a[k * GEMM_LOWP_MR + i];
+                        for(j = 0; j < GEMM_LOWP_NR; j++) acc[i][j] += av * b[k * GEMM_LOWP_NR + j];
+                }
+        }
+
+        for(i = 0; i < mr; i++)
+                for(j = 0; j < nr; j++) C[(size_t) i * ldc + j] += falpha * acc[i][j];
+}
+
+static const gemm_kernel_t gemm_kernel_fp32 = {
+        "fp32", GEMM_LOWP_MR, GEMM_LOWP_NR, 1, sizeof(float), sizeof(float),
+        fp32_pack_A, fp32_pack_B, fp32_micro
+};
+
+static const gemm_kernel_t gemm_kernel_bf16_emulated = {
+        "bf16-emulated", GEMM_LOWP_MR, GEMM_LOWP_NR, 1, sizeof(float), sizeof(float),
+        bf16_pack_A, bf16_pack_B, fp32_micro
+};
+
+static const gemm_kernel_t gemm_kernel_fp16_emulated = {
+        "fp16-emulated", GEMM_LOWP_MR, GEMM_LOWP_NR, 1, sizeof(float), sizeof(float),
+        fp16_pack_A, fp16_pack_B, fp32_micro
+};
+
+#ifdef GEMM_LOWP_X86
+
+static const gemm_kernel_t gemm_kernel_fp16_f16c = {
+        "fp16-f16c", GEMM_LOWP_MR, GEMM_LOWP_NR, 1, sizeof(float), sizeof(float),
+        fp16_f16c_pack_A, fp16_f16c_pack_B, fp32_micro
+};
+
+// ------------------------------------------------------- //
+// AVX512_BF16 kernel
+//
+// Packed values stay BF16, interleaved in K pairs: element
+// (k, x) of a sliver sits at ((k / 2) * R + x) * 2 + k % 2,
+// so one 32-bit broadcast of A and one 512-bit load of B feed
+// VDPBF16PS, which adds both products of the pair into FP32.
+// ------------------------------------------------------- //
+static void bf16_pair_pack_A(const gemm_args_t* g, int i0, int mc, int k0, int kc, void* out) {
+        const uint16_t* A = (const uint16_t*) g->A;
+        uint16_t* GEMM_RESTRICT buf = (uint16_t*) out;
+        const int kcp = (kc + 1) & ~1;
+        int ir, ii, k;
+
+        for(ir = 0; ir < mc; ir += GEMM_LOWP_MR) {
+                uint16_t* GEMM_RESTRICT dst = buf + (size_t) ir * kcp;
+                const int mr = (mc - ir < GEMM_LOWP_MR) ? mc - ir : GEMM_LOWP_MR;
+
+                for(k = 0; k < kcp; k++) {
+                        for(ii = 0; ii < GEMM_LOWP_MR; ii++) {
+                                uint16_t v = 0;
+                                if(ii < mr && k < kc) {
+                                        v = (g->transA == GemmNoTrans) ?
+                                                A[(size_t) (i0 + ir + ii) * g->lda + k0 + k] :
+                                                A[(size_t) (k0 + k) * g->lda + i0 + ir + ii];
+                                }
+                                dst[((k >> 1) * GEMM_LOWP_MR + ii) * 2 + (k & 1)] = v;
+                        }
+                }
+        }
+}
+
+static void bf16_pair_pack_B(const gemm_args_t* g, int j0, int nc, int k0, int kc, void* out) {
+        const uint16_t* B = (const uint16_t*) g->B;
+        uint16_t* GEMM_RESTRICT buf = (uint16_t*) out;
+        const int kcp = (kc + 1) & ~1;
+        int jr, jj, k;
+
+        for(jr = 0; jr < nc; jr += GEMM_LOWP_NR) {
+                uint16_t* GEMM_RESTRICT dst = buf + (size_t) jr * kcp;
+                const int nr = (nc - jr < GEMM_LOWP_NR) ? nc - jr : GEMM_LOWP_NR;
+
+                for(k = 0; k < kcp; k++) {
+                        for(jj = 0; jj < GEMM_LOWP_NR; jj++) {
+                                uint16_t v = 0;
+                                if(jj < nr && k < kc) {
+                                        v = (g->transB == GemmNoTrans) ?
+                                                B[(size_t) (k0 + k) * g->ldb + j0 + jr + jj] :
+                                                B[(size_t) (j0 + jr + jj) * g->ldb + k0 + k];
+                                }
+                                dst[((k >> 1) * GEMM_LOWP_NR + jj) * 2 + (k & 1)] = v;
+                        }
+                }
+        }
+}
+
+__attribute__((target("avx512f,avx512bf16")))
+static void bf16_pair_micro(int kcp, const void* ap, const void* bp,
+        double alpha, void* Cp, int ldc, int mr, int nr) {
+
+        const uint32_t* GEMM_RESTRICT a = (const uint32_t*) ap;
+        const uint16_t* GEMM_RESTRICT b = (const uint16_t*) bp;
+        float* GEMM_RESTRICT C = (float*) Cp;
+        __m512 acc[GEMM_LOWP_MR];
+        int i, kp;
+
+        for(i = 0; i < GEMM_LOWP_MR; i++) acc[i] = _mm512_setzero_ps();
+
+        for(kp = 0; kp < kcp / 2; kp++) {
+                const __m512bh bv = (__m512bh) _mm512_loadu_si512(b + (size_t) kp * GEMM_LOWP_NR * 2);
+                for(i = 0; i < GEMM_LOWP_MR; i++) {
+                        const __m512bh av = (__m512bh) _mm512_set1_epi32((int) a[kp * GEMM_LOWP_MR + i]);
+                        acc[i] = _mm512_dpbf16_ps(acc[i], av, bv);
+                }
+        }
+
+        const __mmask16 mask = (__mmask16) ((1u << nr) - 1);
+        const __m512 valpha = _mm512_set1_ps((float) alpha);
+        for(i = 0; i < mr; i++) {
+                float* c = C + (size_t) i * ldc;
+                const __m512 cv = _mm512_maskz_loadu_ps(mask, c);
+                _mm512_mask_storeu_ps(c, mask, _mm512_fmadd_ps(valpha, acc[i], cv));
+        }
+}
+
+static const gemm_kernel_t gemm_kernel_bf16_avx512 = {
+        "bf16-avx512bf16", GEMM_LOWP_MR, GEMM_LOWP_NR, 2, sizeof(uint16_t), sizeof(float),
+        bf16_pair_pack_A, bf16_pair_pack_B, bf16_pair_micro
+};
+
+// ------------------------------------------------------- //
+// AVX512_FP16 kernel
+//
+// Same FP32 panels as the emulated kernel, filled 16 FP16
+// values per VCVTPH2PSX: contiguous runs of the source are
+// converted with masked loads (zeros past the edge, so the
+// padding comes for free) and scattered to the sliver stride
+// when the run is along K of A or across K of B.
+// ------------------------------------------------------- //
+#define GEMM_FP16_TARGET __attribute__((target("avx512f,avx512bw,avx512vl,avx512fp16")))
+
+// n <= 16 FP16 values from src, zero-extended to 16 floats
+GEMM_FP16_TARGET
+static inline __m512 fp16x16_load(const uint16_t* src, int n) {
+        const __mmask16 mask = (__mmask16) ((n >= 16) ? 0xffffu : (1u << n) - 1);
+        return _mm512_cvtxph_ps(_mm256_castsi256_ph(_mm256_maskz_loadu_epi16(mask, src)));
+}
+
+// kc FP16 values from src to dst[k * stride], k = 0 .. kc-1
+GEMM_FP16_TARGET
+static inline void fp16_run_scatter(const uint16_t* src, int kc, float* dst, int stride) {
+        const __m512i index = _mm512_mullo_epi32(
+                _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                _mm512_set1_epi32(stride));
+        int k;
+        for(k = 0; k < kc; k += 16) {
+                const int n = (kc - k < 16) ? kc - k : 16;
+                const __mmask16 mask = (__mmask16) ((n >= 16) ? 0xffffu : (1u << n) - 1);
+                _mm512_mask_i32scatter_ps(dst + (size_t) k * stride, mask, index, fp16x16_load(src + k, n), 4);
+        }
+}
+
+GEMM_FP16_TARGET
+static void fp16_avx512_pack_A(const gemm_args_t* g, int i0, int mc, int k0, int kc, void* out) {
+        const uint16_t* A = (const uint16_t*) g->A;
+        float* GEMM_RESTRICT buf = (float*) out;
+        int ir, ii, k;
+
+        for(ir = 0; ir < mc; ir += GEMM_LOWP_MR) {
+                float* GEMM_RESTRICT dst = buf + (size_t) ir * kc;
+                const int mr = (mc - ir < GEMM_LOWP_MR) ? mc - ir : GEMM_LOWP_MR;
+                if(g->transA == GemmNoTrans) {
+                        for(ii = 0; ii < mr; ii++)
+                                fp16_run_scatter(A + (size_t) (i0 + ir + ii) * g->lda + k0, kc, dst + ii, GEMM_LOWP_MR);
+                        for(ii = mr; ii < GEMM_LOWP_MR; ii++)
+                                for(k = 0; k < kc; k++) dst[k * GEMM_LOWP_MR + ii] = 0.0f;
+                } else {
+                        for(k = 0; k < kc; k++)
+                                _mm512_mask_storeu_ps(dst + k * GEMM_LOWP_MR, (__mmask16) ((1u << GEMM_LOWP_MR) - 1),
+                                        fp16x16_load(A + (size_t) (k0 + k) * g->lda + i0 + ir, mr));
+                }
+        }
+}
+
+GEMM_FP16_TARGET
+static void fp16_avx512_pack_B(const gemm_args_t* g, int j0, int nc, int k0, int kc, void* out) {
+        const uint16_t* B = (const uint16_t*) g->B;
+        float* GEMM_RESTRICT buf = (float*) out;
+        int jr, jj, k;
+
+        for(jr = 0; jr < nc; jr += GEMM_LOWP_NR) {
+                float* GEMM_RESTRICT dst = buf + (size_t) jr * kc;
+                const int nr = (nc - jr < GEMM_LOWP_NR) ? nc - jr : GEMM_LOWP_NR;
+                if(g->transB == GemmNoTrans) {
+                        for(k = 0; k < kc; k++)
+                                _mm512_storeu_ps(dst + k * GEMM_LOWP_NR,
+                                        fp16x16_load(B + (size_t) (k0 + k) * g->ldb + j0 + jr, nr));
+                } else {
+                        for(jj = 0; jj < nr; jj++)
+                                fp16_run_scatter(B + (size_t) (j0 + jr + jj) * g->ldb + k0, kc, dst + jj, GEMM_LOWP_NR);
+                        for(jj = nr; jj < GEMM_LOWP_NR; jj++)
+                                for(k = 0; k < kc; k++) dst[k * GEMM_LOWP_NR + jj] = 0.0f;
+                }
+        }
+}
+
+// fp32_micro with one 512-bit accumulator per row of A
+__attribute__((target("avx512f")))
+static void fp32_avx512_micro(int kc, const void* ap, const void* bp,
+        double alpha, void* Cp, int ldc, int mr, int nr) {
+
+        const float* GEMM_RESTRICT a = (const float*) ap;
+        const float* GEMM_RESTRICT b = (const float*) bp;
+        float* GEMM_RESTRICT C = (float*) Cp;
+        __m512 acc[GEMM_LOWP_MR];
+        int i, k;
+
+        for(i = 0; i < GEMM_LOWP_MR; i++) acc[i] = _mm512_setzero_ps();
+
+        for(k = 0; k < kc; k++) {
+                const __m512 bv = _mm512_loadu_ps(b + (size_t) k * GEMM_LOWP_NR);
+                for(i = 0; i < GEMM_LOWP_MR; i++)
+                        acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[k * GEMM_LOWP_MR + i]), bv, acc[i]);
+        }
+
+        const __mmask16 mask = (__mmask16) ((1u << nr) - 1);
+        const __m512 valpha = _mm512_set1_ps((float) alpha);
+        for(i = 0; i < mr; i++) {
+                float* c = C + (size_t) i * ldc;
+                const __m512 cv = _mm512_maskz_loadu_ps(mask, c);
+                _mm512_mask_storeu_ps(c, mask, _mm512_fmadd_ps(valpha, acc[i], cv));
+        }
+}
+
+static const gemm_kernel_t gemm_kernel_fp16_avx512 = {
+        "fp16-avx512fp16", GEMM_LOWP_MR, GEMM_LOWP_NR, 1, sizeof(float), sizeof(float),
+        fp16_avx512_pack_A, fp16_avx512_pack_B, fp32_avx512_micro
+};
+
+#endif // GEMM_LOWP_X86
+
+// ------------------------------------------------------- //
+// Kernel selection from CPUID
+// ------------------------------------------------------- //
+static const gemm_kernel_t* gemm_bf16_kernel(void) {
+#ifdef GEMM_LOWP_X86
+        if(!gemm_lowp_emulated && __builtin_cpu_supports("avx512bf16")) return &gemm_kernel_bf16_avx512;
+#endif
+        return &gemm_kernel_bf16_emulated;
+}
+
+static const gemm_kernel_t* gemm_fp16_kernel(void) {
+#ifdef GEMM_LOWP_X86
+        if(!gemm_lowp_emulated && __builtin_cpu_supports("avx512fp16")) return &gemm_kernel_fp16_avx512;
+        if(!gemm_lowp_emulated && __builtin_cpu_supports("f16c")) return &gemm_kernel_fp16_f16c;
+#endif
+        return &gemm_kernel_fp16_emulated;
+}
+
+const char* gemm_lowp_kernel_name(gemm_precision_t precision) {
+        switch(precision) {
+                case GemmFP64: return "fp64";
+                case GemmFP32: return gemm_kernel_fp32.name;
+                case GemmBF16: return gemm_bf16_kernel()->name;
+                case GemmFP16: return gemm_fp16_kernel()->name;
+        }
+        return "unknown";
+}
+
+void gemm_sgemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, float alpha,
+        const float* A, int lda, const float* B, int ldb,
+        float beta, float* C, int ldc) {
+
+        const gemm_args_t g = { &gemm_kernel_fp32, transA, transB, M, N, K, alpha, A, lda, B, ldb };
+        gemm_blocked(&g, beta, C, ldc);
+}
+
+void gemm_bf16_gemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, float alpha,
+        const uint16_t* A, int lda, const uint16_t* B, int ldb,
+        float beta, float* C, int ldc) {
+
+        const gemm_args_t g = { gemm_bf16_kernel(), transA, transB, M, N, K, alpha, A, lda, B, ldb };
+        gemm_blocked(&g, beta, C, ldc);
+}
+
+void gemm_fp16_gemm(gemm_trans_t transA, gemm_trans_t transB,
+        int M, int N, int K, float alpha,
+        const uint16_t* A, int lda, const uint16_t* B, int ldb,
+        float beta, float* C, int ldc) {
+
+        const gemm_args_t g = { gemm_fp16_kernel(), transA, transB, M, N, K, alpha, A, lda, B, ldb };
+        gemm_blocked(&g, beta, C, ldc);
+}
@@ -0,0 +1,320 @@
+// ------------------------------------------------------- //
+// Strassen-Winograd multiply (see gemm.h)
+//
+// Each level splits A, B and C into 2 x 2 quadrants and forms
+// C from 7 half-size products and 15 additions (Winograd's
+// variant). Odd dimensions are peeled: the even part recurses
+// and the last row / column / rank-1 update of K go through
+// gemm_dgemm. Below the crossover the blocked kernel runs.
+//
+// All temporaries come from one arena allocated up front and
+// carved level by level, so the recursion never calls malloc.
+// The top levels run the 7 products as OpenMP tasks, each with
+// its own slice of the arena; deeper levels are sequential
+// within their task and use the two-temporary schedule of
+// Douglas et al., reusing one slice for all 7 sub-products.
+// ------------------------------------------------------- //
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "nanoclock.h"
+#include "gemm_internal.h"
+
+#define GEMM_STRASSEN_CROSSOVER 1024
+
+typedef struct {
+        int crossover;          // recurse while min(m, n, k) > crossover
+        int task_levels;        // levels that run their products as tasks
+} strassen_ctx_t;
+
+static int imin(int a, int b) { return a < b ? a : b; }
+static int imax(int a, int b) { return a > b ? a : b; }
+
+// Bump allocator over the arena
+static double* arena_take(double** arena, size_t elements) {
+        double* p = *arena;
+        // keep every temporary 64-byte aligned for the packing loads
+        *arena += (elements + 7) / 8 * 8;
+        return p;
+}
+
+static int strassen_leaf(const strassen_ctx_t* s, int m, int n, int k) {
+        return imin(m, imin(n, k)) <= s->crossover;
+}
+
+// Arena elements needed by one call at the given depth
+static size_t strassen_arena_size(const strassen_ctx_t* s, int m, int n, int k, int depth) {
+        if(strassen_leaf(s, m, n, k)) return 0;
+
+        const size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+        const size_t mk = (m2 * k2 + 7) / 8 * 8;
+        const size_t kn = (k2 * n2 + 7) / 8 * 8;
+        const size_t mn = (m2 * n2 + 7) / 8 * 8;
+        const size_t child = strassen_arena_size(s, m2, n2, k2, depth + 1);
+
+        if(depth < s->task_levels) {
+                // S1..S4, T1..T4, P1, P6, P7, then one slice per task
+                return 4 * mk + 4 * kn + 3 * mn + 7 * child;
+        }
+        // X (m2 x max(k2, n2)) and Y (k2 x n2), children reuse one slice
+        return (m2 * imax(k2, n2) + 7) / 8 * 8 + kn + child;
+}
+
+// ------------------------------------------------------- //
+// Z = X + sign * Y over an m x n block. At task levels the
+// rows are split into a taskloop so the whole team helps.
+// ------------------------------------------------------- //
+static void strassen_add(int m, int n, const double* X, int ldx, const double* Y, int ldy,
+        double sign, double* Z, int ldz, int parallel) {
+
+        int i, j;
+
+        #pragma omp taskloop if(parallel) grainsize(64) private(j)
+        for(i = 0; i < m; i++) {
+                const double* GEMM_RESTRICT x = X + (size_t) i * ldx;
+                const double* GEMM_RESTRICT y = Y + (size_t) i * ldy;
+                double* z = Z + (size_t) i * ldz;
+
+                if(sign > 0) for(j = 0; j < n; j++) z[j] = x[j] + y[j];
+                else         for(j = 0; j < n; j++) z[j] = x[j] - y[j];
+        }
+}
+
+static void strassen_rec(const strassen_ctx_t* s, int depth, int m, int n, int k,
+        const double* A, int lda, const double* B, int ldb, double* C, int ldc, double* arena);
+
+// C = A * B for one even-sized level, products as parallel tasks
+static void strassen_level_tasks(const strassen_ctx_t* s, int depth, int m2, int n2, int k2,
+        const double* A, int lda, const double* B, int ldb, double* C, int ldc, double* arena) {
+
+        const double *A11 = A, *A12 = A + k2, *A21 = A + (size_t) m2 * lda, *A22 = A21 + k2;
+        const double *B11 = B, *B12 = B + n2, *B21 = B + (size_t) k2 * ldb, *B22 = B21 + n2;
+        double *C11 = C, *C12 = C + n2, *C21 = C + (size_t) m2 * ldc, *C22 = C21 + n2;
+
+        double* S1 = arena_take(&arena, (size_t) m2 * k2);
+        double* S2 = arena_take(&arena, (size_t) m2 * k2);
+        double* S3 = arena_take(&arena, (size_t) m2 * k2);
+        double* S4 = arena_take(&arena, (size_t) m2 * k2);
+        double* T1 = arena_take(&arena, (size_t) k2 * n2);
+        double* T2 = arena_take(&arena, (size_t) k2 * n2);
+        double* T3 = arena_take(&arena, (size_t) k2 * n2);
+        double* T4 = arena_take(&arena, (size_t) k2 * n2);
+        double* P1 = arena_take(&arena, (size_t) m2 * n2);
+        double* P6 = arena_take(&arena, (size_t) m2 * n2);
+        double* P7 = arena_take(&arena, (size_t) m2 * n2);
+        const size_t child = strassen_arena_size(s, m2, n2, k2, depth + 1);
+
+        strassen_add(m2, k2, A21, lda, A22, lda, 1.0, S1, k2, 1);
+        strassen_add(m2, k2, S1, k2, A11, lda, -1.0, S2, k2, 1);
+        strassen_add(m2, k2, A11, lda, A21, lda, -1.0, S3, k2, 1);
+        strassen_add(m2, k2, A12, lda, S2, k2, -1.0, S4, k2, 1);
+        strassen_add(k2, n2, B12, ldb, B11, ldb, -1.0, T1, n2, 1);
+        strassen_add(k2, n2, B22, ldb, T1, n2, -1.0, T2, n2, 1);
+        strassen_add(k2, n2, B22, ldb, B12, ldb, -1.0, T3, n2, 1);
+        strassen_add(k2, n2, T2, n2, B21, ldb, -1.0, T4, n2, 1);
+
+        // P2..P5 go straight into the C quadrants they end up in
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, A11, lda, B11, ldb, P1, n2, arena + 0 * child);
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, A12, lda, B21, ldb, C11, ldc, arena + 1 * child);
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, S4, k2, B22, ldb, C12, ldc, arena + 2 * child);
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, A22, lda, T4, n2, C21, ldc, arena + 3 * child);
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, S1, k2, T1, n2, C22, ldc, arena + 4 * child);
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, S2, k2, T2, n2, P6, n2, arena + 5 * child);
+        #pragma omp task
+        strassen_rec(s, depth + 1, m2, n2, k2, S3, k2, T3, n2, P7, n2, arena + 6 * child);
+        #pragma omp taskwait
+
+        strassen_add(m2, n2, P6, n2, P1, n2, 1.0, P6, n2, 1);           // U2 = P1 + P6
+        strassen_add(m2, n2, P7, n2, P6, n2, 1.0, P7, n2, 1);           // U3 = U2 + P7
+        strassen_add(m2, n2, C12, ldc, P6, n2, 1.0, C12, ldc, 1);       // U5 = P3 + U2 ...
+        strassen_add(m2, n2, C12, ldc, C22, ldc, 1.0, C12, ldc, 1);     //      ... + P5
+        strassen_add(m2, n2, C11, ldc, P1, n2, 1.0, C11, ldc, 1);       // U1 = P1 + P2
+        strassen_add(m2, n2, P7, n2, C21, ldc, -1.0, C21, ldc, 1);      // U6 = U3 - P4
+        strassen_add(m2, n2, C22, ldc, P7, n2, 1.0, C22, ldc, 1);       // U7 = U3 + P5
+}
+
+// C = A * B for one even-sized level, sequential with two temporaries
+static void strassen_level_seq(const strassen_ctx_t* s, int depth, int m2, int n2, int k2,
+        const double* A, int lda, const double* B, int ldb, double* C, int ldc, double* arena) {
+
+        const double *A11 = A, *A12 = A + k2, *A21 = A + (size_t) m2 * lda, *A22 = A21 + k2;
+        const double *B11 = B, *B12 = B + n2, *B21 = B + (size_t) k2 * ldb, *B22 = B21 + n2;
+        double *C11 = C, *C12 = C + n2, *C21 = C + (size_t) m2 * ldc, *C22 = C21 + n2;
+
+        double* X = arena_take(&arena, (size_t) m2 * imax(k2, n2));
+        double* Y = arena_take(&arena, (size_t) k2 * n2);
+
+        strassen_add(m2, k2, A11, lda, A21, lda, -1.0, X, k2, 0);       // S3
+        strassen_add(k2, n2, B22, ldb, B12, ldb, -1.0, Y, n2, 0);       // T3
+        strassen_rec(s, depth + 1, m2, n2, k2, X, k2, Y, n2, C21, ldc, arena);  // P7
+        strassen_add(m2, k2, A21, lda, A22, lda, 1.0, X, k2, 0);        // S1
+        strassen_add(k2, n2, B12, ldb, B11, ldb, -1.0, Y, n2, 0);       // T1
+        strassen_rec(s, depth + 1, m2, n2, k2, X, k2, Y, n2, C22, ldc, arena);  // P5
+        strassen_add(m2, k2, X, k2, A11, lda, -1.0, X, k2, 0);          // S2
+        strassen_add(k2, n2, B22, ldb, Y, n2, -1.0, Y, n2, 0);          // T2
+        strassen_rec(s, depth + 1, m2, n2, k2, X, k2, Y, n2, C12, ldc, arena);  // P6
+        strassen_add(m2, k2, A12, lda, X, k2, -1.0, X, k2, 0);          // S4
+        strassen_rec(s, depth + 1, m2, n2, k2, X, k2, B22, ldb, C11, ldc, arena); // P3
+        strassen_rec(s, depth + 1, m2, n2, k2, A11, lda, B11, ldb, X, n2, arena); // P1
+        strassen_add(m2, n2, X, n2, C12, ldc, 1.0, C12, ldc, 0);        // U2 = P1 + P6
+        strassen_add(m2, n2, C12, ldc, C21, ldc, 1.0, C21, ldc, 0);     // U3 = U2 + P7
+        strassen_add(m2, n2, C12, ldc, C22, ldc, 1.0, C12, ldc, 0);     // U4 = U2 + P5
+        strassen_add(m2, n2, C21, ldc, C22, ldc, 1.0, C22, ldc, 0);     // U7 = U3 + P5
+        strassen_add(m2, n2, C12, ldc, C11, ldc, 1.0, C12, ldc, 0);     // U5 = U4 + P3
+        strassen_add(k2, n2, Y, n2, B21, ldb, -1.0, Y, n2, 0);          // T4
+        strassen_rec(s, depth + 1, m2, n2, k2, A22, lda, Y, n2, C11, ldc, arena); // P4
+        strassen_add(m2, n2, C21, ldc, C11, ldc, -1.0, C21, ldc, 0);    // U6 = U3 - P4
+        strassen_rec(s, depth + 1, m2, n2, k2, A12, lda, B21, ldb, C11, ldc, arena); // P2
+        strassen_add(m2, n2, X, n2, C11, ldc, 1.0, C11, ldc, 0);        // U1 = P1 + P2
+}
+
+// C (m x n) = A (m x k) * B (k x n), all row-major and not transposed
+static void strassen_rec(const strassen_ctx_t* s, int depth, int m, int n, int k,
+        const double* A, int lda, const double* B, int ldb, double* C, int ldc, double* arena) {
+
+        if(strassen_leaf(s, m, n, k)) {
+                gemm_dgemm(GemmNoTrans, GemmNoTrans, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, ldc);
+                return;
+        }
+
+        const int me = m & ~1, ne = n & ~1, ke = k & ~1;
+
+        if(depth < s->task_levels) {
+                strassen_level_tasks(s, depth, me / 2, ne / 2, ke / 2, A, lda, B, ldb, C, ldc, arena);
+        } else {
+                strassen_level_seq(s, depth, me / 2, ne / 2, ke / 2, A, lda, B, ldb, C, ldc, arena);
+        }
+
+        // peel odd dimensions: rank-1 update for the last column of A
+        // / row of B, then the last column and row of C
+        if(k != ke) {
+                gemm_dgemm(GemmNoTrans, GemmNoTrans, me, ne, 1, 1.0, A + ke, lda,
+                        B + (size_t) ke * ldb, ldb, 1.0, C, ldc);
+        }
+        if(n != ne) {
+                gemm_dgemm(GemmNoTrans, GemmNoTrans, me, 1, k, 1.0, A, lda, B + ne, ldb,
+                        0.0, C + ne, ldc);
+        }
+        if(m != me) {
+                gemm_dgemm(GemmNoTrans, GemmNoTrans, 1, n, k, 1.0, A + (size_t) me * lda, lda,
+                        B, ldb, 0.0, C + (size_t) me * ldc, ldc);
+        }
+}
+
+static void strassen_init(strassen_ctx_t* s, int M, int N, int K, int crossover) {
+        const int threads = omp_get_max_threads();
+        int depth = 0, tasks = 1;
+
+        s->crossover = (crossover > 0) ? crossover : GEMM_STRASSEN_CROSSOVER;
+
+        // enough task levels for two tasks per thread, leaf products
+        // inside a task run the blocked kernel on one thread
+        while(imin(M, imin(N, K)) >> depth > s->crossover) depth++;
+        s->task_levels = 0;
+        while(threads > 1 && s->task_levels < depth && tasks < 2 * threads) {
+                s->task_levels++;
+                tasks *= 7;
+        }
+}
+
+int gemm_strassen_levels(int M, int N, int K, int crossover) {
+        strassen_ctx_t s;
+        int depth = 0;
+
+        strassen_init(&s, M, N, K, crossover);
+        while(!strassen_leaf(&s, M >> depth, N >> depth, K >> depth)) depth++;
+        return depth;
+}
+
+void gemm_dgemm_strassen(int M, int N, int K, double alpha,
+        const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc, int crossover) {
+
+        strassen_ctx_t s;
+        strassen_init(&s, M, N, K, crossover);
+
+        if(M <= 0 || N <= 0 || strassen_leaf(&s, M, N, K)) {
+                gemm_dgemm(GemmNoTrans, GemmNoTrans, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+                return;
+        }
+
+        // the recursion overwrites its output, so alpha / beta other
+        // than 1 / 0 need the product in a separate M x N buffer
+        const int direct = (alpha == 1.0 && beta == 0.0);
+        const size_t product = direct ? 0 : ((size_t) M * N + 7) / 8 * 8;
+        double* arena = (double*) gemm_alloc(sizeof(double) *
+                (product + strassen_arena_size(&s, M, N, K, 0)));
+        double* P = direct ? C : arena;
+        const int ldp = direct ? ldc : N;
+        int i, j;
+
+        #pragma omp parallel
+        #pragma omp single
+        strassen_rec(&s, 0, M, N, K, A, lda, B, ldb, P, ldp, arena + product);
+
+        if(!direct) {
+                #pragma omp parallel for private(j)
+                for(i = 0; i < M; i++) {
+                        double* c = C + (size_t) i * ldc;
+                        const double* p = P + (size_t) i * N;
+                        if(beta == 0.0) for(j = 0; j < N; j++) c[j] = alpha * p[j];
+                        else            for(j = 0; j < N; j++) c[j] = alpha * p[j] + beta * c[j];
+                }
+        }
+
+        free(arena);
+}
+
+// ------------------------------------------------------- //
+// Crossover tuning: for doubling sizes s, time a classical
+// 2s multiply against one Strassen level over s-size leaves
+// and return the first s where Strassen wins (0 if it never
+// does below max_n).
+// ------------------------------------------------------- //
+int gemm_strassen_tune(int max_n) {
+        int s;
+
+        nanoclock_init();       // no candidate may pay the TSC calibration
+
+        for(s = 256; 2 * s <= max_n; s *= 2) {
+                const int n = 2 * s;
+                double* A = (double*) gemm_alloc(sizeof(double) * n * n);
+                double* B = (double*) gemm_alloc(sizeof(double) * n * n);
+                double* C = (double*) gemm_alloc(sizeof(double) * n * n);
+                uint64_t classical = UINT64_MAX, fast = UINT64_MAX;
+                int e, rep;
+
+                for(e = 0; e < n * n; e++) {
+                        A[e] = (double) (e % 7) - 3.0;
+                        B[e] = (double) (e % 5) - 2.0;
+                }
+
+                // best of two, the first run also warms up the pages
+                for(rep = 0; rep < 2; rep++) {
+                        uint64_t t = nanoclock_now();
+                        gemm_dgemm(GemmNoTrans, GemmNoTrans, n, n, n, 1.0, A, n, B, n, 0.0, C, n);
+                        t = nanoclock_now() - t;
+                        if(t < classical) classical = t;
+
+                        t = nanoclock_now();
+                        gemm_dgemm_strassen(n, n, n, 1.0, A, n, B, n, 0.0, C, n, s);
+                        t = nanoclock_now() - t;
+                        if(t < fast) fast = t;
+                }
+
+                free(A);
+                free(B);
+                free(C);
+
+                if(fast < classical) return s;
+        }
+
+        return 0;
+}
@@ -0,0 +1,172 @@
+/**
+ * Idle package power baseline, see idle.h
+ **/
+
+#define _XOPEN_SOURCE 500
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "idle.h"
+#include "nanoclock.h"
+
+#define IDLE_SLICE_MS       100
+#define IDLE_MAX_SLICES     600
+#define IDLE_LINE_MAX       1024
+
+// First line of a sysfs/procfs file without the newline, "?" if unreadable
+static void read_line(const char *path, char *buf, size_t len){
+    FILE *f = fopen(path, "r");
+    snprintf(buf, len, "?");
+    if (f == NULL) return;
+    if (fgets(buf, (int)len, f) == NULL) snprintf(buf, len, "?");
+    buf[strcspn(buf, "\r\n")] = '\0';
+    fclose(f);
+}
+
+// "microcode : 0x..." of the first CPU in /proc/cpuinfo
+static void read_microcode(char *buf, size_t len){
+    char line[256];
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    snprintf(buf, len, "?");
+    if (f == NULL) return;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "microcode", 9) == 0 && strchr(line, ':') != NULL) {
+            const char *v = strchr(line, ':') + 1;
+            while (*v == ' ') v++;
+            snprintf(buf, len, "%s", v);
+            buf[strcspn(buf, "\r\n")] = '\0';
+            break;
+        }
+    }
+    fclose(f);
+}
+
+void idle_machine_key(char *key, size_t len){
+    char host[64], version[64], date[32], microcode[32];
+    if (gethostname(host, sizeof(host)) != 0) snprintf(host, sizeof(host), "?");
+    host[sizeof(host) - 1] = '\0';
+    read_line("/sys/class/dmi/id/bios_version", version, sizeof(version));
+    read_line("/sys/class/dmi/id/bios_date", date, sizeof(date));
+    read_microcode(microcode, sizeof(microcode));
+    // the key is one tab-separated field of the cache file
+    for (char *c = version; *c; c++) if (*c == '\t') *c = ' ';
+    snprintf(key, len, "host=%s bios=%s/%s microcode=%s", host, version, date, microcode);
+}
+
+static int compare_doubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int idle_measure(idle_baseline_t *b, int window_ms, double joule_unit){
+    static double slices[SOCKETSperNODE][IDLE_MAX_SLICES];
+    profiler_counters_t counters;
+    int n = window_ms / IDLE_SLICE_MS, i, s;
+
+    if (window_ms <= 0 || joule_unit <= 0.0) return -1;
+    if (n < 1) n = 1;
+    if (n > IDLE_MAX_SLICES) n = IDLE_MAX_SLICES;
+    const int slice_ms = window_ms / n;
+
+    profiler_core_read(&counters);     // baseline
+    uint64_t last = nanoclock_now();
+    for (i = 0; i < n; i++) {
+        usleep(slice_ms * 1000);
+        profiler_core_read(&counters);
+        uint64_t now = nanoclock_now();
+        double dt = nanoclock_to_sec(now - last);
+        last = now;
+        for (s = 0; s < SOCKETSperNODE; s++)
+            slices[s][i] = dt > 0.0 ? (double)counters.energy[s] * joule_unit / dt : 0.0;
+    }
+    for (s = 0; s < SOCKETSperNODE; s++) {
+        qsort(slices[s], n, sizeof(double), compare_doubles);
+        b->watts[s] = (n % 2) ? slices[s][n / 2] : 0.5 * (slices[s][n / 2 - 1] + slices[s][n / 2]);
+    }
+    b->window_ms = (double)slice_ms * n;
+    b->source = IDLE_MEASURED;
+    idle_machine_key(b->key, sizeof(b->key));
+    return 0;
+}
+
+// Parses one cache line; returns 0 when it is an entry for key with this socket count
+static int parse_entry(char *line, const char *key, idle_baseline_t *b){
+    char *save = NULL;
+    char *field = strtok_r(line, "\t\r\n", &save);
+    idle_baseline_t entry;
+    int s;
+    if (field == NULL || strcmp(field, key) != 0) return -1;
+    field = strtok_r(NULL, "\t\r\n", &save);
+    if (field == NULL || atoi(field) != SOCKETSperNODE) return -1;
+    field = strtok_r(NULL, "\t\r\n", &save);
+    if (field == NULL) return -1;
+    entry.window_ms = atof(field);
+    for (s = 0; s < SOCKETSperNODE; s++) {
+        field = strtok_r(NULL, "\t\r\n", &save);
+        if (field == NULL) return -1;
+        entry.watts[s] = atof(field);
+    }
+    // a truncated line leaves b untouched
+    b->window_ms = entry.window_ms;
+    memcpy(b->watts, entry.watts, sizeof(b->watts));
+    return 0;
+}
+
+int idle_cache_load(const char *path, idle_baseline_t *b){
+    char key[256], line[IDLE_LINE_MAX];
+    idle_baseline_t entry;
+    int found = -1;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    idle_machine_key(key, sizeof(key));
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (parse_entry(line, key, &entry) == 0) found = 0;   // the last entry wins
+    }
+    fclose(f);
+    if (found != 0) return -1;
+    memcpy(b->watts, entry.watts, sizeof(b->watts));
+    b->window_ms = entry.window_ms;
+    b->source = IDLE_CACHED;
+    snprintf(b->key, sizeof(b->key), "%s", key);
+    return 0;
+}
+
+int idle_cache_store(const char *path, const idle_baseline_t *b){
+    char tmp[1024], line[IDLE_LINE_MAX], copy[IDLE_LINE_MAX];
+    idle_baseline_t other;
+    int s;
+
+    // rewrite without this machine's old entry, then rename over the cache
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE *out = fopen(tmp, "w");
+    if (out == NULL) {
+        perror(tmp);
+        return -1;
+    }
+    FILE *in = fopen(path, "r");
+    if (in != NULL) {
+        while (fgets(line, sizeof(line), in) != NULL) {
+            snprintf(copy, sizeof(copy), "%s", line);
+            if (parse_entry(copy, b->key, &other) != 0) fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s\t%d\t%.0f", b->key, SOCKETSperNODE, b->window_ms);
+    for (s = 0; s < SOCKETSperNODE; s++) fprintf(out, "\t%f", b->watts[s]);
+    fprintf(out, "\n");
+    if (fclose(out) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+double idle_node_watts(const idle_baseline_t *b){
+    double w = 0.0;
+    int s;
+    if (b->source == IDLE_NONE) return 0.0;
+    for (s = 0; s < SOCKETSperNODE; s++) w += b->watts[s];
+    return w;
+}
@@ -0,0 +1,45 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stddef.h>
+#include "profiler_internal.h"
+
+/**
+ * Idle package power baseline, splitting package energy into a static part
+ * (idle power times elapsed time) and the dynamic rest the workload added.
+ *
+ * The baseline is the power of every socket over a quiet window: the median
+ * of its 100 ms slices, so a stray burst of background work does not raise
+ * it. A baseline belongs to a machine and its firmware; the cache file keeps
+ * one line per key (hostname, BIOS version and date, CPU microcode) so later
+ * runs on the same machine reuse it instead of waiting out the window:
+ *
+ *   <key>\t<sockets>\t<window ms>\t<W socket 0>\t<W socket 1>...
+ **/
+
+typedef enum { IDLE_NONE = 0, IDLE_MEASURED, IDLE_CACHED } idle_source_t;
+
+typedef struct {
+    idle_source_t source;
+    double watts[SOCKETSperNODE];   // idle package power per socket
+    double window_ms;               // quiet window the baseline was measured over
+    char key[256];                  // machine and firmware it belongs to
+} idle_baseline_t;
+
+// "host=<hostname> bios=<version>/<date> microcode=<rev>", unknown parts as "?"
+void idle_machine_key(char *key, size_t len);
+
+// Measures the baseline over window_ms; the MSR core must be open and the
+// caller idle. Returns 0 on success.
+int idle_measure(idle_baseline_t *b, int window_ms, double joule_unit);
+
+// Fills b from the cache entry for this machine. Returns 0 when found.
+int idle_cache_load(const char *path, idle_baseline_t *b);
+
+// Writes b as this machine's cache entry, replacing an older one. Returns 0 on success.
+int idle_cache_store(const char *path, const idle_baseline_t *b);
+
+// Idle power of the node (W), 0 without a baseline
+double idle_node_watts(const idle_baseline_t *b);
+
+#endif // IDLE_H
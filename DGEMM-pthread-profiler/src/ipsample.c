@@ -0,0 +1,519 @@
+/**
+ * Instruction-pointer sampling and flat profile, see ipsample.h
+ **/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "ipsample.h"
+#include "profiler_internal.h"
+
+#define IPSAMPLE_MAX_THREADS    1024
+#define IPSAMPLE_DATA_PAGES     16      // ring buffer size per thread, power of two
+#define IPSAMPLE_DEFAULT_PERIOD 2000000 // events; cpu-clock uses 1 ms
+#define IPSAMPLE_DEFAULT_TOP    40
+
+typedef struct {
+    int fd;
+    struct perf_event_mmap_page *meta;
+    char *data;
+    uint64_t size;
+} ipsample_ring_t;
+
+// address -> samples and joules, open addressing
+typedef struct {
+    uint64_t ip;
+    uint64_t samples;
+    double joules;
+} ipsample_entry_t;
+
+static const char *event_name = NULL;
+static uint64_t period = 0;
+static int top = IPSAMPLE_DEFAULT_TOP;
+
+static ipsample_ring_t rings[IPSAMPLE_MAX_THREADS];
+static int nrings = 0;
+static size_t page_size = 0;
+
+static ipsample_entry_t *table = NULL;
+static size_t table_size = 0, table_used = 0;
+
+static uint64_t *pending = NULL;    // samples of the current interval
+static size_t pending_size = 0, pending_used = 0;
+
+static uint64_t total_samples = 0, lost_samples = 0;
+static double unattributed = 0.0;   // energy of intervals without samples
+
+static void table_add(uint64_t ip, double joules){
+    size_t i;
+    if (2 * (table_used + 1) > table_size) {
+        ipsample_entry_t *old = table;
+        size_t old_size = table_size;
+        table_size = table_size ? 2 * table_size : 4096;
+        table = calloc(table_size, sizeof(ipsample_entry_t));
+        table_used = 0;
+        for (i = 0; i < old_size; i++) {
+            if (old[i].samples > 0) {
+                size_t j = (old[i].ip * 0x9E3779B97F4A7C15ULL) & (table_size - 1);
+                while (table[j].samples > 0) j = (j + 1) & (table_size - 1);
+                table[j] = old[i];
+                table_used++;
+            }
+        }
+        free(old);
+    }
+    i = (ip * 0x9E3779B97F4A7C15ULL) & (table_size - 1);
+    while (table[i].samples > 0 && table[i].ip != ip) i = (i + 1) & (table_size - 1);
+    if (table[i].samples == 0) {
+        table[i].ip = ip;
+        table_used++;
+    }
+    table[i].samples++;
+    table[i].joules += joules;
+}
+
+static void pending_push(uint64_t ip){
+    if (pending_used == pending_size) {
+        pending_size = pending_size ? 2 * pending_size : 4096;
+        pending = realloc(pending, pending_size * sizeof(uint64_t));
+    }
+    pending[pending_used++] = ip;
+}
+
+static int open_thread(pid_t tid, struct perf_event_attr *attr){
+    const size_t length = (1 + IPSAMPLE_DATA_PAGES) * page_size;
+    int fd = (int)syscall(SYS_perf_event_open, attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) return -errno;
+
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        return -err;
+    }
+    rings[nrings].fd = fd;
+    rings[nrings].meta = base;
+    rings[nrings].data = (char *)base + page_size;
+    rings[nrings].size = IPSAMPLE_DATA_PAGES * page_size;
+    nrings++;
+    return 0;
+}
+
+static void make_attr(struct perf_event_attr *attr, const char *name){
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    if (strcmp(name, "cpu-clock") == 0) {
+        attr->type = PERF_TYPE_SOFTWARE;
+        attr->config = PERF_COUNT_SW_TASK_CLOCK;
+    } else {
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = strcmp(name, "instructions") == 0 ?
+                       PERF_COUNT_HW_INSTRUCTIONS : PERF_COUNT_HW_CPU_CYCLES;
+    }
+    attr->sample_period = period;
+    attr->sample_type = PERF_SAMPLE_IP;
+    // no inherit: the kernel refuses to mmap inherited per-task events
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->wakeup_events = 0;    // drained by polling, no wakeups
+}
+
+int ipsample_start(void){
+    const char *mode = getenv("PROFILER_IP_SAMPLING");
+    struct perf_event_attr attr;
+    pid_t self = (pid_t)syscall(SYS_gettid);
+    DIR *tasks;
+    struct dirent *ent;
+    int failed = 0, err = 0;
+
+    if (mode == NULL || *mode == '\0' || strcmp(mode, "0") == 0 || strcmp(mode, "off") == 0)
+        return 0;
+    if (strcmp(mode, "cycles") != 0 && strcmp(mode, "instructions") != 0 &&
+        strcmp(mode, "cpu-clock") != 0) {
+        fprintf(stderr, "::PROFILER_IP_SAMPLING expects cycles, instructions or cpu-clock, not %s\n", mode);
+        return 0;
+    }
+
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    event_name = mode;
+    top = profiler_env_int("PROFILER_IP_TOP", IPSAMPLE_DEFAULT_TOP);
+
+    // probe the event on ourselves first: no PMU (ENOENT/EOPNOTSUPP) falls back to cpu-clock
+    for (;;) {
+        int fd;
+        period = (uint64_t)profiler_env_int("PROFILER_IP_PERIOD",
+                    strcmp(event_name, "cpu-clock") == 0 ? 1000000 : IPSAMPLE_DEFAULT_PERIOD);
+        make_attr(&attr, event_name);
+        fd = (int)syscall(SYS_perf_event_open, &attr, self, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd >= 0) {
+            close(fd);
+            break;
+        }
+        err = errno;
+        if ((err == ENOENT || err == EOPNOTSUPP) && strcmp(event_name, "cpu-clock") != 0) {
+            fprintf(stderr, "::No %s event on this CPU, IP sampling falls back to cpu-clock\n", event_name);
+            event_name = "cpu-clock";
+            continue;
+        }
+        fprintf(stderr, "::IP sampling unavailable: perf_event_open: %s\n", strerror(err));
+        return 0;
+    }
+
+    tasks = opendir("/proc/self/task");
+    if (tasks == NULL) return 0;
+    while ((ent = readdir(tasks)) != NULL && nrings < IPSAMPLE_MAX_THREADS) {
+        pid_t tid = (pid_t)atoi(ent->d_name);
+        if (tid <= 0 || tid == self) continue;
+        if (open_thread(tid, &attr) != 0) failed++;
+    }
+    closedir(tasks);
+
+    if (failed > 0) fprintf(stderr, "::IP sampling could not attach to %d threads\n", failed);
+    fprintf(stderr, "===IP sampling on %s every %" PRIu64 " over %d threads===\n",
+            event_name, period, nrings);
+    return nrings;
+}
+
+static void drain_ring(ipsample_ring_t *r){
+    uint64_t head = __atomic_load_n(&r->meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->meta->data_tail;
+
+    while (tail < head) {
+        struct perf_event_header header;
+        char record[256];
+        uint64_t offset = tail % r->size;
+        uint64_t i;
+
+        // records may wrap around the end of the buffer
+        for (i = 0; i < sizeof(header); i++)
+            ((char *)&header)[i] = r->data[(offset + i) % r->size];
+        if (header.size < sizeof(header)) break;
+        if (header.size <= sizeof(record)) {
+            for (i = 0; i < header.size; i++)
+                record[i] = r->data[(offset + i) % r->size];
+            if (header.type == PERF_RECORD_SAMPLE) {
+                uint64_t ip;
+                memcpy(&ip, record + sizeof(header), sizeof(ip));
+                pending_push(ip);
+            } else if (header.type == PERF_RECORD_LOST) {
+                uint64_t lost;
+                memcpy(&lost, record + sizeof(header) + sizeof(uint64_t), sizeof(lost));
+                lost_samples += lost;
+            }
+        }
+        tail += header.size;
+    }
+    __atomic_store_n(&r->meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void ipsample_drain(double energy){
+    size_t i;
+    int r;
+
+    if (nrings == 0) return;
+    pending_used = 0;
+    for (r = 0; r < nrings; r++) drain_ring(&rings[r]);
+
+    if (pending_used == 0) {
+        unattributed += energy;
+        return;
+    }
+    for (i = 0; i < pending_used; i++) table_add(pending[i], energy / pending_used);
+    total_samples += pending_used;
+}
+
+void ipsample_stop(void){
+    int r;
+    for (r = 0; r < nrings; r++) {
+        ioctl(rings[r].fd, PERF_EVENT_IOC_DISABLE, 0);
+        munmap(rings[r].meta, (1 + IPSAMPLE_DATA_PAGES) * page_size);
+        close(rings[r].fd);
+    }
+    nrings = 0;
+}
+
+/************************************************************************/
+// Symbolization
+/************************************************************************/
+
+typedef struct {
+    uint64_t value, size;
+    char *name;
+} ipsample_sym_t;
+
+typedef struct {
+    char *path;
+    int loaded;
+    ipsample_sym_t *syms;
+    size_t nsyms;
+    Elf64_Phdr *loads;          // PT_LOAD headers, file offset -> vaddr
+    int nloads;
+} ipsample_module_t;
+
+typedef struct {
+    uint64_t start, end, offset;
+    int module;
+} ipsample_map_t;
+
+typedef struct {
+    const char *function;
+    const char *module;
+    uint64_t samples;
+    double joules;
+} ipsample_func_t;
+
+static ipsample_module_t *modules = NULL;
+static int nmodules = 0;
+
+static int compare_syms(const void *a, const void *b){
+    const ipsample_sym_t *x = a, *y = b;
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+static void load_module(ipsample_module_t *m){
+    int fd = open(m->path, O_RDONLY);
+    struct stat st;
+    const unsigned char *base;
+    const Elf64_Ehdr *eh;
+    const Elf64_Shdr *sh;
+    int i, pass;
+
+    m->loaded = 1;
+    if (fd < 0) return;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return;
+
+    eh = (const Elf64_Ehdr *)base;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64) {
+        munmap((void *)base, st.st_size);
+        return;
+    }
+
+    m->loads = malloc(sizeof(Elf64_Phdr) * (eh->e_phnum + 1));
+    for (i = 0; i < eh->e_phnum; i++) {
+        const Elf64_Phdr *ph = (const Elf64_Phdr *)(base + eh->e_phoff + (size_t)i * eh->e_phentsize);
+        if (ph->p_type == PT_LOAD) m->loads[m->nloads++] = *ph;
+    }
+
+    // the full symbol table when present, the dynamic one of stripped libraries otherwise
+    sh = (const Elf64_Shdr *)(base + eh->e_shoff);
+    for (pass = 0; pass < 2 && m->nsyms == 0; pass++) {
+        const uint32_t want = pass == 0 ? SHT_SYMTAB : SHT_DYNSYM;
+        for (i = 0; i < eh->e_shnum; i++) {
+            const Elf64_Sym *sym;
+            const char *strtab;
+            size_t n, k;
+
+            if (sh[i].sh_type != want || sh[i].sh_link >= eh->e_shnum) continue;
+            sym = (const Elf64_Sym *)(base + sh[i].sh_offset);
+            strtab = (const char *)(base + sh[sh[i].sh_link].sh_offset);
+            n = sh[i].sh_size / sizeof(Elf64_Sym);
+            m->syms = realloc(m->syms, sizeof(ipsample_sym_t) * (m->nsyms + n));
+            for (k = 0; k < n; k++) {
+                int type = ELF64_ST_TYPE(sym[k].st_info);
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+                    sym[k].st_shndx == SHN_UNDEF || sym[k].st_value == 0) continue;
+                m->syms[m->nsyms].value = sym[k].st_value;
+                m->syms[m->nsyms].size = sym[k].st_size;
+                m->syms[m->nsyms].name = strdup(strtab + sym[k].st_name);
+                m->nsyms++;
+            }
+        }
+    }
+    qsort(m->syms, m->nsyms, sizeof(ipsample_sym_t), compare_syms);
+    munmap((void *)base, st.st_size);
+}
+
+static int find_module(const char *path){
+    int i;
+    for (i = 0; i < nmodules; i++)
+        if (strcmp(modules[i].path, path) == 0) return i;
+    modules = realloc(modules, sizeof(ipsample_module_t) * (nmodules + 1));
+    memset(&modules[nmodules], 0, sizeof(ipsample_module_t));
+    modules[nmodules].path = strdup(path);
+    return nmodules++;
+}
+
+static ipsample_map_t *read_maps(int *count){
+    FILE *f = fopen("/proc/self/maps", "r");
+    ipsample_map_t *maps = NULL;
+    char line[4096];
+    int n = 0;
+
+    if (f == NULL) return NULL;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        uint64_t start, end, offset;
+        char perms[8], path[4096];
+        path[0] = '\0';
+        if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %7s %" SCNx64 " %*s %*s %4095[^\n]",
+                   &start, &end, perms, &offset, path) < 4) continue;
+        if (perms[2] != 'x' || path[0] == '\0') continue;
+        maps = realloc(maps, sizeof(ipsample_map_t) * (n + 1));
+        maps[n].start = start;
+        maps[n].end = end;
+        maps[n].offset = offset;
+        maps[n].module = find_module(path);
+        n++;
+    }
+    fclose(f);
+    *count = n;
+    return maps;
+}
+
+// function name for ip, or NULL; *module is set whenever a mapping matches
+static const char *symbolize(uint64_t ip, const ipsample_map_t *maps, int nmaps, const char **module){
+    int i, k;
+    *module = NULL;
+    for (i = 0; i < nmaps; i++) {
+        ipsample_module_t *m;
+        uint64_t file_offset, vaddr = 0;
+        size_t lo, hi;
+        int found = 0;
+
+        if (ip < maps[i].start || ip >= maps[i].end) continue;
+        m = &modules[maps[i].module];
+        *module = m->path;
+        if (m->path[0] == '[') return NULL;         // [vdso] and friends
+        if (!m->loaded) load_module(m);
+
+        file_offset = ip - maps[i].start + maps[i].offset;
+        for (k = 0; k < m->nloads; k++) {
+            if (file_offset >= m->loads[k].p_offset &&
+                file_offset < m->loads[k].p_offset + m->loads[k].p_filesz) {
+                vaddr = file_offset - m->loads[k].p_offset + m->loads[k].p_vaddr;
+                found = 1;
+                break;
+            }
+        }
+        if (!found || m->nsyms == 0) return NULL;
+
+        // last symbol starting at or below vaddr
+        lo = 0;
+        hi = m->nsyms;
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (m->syms[mid].value <= vaddr) lo = mid; else hi = mid;
+        }
+        if (m->syms[lo].value > vaddr) return NULL;
+        if (m->syms[lo].size > 0 && vaddr >= m->syms[lo].value + m->syms[lo].size) return NULL;
+        return m->syms[lo].name;
+    }
+    return NULL;
+}
+
+static int compare_funcs(const void *a, const void *b){
+    const ipsample_func_t *x = a, *y = b;
+    if (x->joules != y->joules) return (x->joules < y->joules) - (x->joules > y->joules);
+    return (x->samples < y->samples) - (x->samples > y->samples);
+}
+
+void ipsample_dump(FILE *out){
+    ipsample_map_t *maps;
+    ipsample_func_t *funcs;
+    int nmaps = 0, nfuncs = 0, i, j;
+    size_t e;
+    double total_joules = unattributed;
+
+    if (event_name == NULL || out == NULL) return;
+
+    maps = read_maps(&nmaps);
+    funcs = malloc(sizeof(ipsample_func_t) * (table_used + 1));
+    for (e = 0; e < table_size; e++) {
+        const char *module, *name;
+        if (table[e].samples == 0) continue;
+        name = symbolize(table[e].ip, maps, nmaps, &module);
+        if (name == NULL) name = "[unknown]";
+        if (module == NULL) module = "[unknown]";
+        for (j = 0; j < nfuncs; j++)
+            if (strcmp(funcs[j].function, name) == 0 && strcmp(funcs[j].module, module) == 0) break;
+        if (j == nfuncs) {
+            funcs[nfuncs].function = name;
+            funcs[nfuncs].module = module;
+            funcs[nfuncs].samples = 0;
+            funcs[nfuncs].joules = 0.0;
+            nfuncs++;
+        }
+        funcs[j].samples += table[e].samples;
+        funcs[j].joules += table[e].joules;
+        total_joules += table[e].joules;
+    }
+    qsort(funcs, nfuncs, sizeof(ipsample_func_t), compare_funcs);
+
+    fprintf(out,"\n============================ IP Sampling Flat Profile ============================\n");
+    fprintf(out,"EVENT %s\tPERIOD %" PRIu64 "\tSAMPLES %" PRIu64 "\tLOST %" PRIu64 "\tENERGY(J) %f\n",
+            event_name, period, total_samples, lost_samples, total_joules);
+    fprintf(out,"%s\t","ENERGY(J)");
+    fprintf(out,"%s\t","ENERGY(%)");
+    fprintf(out,"%s\t","SAMPLES");
+    fprintf(out,"%s\t","EVENTS");
+    fprintf(out,"%s\t","FUNCTION");
+    fprintf(out,"%s\t","MODULE");
+    fprintf(out,"\n");
+    for (i = 0; i < nfuncs; i++) {
+        if (top > 0 && i == top) {
+            uint64_t samples = 0;
+            double joules = 0.0;
+            for (j = i; j < nfuncs; j++) {
+                samples += funcs[j].samples;
+                joules += funcs[j].joules;
+            }
+            fprintf(out,"%f\t%f\t%" PRIu64 "\t%" PRIu64 "\t[%d other functions]\t-\n", joules,
+                    total_joules > 0 ? 100.0 * joules / total_joules : 0.0, samples,
+                    samples * period, nfuncs - i);
+            break;
+        }
+        const char *slash = strrchr(funcs[i].module, '/');
+        fprintf(out,"%f\t%f\t%" PRIu64 "\t%" PRIu64 "\t%s\t%s\n", funcs[i].joules,
+                total_joules > 0 ? 100.0 * funcs[i].joules / total_joules : 0.0, funcs[i].samples,
+                funcs[i].samples * period, funcs[i].function, slash ? slash + 1 : funcs[i].module);
+    }
+    if (unattributed > 0)
+        fprintf(out,"%f\t%f\t0\t0\t[intervals without samples]\t-\n", unattributed,
+                total_joules > 0 ? 100.0 * unattributed / total_joules : 0.0);
+    fprintf(out,"(EVENTS = SAMPLES x PERIOD, e.g. instructions retired with PROFILER_IP_SAMPLING=instructions)\n");
+    fprintf(out,"=============================================================================\n");
+
+    free(funcs);
+    free(maps);
+}
+
+void ipsample_free(void){
+    int i;
+    size_t s;
+    for (i = 0; i < nmodules; i++) {
+        for (s = 0; s < modules[i].nsyms; s++) free(modules[i].syms[s].name);
+        free(modules[i].syms);
+        free(modules[i].loads);
+        free(modules[i].path);
+    }
+    free(modules);
+    modules = NULL;
+    nmodules = 0;
+    free(table);
+    table = NULL;
+    table_size = table_used = 0;
+    free(pending);
+    pending = NULL;
+    pending_size = pending_used = 0;
+    total_samples = lost_samples = 0;
+    unattributed = 0.0;
+    event_name = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef IPSAMPLE_H
+#define IPSAMPLE_H
+
+#include <stdio.h>
+
+/**
+ * Instruction-pointer sampling, enabled with PROFILER_IP_SAMPLING.
+ *
+ * Every thread of the process gets a perf_event_open overflow event (cycles,
+ * instructions or the cpu-clock software event) whose samples land in an
+ * mmap ring buffer. Threads created after profiler_start() are not sampled, so
+ * the application should spin up its thread pool first. The profiler drains the
+ * buffers once per sample interval and splits that interval's package energy
+ * evenly over the samples it drained, so a function's joules follow its share
+ * of the samples. At the end the addresses are symbolized against the ELF
+ * symbol tables of the binary and shared libraries mapped in /proc/self/maps,
+ * and a flat profile is written to finalRes.
+ *
+ * PROFILER_IP_PERIOD sets the sample period (events, or nanoseconds for
+ * cpu-clock); PROFILER_IP_TOP the number of functions listed. Kernel code is
+ * not sampled, so the mode works with perf_event_paranoid up to 2. When the
+ * CPU has no PMU the hardware events fall back to cpu-clock.
+ **/
+
+// Reads the configuration and opens the events on every thread except the
+// caller (the profiler worker). Returns 0 when sampling is off or unavailable.
+int ipsample_start(void);
+
+// Drains the ring buffers and attributes energy (J) of the interval that just
+// ended to the samples found
+void ipsample_drain(double energy);
+
+// Final drain is up to the caller; closes the events and keeps the profile
+void ipsample_stop(void);
+
+// Symbolizes the profile and writes the flat profile section to out
+void ipsample_dump(FILE *out);
+
+void ipsample_free(void);
+
+#endif // IPSAMPLE_H
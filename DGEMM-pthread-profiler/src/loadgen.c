@@ -0,0 +1,634 @@
+/**
+ * loadgen: synthetic phase-controlled load for validating libprofiler
+ *
+ * Runs a script of timed phases on every OpenMP thread and checks what the
+ * profiler recorded against what was run:
+ *   - fma    : 8 independent FMA chains (AVX-512, AVX2 or SSE2 mul+add)
+ *   - int    : 8 scalar integer adds on 4 registers
+ *   - stream : SSE2 loads+adds over a buffer much larger than the LLC
+ *   - idle   : every thread sleeps
+ * Each kernel is an inline-asm loop with a fixed number of instructions per
+ * iteration, so the instructions retired by a phase are known exactly (the C
+ * loop around the kernels adds a few hundred instructions per millisecond,
+ * well below the counter noise). Phases are marked with profiler_phase_begin()
+ * so they show up in the PROFILER_TRACE timeline, and their boundaries are
+ * recorded on the perflog time axis.
+ *
+ * After the run the checker reads perflog.txt and reports, per phase, the
+ * instructions the profiler attributes to the phase window (samples split pro
+ * rata at the boundaries) and the rate over the samples wholly inside it,
+ * against the known counts; and, per boundary, where the change of instruction
+ * rate places it against where it really was. INST_RETIRED counts user-mode
+ * instructions of the whole node, so run on an otherwise quiet machine; idle
+ * phases show the background level.
+ *
+ * Usage: loadgen [options] [kind:seconds ...]
+ *        loadgen --check=phases.csv [--perflog=perflog.txt]
+ **/
+
+#include "profiler.h"
+#include "nanoclock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <omp.h>
+
+#if !defined(__x86_64__)
+#error "loadgen kernels are written for x86-64"
+#endif
+
+#define MAX_PHASES          256
+#define MAX_LINE            1024
+#define INSNS_PER_ITER      10          // fma and int loop bodies, including dec/jnz
+#define STREAM_INSNS_PER_LINE 7         // 4 addpd + add + dec + jnz per 64-byte line
+#define COMPUTE_CHUNK       (1 << 18)   // iterations between deadline checks
+#define STREAM_CHUNK        (1 << 20)   // bytes between deadline checks
+#define DEFAULT_STREAM_MB   512
+#define DEFAULT_TOLERANCE   5.0         // % rate error still counted as a pass
+#define DEFAULT_SCRIPT      "idle:1,fma:2,int:2,stream:2,idle:1"
+
+typedef enum { PhaseFma = 0, PhaseInt, PhaseStream, PhaseIdle } phase_kind_t;
+static const char *kind_names[] = { "fma", "int", "stream", "idle" };
+
+typedef enum { FmaAuto = 0, FmaAvx512, FmaAvx2, FmaSse2 } fma_isa_t;
+static const char *isa_names[] = { "auto", "avx512", "avx2", "sse2" };
+
+typedef struct {
+    phase_kind_t kind;
+    double seconds;         // scripted duration
+    double begin_ms;        // phase window on the perflog TIME(ms) axis
+    double end_ms;
+    int first_sample;       // profiler_sample_index() at begin and end
+    int last_sample;
+    double expected;        // instructions retired by the kernels
+    double bytes;           // bytes read (stream)
+} phase_t;
+
+static phase_t phases[MAX_PHASES];
+static int num_phases = 0;
+
+/************************************************************************/
+// Kernels: each returns the exact number of instructions its asm retired
+/************************************************************************/
+
+static uint64_t kernel_fma_avx512(uint64_t iters){
+    uint64_t n = iters;
+    __asm__ volatile(
+        "vxorpd %%xmm0, %%xmm0, %%xmm0\n\t"     // VEX zeroing clears the full zmm
+        "vxorpd %%xmm1, %%xmm1, %%xmm1\n\t"
+        "vxorpd %%xmm2, %%xmm2, %%xmm2\n\t"
+        "vxorpd %%xmm3, %%xmm3, %%xmm3\n\t"
+        "vxorpd %%xmm4, %%xmm4, %%xmm4\n\t"
+        "vxorpd %%xmm5, %%xmm5, %%xmm5\n\t"
+        "vxorpd %%xmm6, %%xmm6, %%xmm6\n\t"
+        "vxorpd %%xmm7, %%xmm7, %%xmm7\n\t"
+        "vxorpd %%xmm8, %%xmm8, %%xmm8\n\t"
+        "vxorpd %%xmm9, %%xmm9, %%xmm9\n\t"
+        "1:\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm2\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm3\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm4\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm5\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm6\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm7\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm8\n\t"
+        "vfmadd231pd %%zmm0, %%zmm1, %%zmm9\n\t"
+        "dec %0\n\t"
+        "jnz 1b\n\t"
+        "vzeroupper\n\t"
+        : "+r"(n)
+        :
+        : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "cc");
+    return 11 + INSNS_PER_ITER * iters;
+}
+
+static uint64_t kernel_fma_avx2(uint64_t iters){
+    uint64_t n = iters;
+    __asm__ volatile(
+        "vxorpd %%xmm0, %%xmm0, %%xmm0\n\t"
+        "vxorpd %%xmm1, %%xmm1, %%xmm1\n\t"
+        "vxorpd %%xmm2, %%xmm2, %%xmm2\n\t"
+        "vxorpd %%xmm3, %%xmm3, %%xmm3\n\t"
+        "vxorpd %%xmm4, %%xmm4, %%xmm4\n\t"
+        "vxorpd %%xmm5, %%xmm5, %%xmm5\n\t"
+        "vxorpd %%xmm6, %%xmm6, %%xmm6\n\t"
+        "vxorpd %%xmm7, %%xmm7, %%xmm7\n\t"
+        "vxorpd %%xmm8, %%xmm8, %%xmm8\n\t"
+        "vxorpd %%xmm9, %%xmm9, %%xmm9\n\t"
+        "1:\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm2\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm3\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm4\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm5\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm6\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm7\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm8\n\t"
+        "vfmadd231pd %%ymm0, %%ymm1, %%ymm9\n\t"
+        "dec %0\n\t"
+        "jnz 1b\n\t"
+        "vzeroupper\n\t"
+        : "+r"(n)
+        :
+        : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "cc");
+    return 11 + INSNS_PER_ITER * iters;
+}
+
+static uint64_t kernel_fma_sse2(uint64_t iters){
+    uint64_t n = iters;
+    __asm__ volatile(
+        "xorpd %%xmm0, %%xmm0\n\t"
+        "xorpd %%xmm1, %%xmm1\n\t"
+        "xorpd %%xmm2, %%xmm2\n\t"
+        "xorpd %%xmm3, %%xmm3\n\t"
+        "xorpd %%xmm4, %%xmm4\n\t"
+        "xorpd %%xmm5, %%xmm5\n\t"
+        "1:\n\t"
+        "mulpd %%xmm0, %%xmm2\n\t"
+        "addpd %%xmm1, %%xmm2\n\t"
+        "mulpd %%xmm0, %%xmm3\n\t"
+        "addpd %%xmm1, %%xmm3\n\t"
+        "mulpd %%xmm0, %%xmm4\n\t"
+        "addpd %%xmm1, %%xmm4\n\t"
+        "mulpd %%xmm0, %%xmm5\n\t"
+        "addpd %%xmm1, %%xmm5\n\t"
+        "dec %0\n\t"
+        "jnz 1b\n\t"
+        : "+r"(n)
+        :
+        : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "cc");
+    return 6 + INSNS_PER_ITER * iters;
+}
+
+static uint64_t kernel_int(uint64_t iters){
+    uint64_t n = iters;
+    __asm__ volatile(
+        "1:\n\t"
+        "add $1, %%r8\n\t"
+        "add $1, %%r9\n\t"
+        "add $1, %%r10\n\t"
+        "add $1, %%r11\n\t"
+        "add $1, %%r8\n\t"
+        "add $1, %%r9\n\t"
+        "add $1, %%r10\n\t"
+        "add $1, %%r11\n\t"
+        "dec %0\n\t"
+        "jnz 1b\n\t"
+        : "+r"(n)
+        :
+        : "r8", "r9", "r10", "r11", "cc");
+    return INSNS_PER_ITER * iters;
+}
+
+// lines: number of 64-byte lines from p (16-byte aligned)
+static uint64_t kernel_stream(const char *p, uint64_t lines){
+    uint64_t n = lines;
+    __asm__ volatile(
+        "xorpd %%xmm0, %%xmm0\n\t"
+        "xorpd %%xmm1, %%xmm1\n\t"
+        "xorpd %%xmm2, %%xmm2\n\t"
+        "xorpd %%xmm3, %%xmm3\n\t"
+        "1:\n\t"
+        "addpd 0(%1), %%xmm0\n\t"
+        "addpd 16(%1), %%xmm1\n\t"
+        "addpd 32(%1), %%xmm2\n\t"
+        "addpd 48(%1), %%xmm3\n\t"
+        "add $64, %1\n\t"
+        "dec %0\n\t"
+        "jnz 1b\n\t"
+        : "+r"(n), "+r"(p)
+        :
+        : "xmm0", "xmm1", "xmm2", "xmm3", "cc", "memory");
+    return 4 + STREAM_INSNS_PER_LINE * lines;
+}
+
+static uint64_t (*kernel_fma)(uint64_t) = kernel_fma_sse2;
+static fma_isa_t fma_isa = FmaAuto;
+
+static char *stream_buf = NULL;
+static size_t stream_slice = 0;     // bytes per thread, a multiple of STREAM_CHUNK
+static size_t stream_mb = DEFAULT_STREAM_MB;
+
+static void select_fma(void){
+    __builtin_cpu_init();
+    if (fma_isa == FmaAuto) {
+        if (__builtin_cpu_supports("avx512f")) fma_isa = FmaAvx512;
+        else if (__builtin_cpu_supports("fma")) fma_isa = FmaAvx2;
+        else fma_isa = FmaSse2;
+    }
+    if ((fma_isa == FmaAvx512 && !__builtin_cpu_supports("avx512f")) ||
+        (fma_isa == FmaAvx2 && !__builtin_cpu_supports("fma"))) {
+        fprintf(stderr, "loadgen: this CPU does not support --fma=%s\n", isa_names[fma_isa]);
+        exit(1);
+    }
+    kernel_fma = fma_isa == FmaAvx512 ? kernel_fma_avx512
+               : fma_isa == FmaAvx2 ? kernel_fma_avx2 : kernel_fma_sse2;
+}
+
+// Buffer split in per-thread slices, first touched by the thread that streams it
+static void alloc_stream(int threads){
+    size_t chunks = (stream_mb << 20) / STREAM_CHUNK / (size_t)threads;
+    if (chunks == 0) chunks = 1;
+    stream_slice = chunks * STREAM_CHUNK;
+    if (posix_memalign((void **)&stream_buf, 64, stream_slice * (size_t)threads) != 0) {
+        fprintf(stderr, "loadgen: cannot allocate %zu MB stream buffer\n",
+                (stream_slice * (size_t)threads) >> 20);
+        exit(1);
+    }
+#pragma omp parallel
+    memset(stream_buf + (size_t)omp_get_thread_num() * stream_slice, 0, stream_slice);
+}
+
+/************************************************************************/
+// Phase execution
+/************************************************************************/
+
+static void sleep_until(uint64_t deadline){
+    uint64_t now;
+    while ((now = nanoclock_now()) < deadline) {
+        uint64_t left = deadline - now;
+        struct timespec ts = { (time_t)(left / NANOCLOCK_NS_PER_SEC), (long)(left % NANOCLOCK_NS_PER_SEC) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Every thread runs the phase kernel in chunks until the common deadline
+static void run_phase(phase_t *ph){
+    uint64_t deadline = nanoclock_now() + (uint64_t)(ph->seconds * 1e9);
+    double expected = 0.0, bytes = 0.0;
+
+#pragma omp parallel reduction(+:expected, bytes)
+    {
+        uint64_t insns = 0;
+        switch (ph->kind) {
+        case PhaseFma:
+            while (nanoclock_now() < deadline) insns += kernel_fma(COMPUTE_CHUNK);
+            break;
+        case PhaseInt:
+            while (nanoclock_now() < deadline) insns += kernel_int(COMPUTE_CHUNK);
+            break;
+        case PhaseStream: {
+            const char *slice = stream_buf + (size_t)omp_get_thread_num() * stream_slice;
+            size_t offset = 0;
+            while (nanoclock_now() < deadline) {
+                insns += kernel_stream(slice + offset, STREAM_CHUNK / 64);
+                bytes += STREAM_CHUNK;
+                offset += STREAM_CHUNK;
+                if (offset == stream_slice) offset = 0;
+            }
+            break;
+        }
+        case PhaseIdle:
+            sleep_until(deadline);
+            break;
+        }
+        expected += (double)insns;
+    }
+    ph->expected = expected;
+    ph->bytes = bytes;
+}
+
+/************************************************************************/
+// Script and phase table I/O
+/************************************************************************/
+
+// "kind:seconds" or "kind seconds"; returns 0 on success
+static int add_phase(const char *spec){
+    char kind[32];
+    double seconds;
+    int k;
+    if (sscanf(spec, " %31[a-z]%*[: \t]%lf", kind, &seconds) != 2) return -1;
+    for (k = 0; k <= PhaseIdle; k++)
+        if (strcmp(kind, kind_names[k]) == 0) break;
+    if (k > PhaseIdle || seconds <= 0.0 || num_phases == MAX_PHASES) return -1;
+    memset(&phases[num_phases], 0, sizeof(phase_t));
+    phases[num_phases].kind = (phase_kind_t)k;
+    phases[num_phases].seconds = seconds;
+    num_phases++;
+    return 0;
+}
+
+static int add_phase_list(const char *list){
+    char buf[MAX_LINE];
+    char *save = NULL, *tok;
+    snprintf(buf, sizeof(buf), "%s", list);
+    for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+        if (add_phase(tok) != 0) {
+            fprintf(stderr, "loadgen: bad phase '%s'\n", tok);
+            return -1;
+        }
+    return 0;
+}
+
+// One phase per line, '#' starts a comment
+static int read_script(const char *path){
+    char line[MAX_LINE];
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (add_phase(line) != 0) {
+            fprintf(stderr, "%s: bad phase '%s'\n", path, line);
+            fclose(in);
+            return -1;
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+static void write_phases(const char *path){
+    int p;
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(out, "phase,kind,script_s,begin_ms,end_ms,first_sample,last_sample,expected_instructions,bytes\n");
+    for (p = 0; p < num_phases; p++)
+        fprintf(out, "%d,%s,%.6f,%.6f,%.6f,%d,%d,%.0f,%.0f\n", p + 1, kind_names[phases[p].kind],
+                phases[p].seconds, phases[p].begin_ms, phases[p].end_ms,
+                phases[p].first_sample, phases[p].last_sample, phases[p].expected, phases[p].bytes);
+    fclose(out);
+}
+
+static int read_phases(const char *path){
+    char line[MAX_LINE], kind[32];
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    num_phases = 0;
+    while (fgets(line, sizeof(line), in) != NULL && num_phases < MAX_PHASES) {
+        phase_t *ph = &phases[num_phases];
+        int id, k;
+        if (sscanf(line, "%d,%31[a-z],%lf,%lf,%lf,%d,%d,%lf,%lf", &id, kind, &ph->seconds,
+                   &ph->begin_ms, &ph->end_ms, &ph->first_sample, &ph->last_sample,
+                   &ph->expected, &ph->bytes) != 9) continue;
+        for (k = 0; k <= PhaseIdle; k++)
+            if (strcmp(kind, kind_names[k]) == 0) break;
+        if (k > PhaseIdle) continue;
+        ph->kind = (phase_kind_t)k;
+        num_phases++;
+    }
+    fclose(in);
+    if (num_phases == 0) fprintf(stderr, "%s: no phases\n", path);
+    return num_phases > 0 ? 0 : -1;
+}
+
+/************************************************************************/
+// Checker: phase table against perflog.txt
+/************************************************************************/
+
+typedef struct {
+    int n;
+    double *t_ms;       // t_ms[k]: end of sample k, t_ms[0] = 0
+    double *inst;
+    double *energy;
+} perflog_t;
+
+static int read_perflog(const char *path, perflog_t *log){
+    char line[MAX_LINE];
+    int cap = 1024;
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    log->n = 0;
+    log->t_ms = malloc((size_t)cap * sizeof(double));
+    log->inst = malloc((size_t)cap * sizeof(double));
+    log->energy = malloc((size_t)cap * sizeof(double));
+    log->t_ms[0] = log->inst[0] = log->energy[0] = 0.0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        int index, cf, uf;
+        double energy, inst, t;
+        if (sscanf(line, "%d %lf %lf %d %d %lf", &index, &energy, &inst, &cf, &uf, &t) != 6) continue;
+        if (index != log->n + 1) continue;     // sample rows are numbered from 1
+        if (index + 1 >= cap) {
+            cap *= 2;
+            log->t_ms = realloc(log->t_ms, (size_t)cap * sizeof(double));
+            log->inst = realloc(log->inst, (size_t)cap * sizeof(double));
+            log->energy = realloc(log->energy, (size_t)cap * sizeof(double));
+        }
+        log->n = index;
+        log->t_ms[index] = t;
+        log->inst[index] = inst;
+        log->energy[index] = energy;
+    }
+    fclose(in);
+    if (log->n == 0) fprintf(stderr, "%s: no samples\n", path);
+    return log->n > 0 ? 0 : -1;
+}
+
+static double overlap(double a0, double a1, double b0, double b1){
+    double lo = a0 > b0 ? a0 : b0, hi = a1 < b1 ? a1 : b1;
+    return hi > lo ? hi - lo : 0.0;
+}
+
+// Rate (instructions/s) and power over the samples wholly inside [b, e]; 0 if none
+static int inner_rate(const perflog_t *log, double b, double e, double *rate, double *power){
+    double inst = 0.0, energy = 0.0, ms = 0.0;
+    int k, count = 0;
+    for (k = 1; k <= log->n; k++) {
+        if (log->t_ms[k-1] < b || log->t_ms[k] > e) continue;
+        inst += log->inst[k];
+        energy += log->energy[k];
+        ms += log->t_ms[k] - log->t_ms[k-1];
+        count++;
+    }
+    *rate = ms > 0.0 ? inst / ms * 1e3 : 0.0;
+    *power = ms > 0.0 ? energy / ms * 1e3 : 0.0;
+    return count;
+}
+
+// Returns the number of phases whose rate error exceeds tolerance (%)
+static int check_phases(const char *perflog_path, double tolerance){
+    perflog_t log;
+    double rate[MAX_PHASES], power[MAX_PHASES];
+    int inner[MAX_PHASES];
+    int p, k, failed = 0;
+
+    if (read_perflog(perflog_path, &log) != 0) return -1;
+
+    printf("\nPer-phase instructions (%d samples in %s):\n", log.n, perflog_path);
+    printf("%-6s %-7s %9s %9s %16s %16s %8s %8s %8s %9s\n", "PHASE", "KIND", "SCRIPT(s)", "RAN(s)",
+           "EXPECTED", "MEASURED", "ERR(%)", "SAMPLES", "RATE(%)", "POWER(W)");
+    for (p = 0; p < num_phases; p++) {
+        phase_t *ph = &phases[p];
+        double measured = 0.0, ran = (ph->end_ms - ph->begin_ms) / 1e3;
+        for (k = 1; k <= log.n; k++) {
+            double dt = log.t_ms[k] - log.t_ms[k-1];
+            if (dt > 0.0) measured += log.inst[k] * overlap(log.t_ms[k-1], log.t_ms[k], ph->begin_ms, ph->end_ms) / dt;
+        }
+        inner[p] = inner_rate(&log, ph->begin_ms, ph->end_ms, &rate[p], &power[p]);
+
+        printf("%-6d %-7s %9.3f %9.3f %16.0f %16.0f ", p + 1, kind_names[ph->kind], ph->seconds, ran,
+               ph->expected, measured);
+        if (ph->kind == PhaseIdle || ph->expected <= 0.0) {
+            printf("%8s %8d %8s ", "-", inner[p], "-");
+        } else {
+            double total_err = (measured / ph->expected - 1.0) * 100.0;
+            printf("%8.2f %8d ", total_err, inner[p]);
+            if (inner[p] > 0) {
+                double rate_err = (rate[p] / (ph->expected / ran) - 1.0) * 100.0;
+                printf("%8.2f ", rate_err);
+                if (fabs(rate_err) > tolerance) failed++;
+            } else {
+                printf("%8s ", "short");
+            }
+        }
+        if (inner[p] > 0) printf("%9.2f\n", power[p]);
+        else printf("%9s\n", "-");
+    }
+
+    // the sample straddling a boundary mixes both rates; its mix gives the boundary position
+    printf("\nPhase boundaries (perflog time axis):\n");
+    printf("%-9s %12s %12s %10s\n", "BOUNDARY", "ACTUAL(ms)", "DETECTED(ms)", "ERROR(ms)");
+    for (p = 0; p + 1 < num_phases; p++) {
+        double t = phases[p].end_ms, lo = rate[p], hi = rate[p+1];
+        printf("%3d->%-5d %12.3f ", p + 1, p + 2, t);
+        for (k = 1; k <= log.n && log.t_ms[k] < t; k++)
+            ;
+        if (k > log.n || inner[p] == 0 || inner[p+1] == 0 ||
+            fabs(hi - lo) < 0.1 * (hi > lo ? hi : lo)) {
+            printf("%12s %10s\n", "-", "-");    // a neighbour is too short, or no rate change
+            continue;
+        }
+        double dt = log.t_ms[k] - log.t_ms[k-1];
+        double f = (log.inst[k] / dt * 1e3 - lo) / (hi - lo);
+        if (f < 0.0) f = 0.0;
+        if (f > 1.0) f = 1.0;
+        double detected = log.t_ms[k] - f * dt;
+        printf("%12.3f %10.3f\n", detected, detected - t);
+    }
+    printf("\nRate tolerance %.1f%%: %s\n", tolerance, failed ? "FAIL" : "PASS");
+
+    free(log.t_ms);
+    free(log.inst);
+    free(log.energy);
+    return failed;
+}
+
+/************************************************************************/
+
+static void usage(const char *prog){
+    fprintf(stderr,
+            "Usage: %s [options] [kind:seconds ...]\n"
+            "       %s --check=phases.csv [--perflog=FILE] [--tolerance=PCT]\n"
+            "Phase kinds: fma, int, stream, idle (default script %s)\n"
+            "  --script=FILE     phases from FILE, one 'kind seconds' per line\n"
+            "  --repeat=N        run the script N times\n"
+            "  --fma=auto|avx512|avx2|sse2\n"
+            "  --stream-mb=MB    stream buffer over all threads (default %d)\n"
+            "  --csv=FILE        phase table (default loadgen_phases.csv)\n"
+            "  --perflog=FILE    profiler log to check (default perflog.txt)\n"
+            "  --tolerance=PCT   allowed per-phase rate error (default %.1f)\n"
+            "  --no-check        run only\n",
+            prog, prog, DEFAULT_SCRIPT, DEFAULT_STREAM_MB, DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char *argv[]){
+    const char *csv = "loadgen_phases.csv", *perflog = "perflog.txt", *check = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    int repeat = 1, run_check = 1, threads, scripted, i, p, r;
+
+    for (i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strncmp(a, "--script=", 9) == 0) {
+            if (read_script(a + 9) != 0) return 1;
+        } else if (strncmp(a, "--repeat=", 9) == 0) {
+            repeat = atoi(a + 9);
+        } else if (strncmp(a, "--fma=", 6) == 0) {
+            for (fma_isa = FmaAuto; fma_isa <= FmaSse2; fma_isa++)
+                if (strcmp(a + 6, isa_names[fma_isa]) == 0) break;
+            if (fma_isa > FmaSse2) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strncmp(a, "--stream-mb=", 12) == 0) {
+            stream_mb = (size_t)atol(a + 12);
+        } else if (strncmp(a, "--csv=", 6) == 0) {
+            csv = a + 6;
+        } else if (strncmp(a, "--perflog=", 10) == 0) {
+            perflog = a + 10;
+        } else if (strncmp(a, "--check=", 8) == 0) {
+            check = a + 8;
+        } else if (strncmp(a, "--tolerance=", 12) == 0) {
+            tolerance = atof(a + 12);
+        } else if (strcmp(a, "--no-check") == 0) {
+            run_check = 0;
+        } else if (a[0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else if (add_phase_list(a) != 0) {
+            return 1;
+        }
+    }
+
+    if (check != NULL) {
+        if (read_phases(check) != 0) return 1;
+        return check_phases(perflog, tolerance) != 0;
+    }
+
+    if (num_phases == 0) add_phase_list(DEFAULT_SCRIPT);
+    if (repeat < 1 || stream_mb < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    scripted = num_phases;
+    for (r = 1; r < repeat; r++)
+        for (p = 0; p < scripted && num_phases < MAX_PHASES; p++)
+            phases[num_phases++] = phases[p];
+
+    select_fma();
+    threads = omp_get_max_threads();
+    for (p = 0; p < num_phases; p++)
+        if (phases[p].kind == PhaseStream) {
+            alloc_stream(threads);
+            break;
+        }
+
+    printf("Threads:          %d\n", threads);
+    printf("FMA kernel:       %s\n", isa_names[fma_isa]);
+    if (stream_buf != NULL) printf("Stream buffer:    %zu MB\n", (stream_slice * (size_t)threads) >> 20);
+    printf("Phases:          ");
+    for (p = 0; p < num_phases; p++) printf(" %s:%g", kind_names[phases[p].kind], phases[p].seconds);
+    printf("\n");
+
+    profiler_start();
+    // phase boundaries are placed on the time axis of the first sample onward
+    for (i = 0; i < 2000 && profiler_sample_index() < 1; i++) usleep(1000);
+    if (profiler_sample_index() < 1) fprintf(stderr, "loadgen: no profiler samples yet, boundaries may be off\n");
+
+    for (p = 0; p < num_phases; p++) {
+        char name[48];
+        snprintf(name, sizeof(name), "%d:%s", p + 1, kind_names[phases[p].kind]);
+        phases[p].first_sample = profiler_sample_index();
+        phases[p].begin_ms = profiler_elapsed_ms();
+        profiler_phase_begin(name);
+        run_phase(&phases[p]);
+        profiler_phase_end();
+        phases[p].end_ms = profiler_elapsed_ms();
+        phases[p].last_sample = profiler_sample_index();
+    }
+
+    profiler_stop();
+    free(stream_buf);
+
+    write_phases(csv);
+    printf("Phase table:      %s\n", csv);
+    if (!run_check) return 0;
+    return check_phases(perflog, tolerance) != 0;
+}
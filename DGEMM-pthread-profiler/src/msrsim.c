@@ -0,0 +1,169 @@
+/**
+ * msrsim: simulated MSR device for testing libprofiler without msr_safe
+ *
+ * Creates one regular file per CPU in DIR (DIR/0, DIR/1, ...) holding MSR n
+ * at offset 8 * n, the layout libprofiler expects of a regular file, then keeps the
+ * counters moving until killed:
+ *   - IA32_MPERF / IA32_APERF advance at the base and at the requested ratio
+ *     (IA32_PERF_CTL bits 15:8) while the host CPUs are busy (/proc/stat);
+ *   - IA32_FIXED_CTR0 advances at a fixed IPC on APERF;
+ *   - MSR_UNCORE_READ follows the uncore max limit (MSR_UNCORE_RATIO_LIMIT);
+ *   - MSR_PKG_ENERGY_STATUS integrates a power model: static power plus a
+ *     per-core term growing with ratio^3 and an uncore term linear in its ratio.
+ * Point the profiler at it with PROFILER_MSR_DEVICE=DIR/%d. Caps written by
+ * profiler_set_frequency_caps() change the simulated power, not the speed of
+ * the real run, so the device checks the plumbing rather than the optimum.
+ *
+ * Usage: msrsim [-t tick_ms] [-s seconds] DIR
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "profiler_internal.h"
+
+#define IA32_MPERF              0xE7
+#define IA32_APERF              0xE8
+#define IA32_PERF_CTL           0x199
+#define IA32_FIXED_CTR0         0x309
+#define MSR_RAPL_POWER_UNIT     0x606
+#define MSR_PKG_ENERGY_STATUS   0x611
+#define MSR_UNCORE_RATIO_LIMIT  0x620
+#define MSR_UNCORE_READ         0x621
+#define MSR_FILE_SIZE           (0x1000 * 8)
+
+#define BASE_RATIO              20          // as BASE_FREQ in profiler.c
+#define MAX_RATIO               30
+#define UNCORE_MIN              12
+#define UNCORE_MAX              24
+#define POWER_UNIT_VALUE        0xA0E03     // energy unit 2^-14 J
+#define ENERGY_UNIT             (1.0 / 16384.0)
+#define STATIC_WATTS            40.0        // per socket
+#define CORE_WATTS_AT_BASE      3.0         // per busy core at BASE_RATIO
+#define UNCORE_WATTS_PER_RATIO  0.8
+#define IPC                     2.0
+
+static int fds[PROFILER_CPUS];
+
+static uint64_t msr_get(int cpu, uint32_t msr){
+    uint64_t v = 0;
+    if (pread(fds[cpu], &v, sizeof(v), (off_t)msr * 8) != (ssize_t)sizeof(v)) v = 0;
+    return v;
+}
+
+static void msr_put(int cpu, uint32_t msr, uint64_t v){
+    if (pwrite(fds[cpu], &v, sizeof(v), (off_t)msr * 8) != (ssize_t)sizeof(v)) perror("msrsim: pwrite");
+}
+
+// Fraction of host CPU time busy since the previous call
+static double host_busy(void){
+    static unsigned long long last_busy = 0, last_total = 0;
+    unsigned long long v[8] = { 0 }, busy, total;
+    double frac = 0.0;
+    FILE *f = fopen("/proc/stat", "r");
+    if (f == NULL) return 1.0;
+    if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8) {
+        fclose(f);
+        return 1.0;
+    }
+    fclose(f);
+    busy = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+    total = busy + v[3] + v[4];
+    if (total > last_total) frac = (double)(busy - last_busy) / (double)(total - last_total);
+    last_busy = busy;
+    last_total = total;
+    return frac;
+}
+
+static int socket_of(int cpu){
+    return cpu / CORESperSOCKET;
+}
+
+int main(int argc, char *argv[]){
+    double tick_ms = 10.0, seconds = 0.0;
+    double energy[SOCKETSperNODE] = { 0 };
+    uint64_t uncore_limit[SOCKETSperNODE];
+    const char *dir;
+    int opt, cpu, s;
+
+    while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+        if (opt == 't') tick_ms = atof(optarg);
+        else if (opt == 's') seconds = atof(optarg);
+        else {
+            fprintf(stderr, "Usage: %s [-t tick_ms] [-s seconds] DIR\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || tick_ms <= 0.0) {
+        fprintf(stderr, "Usage: %s [-t tick_ms] [-s seconds] DIR\n", argv[0]);
+        return 1;
+    }
+    dir = argv[optind];
+    mkdir(dir, 0755);
+
+    for (cpu = 0; cpu < PROFILER_CPUS; cpu++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%d", dir, cpu);
+        fds[cpu] = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fds[cpu] < 0 || ftruncate(fds[cpu], MSR_FILE_SIZE) != 0) {
+            perror(path);
+            return 1;
+        }
+        msr_put(cpu, MSR_RAPL_POWER_UNIT, POWER_UNIT_VALUE);
+        msr_put(cpu, IA32_PERF_CTL, (uint64_t)MAX_RATIO << 8);
+        msr_put(cpu, MSR_UNCORE_RATIO_LIMIT, ((uint64_t)UNCORE_MIN << 8) | UNCORE_MAX);
+        msr_put(cpu, MSR_UNCORE_READ, UNCORE_MAX);
+    }
+    for (s = 0; s < SOCKETSperNODE; s++) uncore_limit[s] = ((uint64_t)UNCORE_MIN << 8) | UNCORE_MAX;
+    printf("PROFILER_MSR_DEVICE=%s/%%d\n", dir);
+    fflush(stdout);
+
+    host_busy();
+    double elapsed = 0.0, dt = tick_ms / 1000.0;
+    struct timespec ts = { (time_t)(tick_ms / 1000.0), (long)(((long)(tick_ms * 1e6)) % 1000000000L) };
+    while (seconds <= 0.0 || elapsed < seconds) {
+        nanosleep(&ts, NULL);
+        elapsed += dt;
+        double busy = host_busy();
+        double watts[SOCKETSperNODE];
+        for (s = 0; s < SOCKETSperNODE; s++) {
+            // socket s is accessed on CPU s (cyclic numbering) or s * CORESperSOCKET (block):
+            // take whichever copy of the limit was written since the last tick, mirror it to both
+            uint64_t a = msr_get(s, MSR_UNCORE_RATIO_LIMIT), b = msr_get(s * CORESperSOCKET, MSR_UNCORE_RATIO_LIMIT);
+            if (a != uncore_limit[s]) uncore_limit[s] = a;
+            else if (b != uncore_limit[s]) uncore_limit[s] = b;
+            double uncore = (double)(uncore_limit[s] & 0x7F);
+            watts[s] = STATIC_WATTS + UNCORE_WATTS_PER_RATIO * uncore;
+            msr_put(s, MSR_UNCORE_RATIO_LIMIT, uncore_limit[s]);
+            msr_put(s * CORESperSOCKET, MSR_UNCORE_RATIO_LIMIT, uncore_limit[s]);
+            msr_put(s, MSR_UNCORE_READ, (uint64_t)uncore);
+            msr_put(s * CORESperSOCKET, MSR_UNCORE_READ, (uint64_t)uncore);
+        }
+        for (cpu = 0; cpu < PROFILER_CPUS; cpu++) {
+            double ratio = (double)((msr_get(cpu, IA32_PERF_CTL) >> 8) & 0xFF);
+            if (ratio > MAX_RATIO) ratio = MAX_RATIO;
+            double mperf = BASE_RATIO * 1e8 * dt * busy;
+            double aperf = ratio * 1e8 * dt * busy;
+            double r = ratio / BASE_RATIO;
+            msr_put(cpu, IA32_MPERF, msr_get(cpu, IA32_MPERF) + (uint64_t)mperf);
+            msr_put(cpu, IA32_APERF, msr_get(cpu, IA32_APERF) + (uint64_t)aperf);
+            msr_put(cpu, IA32_FIXED_CTR0, (msr_get(cpu, IA32_FIXED_CTR0) + (uint64_t)(IPC * aperf)) & ((1ULL << 48) - 1));
+            watts[socket_of(cpu)] += CORE_WATTS_AT_BASE * busy * r * r * r;
+        }
+        for (s = 0; s < SOCKETSperNODE; s++) {
+            energy[s] += watts[s] * dt / ENERGY_UNIT;
+            uint64_t status = (uint64_t)energy[s] & 0xFFFFFFFFULL;
+            msr_put(s, MSR_PKG_ENERGY_STATUS, status);
+            msr_put(s * CORESperSOCKET, MSR_PKG_ENERGY_STATUS, status);
+        }
+    }
+    for (cpu = 0; cpu < PROFILER_CPUS; cpu++) close(fds[cpu]);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * Shared monotonic nanosecond clock, see nanoclock.h
+ **/
+
+#include <pthread.h>
+#include <time.h>
+#include "nanoclock.h"
+
+#if defined(NANOCLOCK_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define NANOCLOCK_HAVE_TSC 1
+#endif
+
+static inline uint64_t nanoclock_raw_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * NANOCLOCK_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef NANOCLOCK_HAVE_TSC
+
+#define NANOCLOCK_CALIBRATION_NS 20000000ULL // 20ms calibration window
+
+static pthread_once_t nanoclock_once = PTHREAD_ONCE_INIT;
+static int nanoclock_tsc_state = 0;     // 1 = TSC, -1 = fallback
+static uint64_t nanoclock_tsc_base;
+static uint64_t nanoclock_ns_base;
+static uint64_t nanoclock_tsc_mult;     // ns per tick in 32.32 fixed point
+
+static void nanoclock_calibrate(void){
+    unsigned int eax, ebx, ecx, edx;
+    // CPUID.80000007H:EDX[8] = invariant TSC
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+        nanoclock_tsc_state = -1;
+        return;
+    }
+    uint64_t ns0 = nanoclock_raw_ns();
+    uint64_t tsc0 = __rdtsc();
+    uint64_t ns1;
+    do {
+        ns1 = nanoclock_raw_ns();
+    } while (ns1 - ns0 < NANOCLOCK_CALIBRATION_NS);
+    uint64_t tsc1 = __rdtsc();
+
+    nanoclock_tsc_mult = (uint64_t)(((unsigned __int128)(ns1 - ns0) << 32) / (tsc1 - tsc0));
+    nanoclock_tsc_base = tsc1;
+    nanoclock_ns_base = ns1;
+    nanoclock_tsc_state = 1;
+}
+
+void nanoclock_init(void){
+    pthread_once(&nanoclock_once, nanoclock_calibrate);
+}
+
+uint64_t nanoclock_now(void){
+    pthread_once(&nanoclock_once, nanoclock_calibrate);
+    if (nanoclock_tsc_state < 0) return nanoclock_raw_ns();
+    uint64_t ticks = __rdtsc() - nanoclock_tsc_base;
+    return nanoclock_ns_base + (uint64_t)(((unsigned __int128)ticks * nanoclock_tsc_mult) >> 32);
+}
+
+#else
+
+void nanoclock_init(void){
+}
+
+uint64_t nanoclock_now(void){
+    return nanoclock_raw_ns();
+}
+
+#endif // NANOCLOCK_HAVE_TSC
@@ -0,0 +1,47 @@
+#ifndef NANOCLOCK_H
+#define NANOCLOCK_H
+
+/**
+ * Monotonic nanosecond clock shared by libprofiler and dgemm.
+ *
+ * Timestamps are kept as integer nanoseconds so long runs do not lose
+ * resolution the way a double holding seconds since boot does. By default the
+ * clock reads CLOCK_MONOTONIC_RAW (not slewed by NTP). Building with
+ * -DNANOCLOCK_TSC switches to RDTSC when CPUID reports an invariant TSC; the
+ * TSC rate is calibrated once against CLOCK_MONOTONIC_RAW and converted with a
+ * 32.32 fixed-point multiplier. The clock state lives in nanoclock.c, compiled
+ * into libprofiler and dgemm; a program linking both uses its own copy for
+ * both, since the executable's definitions take precedence.
+ **/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NANOCLOCK_NS_PER_SEC 1000000000ULL
+
+// Calibrates the TSC once per process (pthread_once), so every file of a
+// program and libprofiler share one base and rate. nanoclock_now() calls it
+// too; main and profiler_start() call it up front so no timed region pays the
+// 20 ms calibration.
+void nanoclock_init(void);
+
+// Nanoseconds on the shared monotonic clock
+uint64_t nanoclock_now(void);
+
+// Convert an integer nanosecond interval to seconds / milliseconds for reporting only
+static inline double nanoclock_to_sec(uint64_t ns){
+    return (double)ns * 1.0e-9;
+}
+
+static inline double nanoclock_to_ms(uint64_t ns){
+    return (double)ns * 1.0e-6;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NANOCLOCK_H
@@ -0,0 +1,311 @@
+// ------------------------------------------------------- //
+// Out-of-core streaming multiply (see ooc.h)
+// ------------------------------------------------------- //
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nanoclock.h"
+#include "ooc.h"
+
+#define OOC_FILL_BYTES  (8 << 20)       // write size when populating the files
+
+static const char* ooc_names[3] = { "dgemm_A.bin", "dgemm_B.bin", "dgemm_C.bin" };
+
+int ooc_tile_size(int N, size_t mem_bytes) {
+        size_t t = 64;
+
+        while((t + 64) * (t + 64) * 6 * sizeof(double) <= mem_bytes) t += 64;
+        return (t < (size_t) N) ? (int) t : N;
+}
+
+static int ooc_fill(int fd, size_t bytes, double value) {
+        double* chunk = (double*) malloc(OOC_FILL_BYTES);
+        size_t off = 0, e;
+
+        if(chunk == NULL) return -1;
+        for(e = 0; e < OOC_FILL_BYTES / sizeof(double); e++) chunk[e] = value;
+
+        while(off < bytes) {
+                const size_t len = (bytes - off < OOC_FILL_BYTES) ? bytes - off : OOC_FILL_BYTES;
+                const ssize_t done = pwrite(fd, chunk, len, (off_t) off);
+                if(done <= 0) {
+                        free(chunk);
+                        return -1;
+                }
+                off += (size_t) done;
+        }
+        free(chunk);
+
+        // start from disk, not from the page cache the fill left behind
+        if(fsync(fd) != 0) return -1;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        return 0;
+}
+
+int ooc_open(ooc_matrices_t* o, const char* dir, int N, int tile, double a, double b, double c) {
+        const size_t bytes = (size_t) N * N * sizeof(double);
+        const double values[3] = { a, b, c };
+        int i;
+
+        memset(o, 0, sizeof(*o));
+        o->N = N;
+        o->tile = tile;
+        for(i = 0; i < 3; i++) o->fd[i] = -1;
+
+        for(i = 0; i < 3; i++) {
+                snprintf(o->path[i], sizeof(o->path[i]), "%s/%s", dir, ooc_names[i]);
+                o->fd[i] = open(o->path[i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if(o->fd[i] < 0 || ftruncate(o->fd[i], (off_t) bytes) != 0 ||
+                        ooc_fill(o->fd[i], bytes, values[i]) != 0) {
+                        fprintf(stderr, "Error: cannot create %s: %s\n", o->path[i], strerror(errno));
+                        ooc_close(o);
+                        return -1;
+                }
+                o->map[i] = (double*) mmap(NULL, bytes, (i == 2) ? PROT_READ | PROT_WRITE : PROT_READ,
+                        MAP_SHARED, o->fd[i], 0);
+                if(o->map[i] == MAP_FAILED) {
+                        o->map[i] = NULL;
+                        fprintf(stderr, "Error: cannot map %s: %s\n", o->path[i], strerror(errno));
+                        ooc_close(o);
+                        return -1;
+                }
+        }
+
+        o->buf = (double*) malloc(sizeof(double) * 6 * (size_t) tile * tile);
+        if(o->buf == NULL) {
+                fprintf(stderr, "Error: unable to allocate the %d x %d tile buffers\n", tile, tile);
+                ooc_close(o);
+                return -1;
+        }
+        return 0;
+}
+
+void ooc_close(ooc_matrices_t* o) {
+        const size_t bytes = (size_t) o->N * o->N * sizeof(double);
+        int i;
+
+        for(i = 0; i < 3; i++) {
+                if(o->map[i] != NULL) munmap(o->map[i], bytes);
+                if(o->fd[i] >= 0) {
+                        close(o->fd[i]);
+                        unlink(o->path[i]);
+                }
+                o->map[i] = NULL;
+                o->fd[i] = -1;
+        }
+        free(o->buf);
+        o->buf = NULL;
+}
+
+double ooc_sum_c(const ooc_matrices_t* o) {
+        const size_t elements = (size_t) o->N * o->N;
+        const double* c = o->map[2];
+        double sum = 0;
+        size_t e;
+
+        #pragma omp parallel for reduction(+:sum)
+        for(e = 0; e < elements; e++) sum += c[e];
+        return sum;
+}
+
+// ------------------------------------------------------- //
+// Tile pipeline
+//
+// Step s multiplies A(I, K) by B(K, J) into C(I, J), K
+// innermost, so tile t = s / nt of C is finished after nt
+// steps. Input slot s % 2 is reused by step s + 2 and C slot
+// t % 2 by tile t + 2; the counters below, guarded by one
+// mutex, say when a slot is free (consumed, written) or
+// filled (loaded, finished).
+// ------------------------------------------------------- //
+typedef struct {
+        ooc_matrices_t* o;
+        int nt;
+        long steps;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        long loaded;            // steps with inputs in place
+        long consumed;          // steps computed
+        long finished;          // C tiles computed
+        long written;           // C tiles stored back
+        uint64_t io_ns;
+        double bytes_read, bytes_written;
+} ooc_run_t;
+
+static double* ooc_slot(const ooc_matrices_t* o, int matrix, long slot) {
+        return o->buf + ((size_t) (slot % 2) * 3 + matrix) * (size_t) o->tile * o->tile;
+}
+
+static int ooc_extent(const ooc_matrices_t* o, int index) {
+        const int rest = o->N - index * o->tile;
+        return (rest < o->tile) ? rest : o->tile;
+}
+
+// Copies the rows x cols tile at (row, col) of a mapping to or from a compact buffer
+static void ooc_copy(const ooc_matrices_t* o, double* map, double* tile, int row, int col,
+        int rows, int cols, int store) {
+
+        int i;
+        for(i = 0; i < rows; i++) {
+                double* m = map + (size_t) (row + i) * o->N + col;
+                if(store) memcpy(m, tile + (size_t) i * cols, sizeof(double) * cols);
+                else memcpy(tile + (size_t) i * cols, m, sizeof(double) * cols);
+        }
+}
+
+static void ooc_willneed(const ooc_matrices_t* o, const double* map, int row, int col, int rows, int cols) {
+        const uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+        int i;
+
+        for(i = 0; i < rows; i++) {
+                const uintptr_t first = (uintptr_t) (map + (size_t) (row + i) * o->N + col);
+                const uintptr_t start = first & ~(page - 1);
+                madvise((void*) start, first + sizeof(double) * cols - start, MADV_WILLNEED);
+        }
+}
+
+// Grid position of step s: C tile (ti, tj), inner index tk
+static void ooc_step(const ooc_run_t* run, long s, int* ti, int* tj, int* tk) {
+        const long t = s / run->nt;
+        *ti = (int) (t / run->nt);
+        *tj = (int) (t % run->nt);
+        *tk = (int) (s % run->nt);
+}
+
+static void ooc_store_tile(ooc_run_t* run, long t) {
+        ooc_matrices_t* o = run->o;
+        const int ti = (int) (t / run->nt), tj = (int) (t % run->nt);
+        const int m = ooc_extent(o, ti), n = ooc_extent(o, tj);
+        const uint64_t begin = nanoclock_now();
+
+        ooc_copy(o, o->map[2], ooc_slot(o, 2, t), ti * o->tile, tj * o->tile, m, n, 1);
+        run->bytes_written += (double) m * n * sizeof(double);
+        run->io_ns += nanoclock_now() - begin;
+}
+
+// Stores finished C tiles until ready holds; called and returns with the lock held
+#define OOC_WAIT_STORING(run, ready)                                            \
+        while(!(ready)) {                                                       \
+                if((run)->written < (run)->finished) {                          \
+                        const long t_ = (run)->written;                         \
+                        pthread_mutex_unlock(&(run)->lock);                     \
+                        ooc_store_tile((run), t_);                              \
+                        pthread_mutex_lock(&(run)->lock);                       \
+                        (run)->written++;                                       \
+                        pthread_cond_broadcast(&(run)->cond);                   \
+                } else {                                                        \
+                        pthread_cond_wait(&(run)->cond, &(run)->lock);          \
+                }                                                               \
+        }
+
+static void* ooc_io_thread(void* arg) {
+        ooc_run_t* run = (ooc_run_t*) arg;
+        ooc_matrices_t* o = run->o;
+        const int T = o->tile;
+        long s;
+
+        for(s = 0; s < run->steps; s++) {
+                int ti, tj, tk;
+                ooc_step(run, s, &ti, &tj, &tk);
+                const long t = s / run->nt;
+                const int m = ooc_extent(o, ti), n = ooc_extent(o, tj), k = ooc_extent(o, tk);
+
+                pthread_mutex_lock(&run->lock);
+                OOC_WAIT_STORING(run, run->consumed >= s - 1 && (tk > 0 || run->written >= t - 1));
+                pthread_mutex_unlock(&run->lock);
+
+                const uint64_t begin = nanoclock_now();
+                ooc_copy(o, o->map[0], ooc_slot(o, 0, s), ti * T, tk * T, m, k, 0);
+                ooc_copy(o, o->map[1], ooc_slot(o, 1, s), tk * T, tj * T, k, n, 0);
+                run->bytes_read += (double) (m + n) * k * sizeof(double);
+                if(tk == 0) {
+                        ooc_copy(o, o->map[2], ooc_slot(o, 2, t), ti * T, tj * T, m, n, 0);
+                        run->bytes_read += (double) m * n * sizeof(double);
+                }
+                run->io_ns += nanoclock_now() - begin;
+
+                pthread_mutex_lock(&run->lock);
+                run->loaded = s + 1;
+                pthread_cond_broadcast(&run->cond);
+                pthread_mutex_unlock(&run->lock);
+
+                // let the kernel read ahead the step after while this one computes
+                if(s + 1 < run->steps) {
+                        ooc_step(run, s + 1, &ti, &tj, &tk);
+                        const int m1 = ooc_extent(o, ti), n1 = ooc_extent(o, tj), k1 = ooc_extent(o, tk);
+                        ooc_willneed(o, o->map[0], ti * T, tk * T, m1, k1);
+                        ooc_willneed(o, o->map[1], tk * T, tj * T, k1, n1);
+                        if(tk == 0) ooc_willneed(o, o->map[2], ti * T, tj * T, m1, n1);
+                }
+        }
+
+        pthread_mutex_lock(&run->lock);
+        OOC_WAIT_STORING(run, run->written == (long) run->nt * run->nt);
+        pthread_mutex_unlock(&run->lock);
+        return NULL;
+}
+
+void ooc_multiply(ooc_matrices_t* o, double alpha, double beta, ooc_kernel_t kernel, ooc_stats_t* stats) {
+        ooc_run_t run;
+        pthread_t io;
+        long s;
+
+        memset(&run, 0, sizeof(run));
+        run.o = o;
+        run.nt = (o->N + o->tile - 1) / o->tile;
+        run.steps = (long) run.nt * run.nt * run.nt;
+        pthread_mutex_init(&run.lock, NULL);
+        pthread_cond_init(&run.cond, NULL);
+
+        const uint64_t start = nanoclock_now();
+        pthread_create(&io, NULL, ooc_io_thread, &run);
+
+        for(s = 0; s < run.steps; s++) {
+                int ti, tj, tk;
+                ooc_step(&run, s, &ti, &tj, &tk);
+
+                const uint64_t wait = nanoclock_now();
+                pthread_mutex_lock(&run.lock);
+                while(run.loaded <= s) pthread_cond_wait(&run.cond, &run.lock);
+                pthread_mutex_unlock(&run.lock);
+                const uint64_t begin = nanoclock_now();
+                stats->stall_ns += begin - wait;
+
+                kernel(ooc_extent(o, ti), ooc_extent(o, tj), ooc_extent(o, tk), alpha,
+                        ooc_slot(o, 0, s), ooc_slot(o, 1, s), (tk == 0) ? beta : 1.0,
+                        ooc_slot(o, 2, s / run.nt));
+                stats->compute_ns += nanoclock_now() - begin;
+
+                pthread_mutex_lock(&run.lock);
+                run.consumed = s + 1;
+                if(tk == run.nt - 1) run.finished++;
+                pthread_cond_broadcast(&run.cond);
+                pthread_mutex_unlock(&run.lock);
+        }
+
+        // the last C tiles and the page cache still have to reach the file
+        const uint64_t drain = nanoclock_now();
+        pthread_join(io, NULL);
+        const uint64_t sync = nanoclock_now();
+        msync(o->map[2], (size_t) o->N * o->N * sizeof(double), MS_SYNC);
+        const uint64_t end = nanoclock_now();
+
+        stats->stall_ns += end - drain;
+        stats->io_ns += run.io_ns + (end - sync);
+        stats->bytes_read += run.bytes_read;
+        stats->bytes_written += run.bytes_written;
+        stats->wall_ns += end - start;
+        stats->steps += run.steps;
+
+        pthread_cond_destroy(&run.cond);
+        pthread_mutex_destroy(&run.lock);
+}
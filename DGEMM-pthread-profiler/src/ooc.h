@@ -0,0 +1,61 @@
+#ifndef OOC_H
+#define OOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ------------------------------------------------------- //
+// Out-of-core streaming multiply for the dgemm benchmark
+//
+// A, B and C are N x N row-major files of doubles mapped
+// with mmap. The multiply walks C in T x T tiles and, for
+// each, the K tiles of A and B; an I/O thread copies the
+// tiles of the next step out of the mappings into one half
+// of a double buffer while the kernel works on the other,
+// hints the step after with madvise(MADV_WILLNEED), and
+// writes finished C tiles back. Only the six T x T buffers
+// are resident, so N is bounded by the disk, not by RAM.
+// ------------------------------------------------------- //
+
+// Multiply of one step on compact tiles (lda = k, ldb = ldc = n)
+typedef void (*ooc_kernel_t)(int m, int n, int k, double alpha, const double* A,
+        const double* B, double beta, double* C);
+
+typedef struct {
+        int N, tile;
+        int fd[3];              // A, B, C
+        double* map[3];
+        char path[3][512];
+        double* buf;            // 2 x (A, B, C) tiles
+} ooc_matrices_t;
+
+typedef struct {
+        double bytes_read;      // tile loads from the mappings
+        double bytes_written;   // C tile stores
+        uint64_t io_ns;         // I/O thread busy (loads, stores, final msync)
+        uint64_t compute_ns;    // kernel calls
+        uint64_t stall_ns;      // kernel waiting for its inputs
+        uint64_t wall_ns;
+        long steps;
+} ooc_stats_t;
+
+// Largest tile (a multiple of 64, at most N) whose six
+// buffers fit in mem_bytes
+int ooc_tile_size(int N, size_t mem_bytes);
+
+// Creates DIR/dgemm_{A,B,C}.bin filled with a, b and c,
+// evicts them from the page cache and maps them. Returns 0
+// on success, -1 with a message on stderr otherwise.
+int ooc_open(ooc_matrices_t* o, const char* dir, int N, int tile, double a, double b, double c);
+
+// C = alpha * A * B + beta * C through the tile pipeline;
+// adds this multiply to stats
+void ooc_multiply(ooc_matrices_t* o, double alpha, double beta, ooc_kernel_t kernel, ooc_stats_t* stats);
+
+// Sum of all elements of C (reads the file back)
+double ooc_sum_c(const ooc_matrices_t* o);
+
+// Unmaps and removes the files
+void ooc_close(ooc_matrices_t* o);
+
+#endif // OOC_H
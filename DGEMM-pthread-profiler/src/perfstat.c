@@ -0,0 +1,486 @@
+/**
+ * perfstat: aggregate many profiler / dgemm runs into summary statistics
+ *
+ * Every file given on the command line is streamed line by line and classified
+ * by its contents, so perflog.txt, finalRes.txt and the captured stdout of dgemm
+ * can be mixed freely:
+ *   - perflog.txt   : per-sample energy, instructions, core and uncore frequency
+ *   - finalRes.txt  : total energy, instructions and time of one run, and its
+ *                     static / dynamic split when an idle baseline was taken
+ *   - dgemm stdout  : "Multiply time" and "GFLOP/s rate" lines
+ *
+ * Per-sample tables are reduced to per-run averages after discarding the warm-up
+ * samples at the top of the log (and the partial sample written by
+ * profiler_stop() at the bottom). Per-run values are then folded into running
+ * statistics, so memory use is bounded regardless of the number of inputs.
+ *
+ * Usage: perfstat [-w window] [-t tolerance] [-a time|phase [-b bins] [-o aligned.csv]] file...
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+#define DEFAULT_INTERVAL_MS     100.0
+#define DEFAULT_WARMUP_WINDOW   5
+#define DEFAULT_TOLERANCE       0.10
+#define DEFAULT_ALIGN_BINS      600
+#define MAX_WARMUP_WINDOW       64
+#define MAX_LINE                1024
+#define MAX_COLUMNS             16
+
+/************************************************************************/
+// Running statistics: Welford mean/variance plus a P^2 median estimate
+/************************************************************************/
+
+typedef struct {
+    uint64_t n;
+    double mean;
+    double m2;
+    double min;
+    double max;
+    // P^2 quantile estimator state (Jain & Chlamtac), p = 0.5
+    double q[5];
+    double pos[5];
+    double want[5];
+} running_stat_t;
+
+static void stat_init(running_stat_t *s){
+    memset(s, 0, sizeof(*s));
+    s->want[0] = 1.0; s->want[1] = 2.0; s->want[2] = 3.0; s->want[3] = 4.0; s->want[4] = 5.0;
+}
+
+static int cmp_double(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double p2_parabolic(running_stat_t *s, int i, double d){
+    return s->q[i] + d / (s->pos[i+1] - s->pos[i-1]) *
+        ((s->pos[i] - s->pos[i-1] + d) * (s->q[i+1] - s->q[i]) / (s->pos[i+1] - s->pos[i]) +
+         (s->pos[i+1] - s->pos[i] - d) * (s->q[i] - s->q[i-1]) / (s->pos[i] - s->pos[i-1]));
+}
+
+static void stat_add(running_stat_t *s, double x){
+    int i, k;
+    s->n++;
+    double delta = x - s->mean;
+    s->mean += delta / (double)s->n;
+    s->m2 += delta * (x - s->mean);
+    if (s->n == 1 || x < s->min) s->min = x;
+    if (s->n == 1 || x > s->max) s->max = x;
+
+    if (s->n <= 5) {
+        s->q[s->n - 1] = x;
+        if (s->n == 5) {
+            qsort(s->q, 5, sizeof(double), cmp_double);
+            for (i = 0; i < 5; i++) s->pos[i] = i + 1;
+        }
+        return;
+    }
+
+    if (x < s->q[0]) { s->q[0] = x; k = 0; }
+    else if (x >= s->q[4]) { s->q[4] = x; k = 3; }
+    else { for (k = 0; k < 3 && x >= s->q[k+1]; k++); }
+
+    for (i = k + 1; i < 5; i++) s->pos[i] += 1.0;
+    s->want[1] += 0.25; s->want[2] += 0.5; s->want[3] += 0.75; s->want[4] += 1.0;
+
+    for (i = 1; i <= 3; i++) {
+        double d = s->want[i] - s->pos[i];
+        if ((d >= 1.0 && s->pos[i+1] - s->pos[i] > 1.0) ||
+            (d <= -1.0 && s->pos[i-1] - s->pos[i] < -1.0)) {
+            d = (d > 0) ? 1.0 : -1.0;
+            double qn = p2_parabolic(s, i, d);
+            if (qn <= s->q[i-1] || qn >= s->q[i+1]) {
+                int j = i + (int)d;
+                qn = s->q[i] + d * (s->q[j] - s->q[i]) / (s->pos[j] - s->pos[i]);
+            }
+            s->q[i] = qn;
+            s->pos[i] += d;
+        }
+    }
+}
+
+static double stat_stddev(const running_stat_t *s){
+    return (s->n > 1) ? sqrt(s->m2 / (double)(s->n - 1)) : 0.0;
+}
+
+static double stat_median(const running_stat_t *s){
+    if (s->n >= 5) return s->q[2];
+    double tmp[5];
+    memcpy(tmp, s->q, sizeof(double) * s->n);
+    qsort(tmp, s->n, sizeof(double), cmp_double);
+    return (s->n % 2) ? tmp[s->n / 2] : 0.5 * (tmp[s->n/2 - 1] + tmp[s->n/2]);
+}
+
+// two-sided 95% Student-t critical values for 1..30 degrees of freedom
+static const double T95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double stat_ci95(const running_stat_t *s){
+    if (s->n < 2) return 0.0;
+    uint64_t df = s->n - 1;
+    double t = (df <= 30) ? T95[df - 1] : 1.960;
+    return t * stat_stddev(s) / sqrt((double)s->n);
+}
+
+/************************************************************************/
+// Aggregated metrics
+/************************************************************************/
+
+enum {
+    M_ENERGY = 0,       // finalRes: total package energy (J)
+    M_TIME,             // finalRes: profiled time (s)
+    M_AVG_POWER,        // finalRes: energy / time (W)
+    M_INSTRUCTIONS,     // finalRes: total instructions retired
+    M_STATIC_ENERGY,    // finalRes: idle power x time (J)
+    M_DYNAMIC_ENERGY,   // finalRes: package energy above the idle baseline (J)
+    M_MULTIPLY_TIME,    // dgemm: multiply time (s)
+    M_GFLOPS,           // dgemm: GFLOP/s rate
+    M_STEADY_POWER,     // perflog: mean package power over steady-state samples (W)
+    M_STEADY_IPS,       // perflog: mean instruction rate over steady-state samples (G/s)
+    M_STEADY_CORE_FREQ, // perflog: mean core frequency over steady-state samples
+    M_STEADY_UNC_FREQ,  // perflog: mean uncore frequency over steady-state samples
+    M_WARMUP_SAMPLES,   // perflog: samples discarded as warm-up
+    NUM_METRICS
+};
+
+static const char *METRIC_NAMES[NUM_METRICS] = {
+    "energy_J", "time_s", "avg_power_W", "instructions",
+    "static_energy_J", "dynamic_energy_J",
+    "multiply_time_s", "gflops",
+    "steady_power_W", "steady_ginst_per_s", "steady_core_freq", "steady_uncore_freq",
+    "warmup_samples"
+};
+
+static running_stat_t metrics[NUM_METRICS];
+
+// per-sample series aligned across runs
+enum { S_POWER = 0, S_IPS, S_CORE_FREQ, S_UNC_FREQ, NUM_SERIES };
+
+static const char *SERIES_NAMES[NUM_SERIES] = { "power_W", "ginst_per_s", "core_freq", "uncore_freq" };
+
+typedef struct { uint64_t n; double mean; double m2; } align_stat_t;
+
+static align_stat_t *aligned = NULL;    // bins * NUM_SERIES
+static int align_bins = DEFAULT_ALIGN_BINS;
+static int align_mode = 0;              // 0 = off, 1 = time, 2 = phase
+static double align_bin_ms = DEFAULT_INTERVAL_MS;
+static uint64_t align_overflow = 0;
+
+static void align_add(int bin, const double *values){
+    if (bin < 0) return;
+    if (bin >= align_bins) { align_overflow++; return; }
+    for (int s = 0; s < NUM_SERIES; s++) {
+        align_stat_t *a = &aligned[bin * NUM_SERIES + s];
+        a->n++;
+        double delta = values[s] - a->mean;
+        a->mean += delta / (double)a->n;
+        a->m2 += delta * (values[s] - a->mean);
+    }
+}
+
+/************************************************************************/
+// perflog parsing with steady-state (warm-up) detection
+/************************************************************************/
+
+static int warmup_window = DEFAULT_WARMUP_WINDOW;
+static double tolerance = DEFAULT_TOLERANCE;
+
+typedef struct {
+    double values[NUM_SERIES];
+    double t_ms;                        // sample end time relative to the first sample
+} sample_t;
+
+typedef struct {
+    int col[NUM_SERIES];                // column index of each series, -1 if absent
+    int col_time;                       // TIME(ms) column if the log carries timestamps
+    double interval_ms;
+
+    // samples still waiting for the steady-state decision / the trailing sample check
+    sample_t pending[MAX_WARMUP_WINDOW + 1];
+    int npending;
+    int steady;
+    int warmup;
+    int index;
+    int steady_index;
+
+    double sum[NUM_SERIES];
+    uint64_t nsteady;
+} perflog_state_t;
+
+static void perflog_reset(perflog_state_t *p){
+    memset(p, 0, sizeof(*p));
+    for (int s = 0; s < NUM_SERIES; s++) p->col[s] = -1;
+    p->col_time = -1;
+    p->interval_ms = DEFAULT_INTERVAL_MS;
+}
+
+static void perflog_accept(perflog_state_t *p, const sample_t *smp){
+    for (int s = 0; s < NUM_SERIES; s++) p->sum[s] += smp->values[s];
+    p->nsteady++;
+    if (align_mode == 2) align_add(p->steady_index, smp->values);
+    p->steady_index++;
+}
+
+// Warm-up ends at the first sample whose power is within the tolerance of the mean
+// of the following window; everything before it is discarded.
+static void perflog_settle(perflog_state_t *p, int final){
+    while (!p->steady && (p->npending > warmup_window || (final && p->npending > 0))) {
+        double mean = 0.0;
+        int n = p->npending;
+        for (int i = 0; i < n; i++) mean += p->pending[i].values[S_POWER];
+        mean /= n;
+        if (p->pending[0].values[S_POWER] >= (1.0 - tolerance) * mean) {
+            p->steady = 1;
+            break;
+        }
+        p->warmup++;
+        memmove(&p->pending[0], &p->pending[1], sizeof(sample_t) * (n - 1));
+        p->npending--;
+    }
+    if (!p->steady) return;
+
+    // keep one sample back: the last reading of a run only covers a partial interval
+    int keep = final ? 0 : 1;
+    int i;
+    for (i = 0; i < p->npending - keep; i++) perflog_accept(p, &p->pending[i]);
+    memmove(&p->pending[0], &p->pending[i], sizeof(sample_t) * (p->npending - i));
+    p->npending -= i;
+}
+
+static void perflog_sample(perflog_state_t *p, char **tok, int ntok){
+    sample_t smp;
+    double interval_s = p->interval_ms / 1000.0;
+    for (int s = 0; s < NUM_SERIES; s++) {
+        smp.values[s] = (p->col[s] >= 0 && p->col[s] < ntok) ? atof(tok[p->col[s]]) : 0.0;
+    }
+    smp.values[S_POWER] /= interval_s;
+    smp.values[S_IPS] /= interval_s * 1.0e9;
+    smp.t_ms = (p->col_time >= 0 && p->col_time < ntok) ? atof(tok[p->col_time]) : p->index * p->interval_ms;
+    p->index++;
+    // time alignment keeps the whole timeline, warm-up included
+    if (align_mode == 1) align_add((int)(smp.t_ms / align_bin_ms), smp.values);
+    p->pending[p->npending++] = smp;
+    perflog_settle(p, 0);
+}
+
+static void perflog_finish(perflog_state_t *p){
+    if (p->npending > 0) {
+        // drop the trailing partial sample when it is clearly below steady power
+        if (p->steady && p->nsteady > 0) {
+            sample_t *last = &p->pending[p->npending - 1];
+            if (last->values[S_POWER] < (1.0 - tolerance) * (p->sum[S_POWER] / p->nsteady)) p->npending--;
+        }
+        perflog_settle(p, 1);
+    }
+    if (p->nsteady == 0) return;
+    stat_add(&metrics[M_STEADY_POWER], p->sum[S_POWER] / p->nsteady);
+    stat_add(&metrics[M_STEADY_IPS], p->sum[S_IPS] / p->nsteady);
+    stat_add(&metrics[M_STEADY_CORE_FREQ], p->sum[S_CORE_FREQ] / p->nsteady);
+    stat_add(&metrics[M_STEADY_UNC_FREQ], p->sum[S_UNC_FREQ] / p->nsteady);
+    stat_add(&metrics[M_WARMUP_SAMPLES], (double)p->warmup);
+}
+
+static int split_tabs(char *line, char **tok){
+    int n = 0;
+    for (char *t = strtok(line, "\t\r\n"); t != NULL && n < MAX_COLUMNS; t = strtok(NULL, "\t\r\n")) {
+        tok[n++] = t;
+    }
+    return n;
+}
+
+static void perflog_header(perflog_state_t *p, char **tok, int ntok){
+    for (int i = 0; i < ntok; i++) {
+        if (strcmp(tok[i], "PWR_PKG_ENERGY") == 0) p->col[S_POWER] = i;
+        else if (strcmp(tok[i], "INST_RETIRED") == 0) p->col[S_IPS] = i;
+        else if (strcmp(tok[i], "CORE FREQ") == 0) p->col[S_CORE_FREQ] = i;
+        else if (strcmp(tok[i], "UNCORE FREQ") == 0) p->col[S_UNC_FREQ] = i;
+        else if (strcmp(tok[i], "TIME(ms)") == 0) p->col_time = i;
+    }
+}
+
+/************************************************************************/
+// Input files
+/************************************************************************/
+
+enum { IN_NONE = 0, IN_PERFLOG, IN_FINALRES, IN_BREAKDOWN };
+
+static int process_file(const char *path){
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char line[MAX_LINE];
+    char *tok[MAX_COLUMNS];
+    int section = IN_NONE;
+    perflog_state_t p;
+    perflog_reset(&p);
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        double v;
+        if (sscanf(line, " === DURATION BETWEEN EACH READING :: %lfms", &v) == 1) {
+            p.interval_ms = v;
+            continue;
+        }
+        if (sscanf(line, "Multiply time: %lf", &v) == 1) {
+            stat_add(&metrics[M_MULTIPLY_TIME], v);
+            continue;
+        }
+        if (sscanf(line, "GFLOP/s rate: %lf", &v) == 1) {
+            stat_add(&metrics[M_GFLOPS], v);
+            continue;
+        }
+        if (strncmp(line, "S.NO\t", 5) == 0) {
+            int ntok = split_tabs(line, tok);
+            perflog_header(&p, tok, ntok);
+            section = IN_PERFLOG;
+            continue;
+        }
+        if (strncmp(line, "PWR_PKG_ENERGY\t", 15) == 0) {
+            section = IN_FINALRES;
+            continue;
+        }
+        if (strncmp(line, "SOCKET\tIDLE_POWER(W)\t", 21) == 0) {
+            section = IN_BREAKDOWN;
+            continue;
+        }
+        if (line[0] == '=') {
+            if (section == IN_PERFLOG) perflog_finish(&p);
+            section = IN_NONE;
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        int ntok = split_tabs(line, tok);
+        if (section == IN_PERFLOG && ntok >= 2) {
+            perflog_sample(&p, tok, ntok);
+        } else if (section == IN_FINALRES && ntok >= 4) {
+            double energy = atof(tok[0]);
+            double time_s = atof(tok[3]) / 1000.0;
+            stat_add(&metrics[M_ENERGY], energy);
+            stat_add(&metrics[M_INSTRUCTIONS], atof(tok[1]));
+            stat_add(&metrics[M_TIME], time_s);
+            if (time_s > 0.0) stat_add(&metrics[M_AVG_POWER], energy / time_s);
+            section = IN_NONE;
+        } else if (section == IN_BREAKDOWN && ntok >= 5 && strcmp(tok[0], "NODE") == 0) {
+            stat_add(&metrics[M_STATIC_ENERGY], atof(tok[3]));
+            stat_add(&metrics[M_DYNAMIC_ENERGY], atof(tok[4]));
+        }
+    }
+    // truncated log without the closing rule
+    if (section == IN_PERFLOG) perflog_finish(&p);
+
+    fclose(fp);
+    return 0;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr,
+        "Usage: %s [options] file...\n"
+        "  -w N          warm-up detection window in samples (default %d, max %d)\n"
+        "  -t F          steady-state tolerance as a fraction of window power (default %.2f)\n"
+        "  -a time|phase align per-sample series by elapsed time or by steady-state onset\n"
+        "  -b N          number of alignment bins (default %d)\n"
+        "  -o FILE       write the aligned series of -a as CSV to FILE (default stdout)\n"
+        "  -             read the list of input files from stdin, one per line\n",
+        prog, DEFAULT_WARMUP_WINDOW, MAX_WARMUP_WINDOW, DEFAULT_TOLERANCE, DEFAULT_ALIGN_BINS);
+}
+
+int main(int argc, char *argv[]){
+    const char *aligned_path = NULL;
+    int nfiles = 0;
+    int i;
+
+    for (i = 0; i < NUM_METRICS; i++) stat_init(&metrics[i]);
+
+    // options first, then files
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (i + 1 >= argc) { usage(argv[0]); return 1; }
+        const char *val = argv[++i];
+        switch (argv[i-1][1]) {
+            case 'w': warmup_window = atoi(val); break;
+            case 't': tolerance = atof(val); break;
+            case 'b': align_bins = atoi(val); break;
+            case 'o': aligned_path = val; break;
+            case 'a':
+                if (strcmp(val, "time") == 0) align_mode = 1;
+                else if (strcmp(val, "phase") == 0) align_mode = 2;
+                else { usage(argv[0]); return 1; }
+                break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (i >= argc || warmup_window < 1 || warmup_window > MAX_WARMUP_WINDOW || align_bins < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (aligned_path != NULL && !align_mode) {
+        fprintf(stderr, "%s: -o writes the aligned series and needs -a time|phase\n", argv[0]);
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (align_mode) {
+        aligned = (align_stat_t *) calloc((size_t)align_bins * NUM_SERIES, sizeof(align_stat_t));
+        if (aligned == NULL) {
+            perror("calloc");
+            return 1;
+        }
+    }
+
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-") == 0) {
+            char path[MAX_LINE];
+            while (fgets(path, sizeof(path), stdin) != NULL) {
+                path[strcspn(path, "\r\n")] = '\0';
+                if (path[0] != '\0' && process_file(path) == 0) nfiles++;
+            }
+        } else if (process_file(argv[i]) == 0) {
+            nfiles++;
+        }
+    }
+
+    printf("# files processed: %d\n", nfiles);
+    printf("%-20s %8s %16s %16s %16s %16s %16s %16s\n",
+        "metric", "n", "mean", "median", "stddev", "ci95", "min", "max");
+    for (i = 0; i < NUM_METRICS; i++) {
+        const running_stat_t *s = &metrics[i];
+        if (s->n == 0) continue;
+        printf("%-20s %8" PRIu64 " %16.6f %16.6f %16.6f %16.6f %16.6f %16.6f\n",
+            METRIC_NAMES[i], s->n, s->mean, stat_median(s), stat_stddev(s), stat_ci95(s), s->min, s->max);
+    }
+
+    if (align_mode) {
+        FILE *out = stdout;
+        if (aligned_path != NULL && (out = fopen(aligned_path, "w")) == NULL) {
+            perror(aligned_path);
+            return 1;
+        }
+        fprintf(out, "%s", align_mode == 1 ? "time_ms" : "steady_sample");
+        for (int s = 0; s < NUM_SERIES; s++) fprintf(out, ",%s_n,%s_mean,%s_stddev", SERIES_NAMES[s], SERIES_NAMES[s], SERIES_NAMES[s]);
+        fprintf(out, "\n");
+        for (int b = 0; b < align_bins; b++) {
+            if (aligned[b * NUM_SERIES].n == 0) continue;
+            if (align_mode == 1) fprintf(out, "%f", b * align_bin_ms);
+            else fprintf(out, "%d", b);
+            for (int s = 0; s < NUM_SERIES; s++) {
+                const align_stat_t *a = &aligned[b * NUM_SERIES + s];
+                fprintf(out, ",%" PRIu64 ",%f,%f", a->n, a->mean, a->n > 1 ? sqrt(a->m2 / (double)(a->n - 1)) : 0.0);
+            }
+            fprintf(out, "\n");
+        }
+        if (align_overflow > 0) fprintf(stderr, "perfstat: %" PRIu64 " samples beyond the last alignment bin were not aligned\n", align_overflow);
+        if (out != stdout) fclose(out);
+        free(aligned);
+    }
+    return 0;
+}
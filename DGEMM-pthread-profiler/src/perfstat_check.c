@@ -0,0 +1,86 @@
+/**
+ * perfstat_check: checks of the running statistics in perfstat (make check)
+ *
+ * perfstat.c is included with its main() renamed, so the static Welford and
+ * P^2 code is exercised as built. Each sequence has a closed-form mean,
+ * variance and median:
+ *   - 1e9 + {4, 7, 13, 16}: mean 1e9 + 10, sample variance 30. A one-pass
+ *     sum-of-squares loses every digit here; Welford's update must not.
+ *   - {3, 1, 2} and {4, 1, 3, 2}: fewer than five samples, so the median is
+ *     exact (2 and 2.5).
+ *   - a permutation of 1..1001: mean and median 501, sample variance
+ *     1001 * 1002 / 12. P^2 only estimates the median; it must land within
+ *     P2_TOLERANCE of the range.
+ *
+ * Reports every failing check and exits non-zero if there was one.
+ **/
+
+#define main perfstat_main
+#include "perfstat.c"
+#undef main
+
+#define REL_TOLERANCE   1e-12
+#define P2_TOLERANCE    0.01
+#define PERM_N          1001
+#define PERM_STEP       389     // coprime to 1001, so i * 389 mod 1001 is a permutation
+
+static int failures = 0;
+static int checks = 0;
+
+static void expect(const char *what, double got, double want, double tol){
+    checks++;
+    if (fabs(got - want) > tol) {
+        failures++;
+        printf("FAIL %-28s got %.17g want %.17g (tolerance %g)\n", what, got, want, tol);
+    }
+}
+
+static void check_welford(void){
+    const double x[4] = {4.0, 7.0, 13.0, 16.0};
+    running_stat_t s;
+    int i;
+    stat_init(&s);
+    for (i = 0; i < 4; i++) stat_add(&s, 1e9 + x[i]);
+    expect("offset mean", s.mean, 1e9 + 10.0, 1e9 * REL_TOLERANCE);
+    expect("offset variance", stat_stddev(&s) * stat_stddev(&s), 30.0, 30.0 * 1e-6);
+    expect("offset min", s.min, 1e9 + 4.0, 0.0);
+    expect("offset max", s.max, 1e9 + 16.0, 0.0);
+    expect("offset ci95", stat_ci95(&s), T95[2] * sqrt(30.0) / 2.0, 1e-6);
+}
+
+static void check_small_median(void){
+    const double odd[3] = {3.0, 1.0, 2.0};
+    const double even[4] = {4.0, 1.0, 3.0, 2.0};
+    running_stat_t s;
+    int i;
+    stat_init(&s);
+    for (i = 0; i < 3; i++) stat_add(&s, odd[i]);
+    expect("median of 3", stat_median(&s), 2.0, 0.0);
+    stat_init(&s);
+    for (i = 0; i < 4; i++) stat_add(&s, even[i]);
+    expect("median of 4", stat_median(&s), 2.5, 0.0);
+    stat_init(&s);
+    stat_add(&s, 7.0);
+    expect("median of 1", stat_median(&s), 7.0, 0.0);
+    expect("stddev of 1", stat_stddev(&s), 0.0, 0.0);
+}
+
+static void check_p2_median(void){
+    running_stat_t s;
+    int i;
+    stat_init(&s);
+    for (i = 0; i < PERM_N; i++) stat_add(&s, (double)((i * PERM_STEP) % PERM_N + 1));
+    expect("permutation mean", s.mean, 501.0, 501.0 * REL_TOLERANCE);
+    expect("permutation variance", s.m2 / (double)(s.n - 1), PERM_N * (PERM_N + 1) / 12.0,
+           PERM_N * (PERM_N + 1) / 12.0 * REL_TOLERANCE);
+    expect("permutation P2 median", stat_median(&s), 501.0, P2_TOLERANCE * (PERM_N - 1));
+}
+
+int main(void){
+    check_welford();
+    check_small_median();
+    check_p2_median();
+
+    printf("perfstat_check: %d checks, %d failed\n", checks, failures);
+    return failures > 0;
+}
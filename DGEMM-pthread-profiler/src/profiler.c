@@ -18,65 +18,44 @@
 #include <fcntl.h>
 #include <errno.h>
 #include<time.h>
+#include <string.h>
 #include <pthread.h>
-/* Haswell Power MSR register addresses  (change according to your machine) */
-// register value for different scope
-#define IA32_PERF_GLOBAL_CTRL_VALUE 0x10000000F // bit {0-3} tells us the number of PMC registers in use (i'th bit implies that PMC[i] is active)
-#define IA32_FIXED_CTR_CTRL_VALUE 0x2 // Control register for Fixed Counter
-// Fixed CTRL register
-#define IA32_FIXED_CTR_CTRL             0x38D // Controls for fixed ctr0, 1, and 2
-#define IA32_PERF_GLOBAL_CTRL           0x38F // Enables for fixed ctr0,1,and2 here
-#define IA32_FIXED_CTR0                 0x309 // (R/W) Counts Instr_Retired.Any
-/* RAPL defines */
-#define MSR_RAPL_POWER_UNIT             0x606
-#define MSR_PKG_ENERGY_STATUS           0x611
-
+#include "profiler_internal.h"
+#include "nanoclock.h"
+#include "steady.h"
+#include "ipsample.h"
+#include "trace.h"
+#include "idle.h"
 
 /*CORE Frequency*/
-#define IA32_MPERF                      0xE7
-#define IA32_APERF                      0xE8
 #define BASE_FREQ                       20 // for orca machine
-/* Uncore Frequency*/
-#define MSR_UNCORE_FREQ                 0x620
-#define MSR_UNCORE_READ                 0x621
-
-/************************************************************************/
-// Machine configuration  (change according to your machine)
-#define CORESperSOCKET 24
-#define SOCKETSperNODE 2
-#define NNODES 1
-/************************************************************************/
 
 
 int64_t numOfNodes = -1;
 int64_t numOfSockets = -1;
 int64_t numOfCores = -1;
 
-uint64_t *energyWrap;
-uint64_t *energySave;
-
-
-static int isBlockTopology = 0; //Assuming non-block (cyclic etc.) topology for the system by default
-
 uint64_t TOTAL_PWR_PKG_ENERGY[SOCKETSperNODE];
 uint64_t LAST_PWR_PKG_ENERGY[SOCKETSperNODE];
-uint64_t PWR_PKG_ENERGY_Core[SOCKETSperNODE];
 
 uint64_t TOTAL_INST_RETIRED[SOCKETSperNODE * CORESperSOCKET];
 uint64_t LAST_INST_RETIRED[SOCKETSperNODE * CORESperSOCKET];
-uint64_t INST_RETIRED_CORE[SOCKETSperNODE * CORESperSOCKET];
 
 //////////////////////////////////////////////////
 uint64_t LAST_APERF[SOCKETSperNODE * CORESperSOCKET];
-uint64_t APERF[SOCKETSperNODE * CORESperSOCKET];
 uint64_t LAST_MPERF[SOCKETSperNODE * CORESperSOCKET];
-uint64_t MPERF[SOCKETSperNODE * CORESperSOCKET];
+
+uint64_t TOTAL_APERF[SOCKETSperNODE * CORESperSOCKET];
+uint64_t TOTAL_MPERF[SOCKETSperNODE * CORESperSOCKET];
 
 uint64_t LAST_UNCORE[SOCKETSperNODE];
-uint64_t LAST_UNCORE_DELTA[SOCKETSperNODE];
 //////////////////////////////////////////////////
 
-uint64_t POWER_UNIT = 0;
+// counter deltas of the current sample, read by the MSR core (profiler_core.cpp)
+static profiler_counters_t counters;
+// time spent reading the counters per sample
+static uint64_t read_ns_total = 0, read_ns_max = 0, read_count = 0;
+
 double JOULE_UNIT = 0.0;  // convert energy counter in JOULE
 
 
@@ -86,222 +65,108 @@ static pthread_t profiler_thread_id;
 static FILE* perflog_fd =NULL;
 static FILE* current_res_fd = NULL;
 
-static double start_def_global;
-static double end_def_global;
+static uint64_t start_def_global; // ns
+static uint64_t end_def_global;   // ns
 
 static volatile int perflog_counter = 0;
-
-void timer_func(double *timer){
-  struct timespec currentTime;
-  clock_gettime(CLOCK_MONOTONIC, &currentTime);
-  *timer = (currentTime.tv_sec + (currentTime.tv_nsec * 10e-10));
-}
-
-uint64_t readMSR(uint32_t core , uint32_t name){
-    int fd = -1;
-    char filename[256];
-    sprintf(filename, "/dev/cpu/%d/msr_safe", core);
-    fd = open(filename, O_RDONLY);
-    if(fd < 0){
-        fprintf (stderr, "\n%s : open failed", filename);
-        return -1;
-    }
-    uint64_t data;
-    if (pread(fd, &data, sizeof(data), name) != sizeof(data)) {
-        perror("rdmsr:pread");
-        exit(127);
-    }
-    close(fd);
-    return data;
+static uint64_t last_sample_global;
+
+// OpenMP thread -> CPU map handed over by the application (profiler_set_thread_map).
+// When set, the core frequency averages only the mapped cores; otherwise cores
+// busy less than PROFILER_IDLE_BUSY of a sample (MPERF vs. reference cycles) are
+// left out as idle.
+#define MAX_THREAD_MAP (SOCKETSperNODE * CORESperSOCKET * 4)
+static int thread_map[MAX_THREAD_MAP];
+static int thread_map_count = 0;
+static char core_mapped[SOCKETSperNODE * CORESperSOCKET];
+static double idle_busy = 0.05;
+
+// steady-state / throttling detection (see steady.h)
+static steady_detector_t steady_detector;
+static int steady_only = 0; // PROFILER_STEADY_ONLY: report totals over steady-state windows only
+
+// idle package power baseline (see idle.h): static energy = idle power x time,
+// dynamic energy = package energy - static energy
+static idle_baseline_t idle_baseline;
+static double idle_watts = 0.0; // node idle power (W), 0 without a baseline
+
+int profiler_env_int(const char *name, int def){
+  const char *val = getenv(name);
+  return (val != NULL && *val != '\0') ? atoi(val) : def;
 }
 
-int writeMSR(int cpu, uint32_t reg, uint64_t data)
-{
-  int fd;
-  char msr_file_name[64];
-
-  sprintf(msr_file_name, "/dev/cpu/%d/msr_safe", cpu);
-  fd = open(msr_file_name, O_WRONLY);
-  if (fd < 0) {
-    if (errno == ENXIO) {
-      fprintf(stderr, "wrmsr: No CPU %d\n", cpu);
-      exit(2);
-    } else if (errno == EIO) {
-      fprintf(stderr, "wrmsr: CPU %d doesn't support MSRs\n",
-        cpu);
-      exit(3);
-    } else {
-      perror("wrmsr@: open");
-      exit(127);
-    }
-  }
-
-    if (pwrite(fd, &data, sizeof data, reg) != sizeof data) {
-        if (errno == EIO) {
-            fprintf(stderr,
-                "wrmsr: CPU %d cannot set MSR "
-                "0x%08" PRIx32 " to 0x%016" PRIx64 "\n",
-                cpu, reg, data);
-            return(4);
-        } else {
-            perror("wrmsr: pwrite");
-            return(127);
-        }
-    }
-
-  close(fd);
-
-  return(0);
-}
-
-
-
-/* Function returns the physical package id (socket number) given a cpu */
-int get_physical_package_id (int cpu)
-{
-  char path[256];
-  FILE *fileP;
-  int physicalPackageId;
-
-  sprintf (path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
-
-  fileP = fopen (path, "r");
-  if (!fileP)
-  {
-    fprintf (stderr, "\n%s : open failed", path);
-    return -1;
-  }
-
-  if (fscanf (fileP, "%d", &physicalPackageId) != 1)
-  {
-    fprintf (stderr, "\n%s: failed to parse from file", path);
-    return -1;
-  }
-
-  fclose(fileP);
-  return physicalPackageId;
+double profiler_env_double(const char *name, double def){
+  const char *val = getenv(name);
+  return (val != NULL && *val != '\0') ? atof(val) : def;
 }
 
-
 void perfcounters_dump();
-void perfcounters_read();
+void perfcounters_read(profiler_sample_t *sample);
 
 void perfcounters_init(){
 
-    int sock;
     //Store local copies of the socket and core counts -- check for previous intialization
     if (numOfNodes == -1) numOfNodes = NNODES;
     if (numOfSockets == -1) numOfSockets = SOCKETSperNODE;
     if (numOfCores == -1) numOfCores = CORESperSOCKET;
 
-    energyWrap = (uint64_t *) malloc (sizeof (uint64_t) * numOfSockets);
-    energySave = (uint64_t *) malloc (sizeof (uint64_t) * numOfSockets);
-
-        for (int core = 0; core < numOfCores * numOfSockets; core++)
-        {
-                // set Global Counter to read instruction at user level only
-            writeMSR (core, IA32_PERF_GLOBAL_CTRL, IA32_PERF_GLOBAL_CTRL_VALUE);
-        writeMSR (core, IA32_FIXED_CTR_CTRL, IA32_FIXED_CTR_CTRL_VALUE);
-        }
-
+    // opens the MSR devices and programs the fixed counter to count user-level instructions
+    if (profiler_core_open() != 0) {
+        fprintf(stderr, "ERROR: cannot open the MSR devices\n");
+        exit(127);
+    }
 }
 void perfcounters_start(){
-    //compute power unit
-    int correctedCoreNumber;
     int sock;
-    POWER_UNIT = readMSR(0, MSR_RAPL_POWER_UNIT); // calculate once
-    JOULE_UNIT = 1.0 / (1 << ((POWER_UNIT >> 8) & 0x1F));
+    JOULE_UNIT = profiler_core_joule_unit();
+    profiler_core_read(&counters);  // baseline
 
     for (sock = 0; sock < numOfSockets; sock++)
     {
-                energyWrap[sock] = 0;
-        energySave[sock] = 0;
-        PWR_PKG_ENERGY_Core[sock] = 0;
         LAST_PWR_PKG_ENERGY[sock] = 0;
         TOTAL_PWR_PKG_ENERGY[sock] = 0;
-
-        //
-
-        //
-        //Discover the topology of the system using the physical id and assign correct cores to sockets
-        if (sock == get_physical_package_id(sock))
-        {
-            correctedCoreNumber = sock;
-        }
-        else
-        {
-            correctedCoreNumber = sock * numOfCores;
-            isBlockTopology = 1;
-        }
-        uint64_t energyStatus = readMSR(correctedCoreNumber, MSR_PKG_ENERGY_STATUS); // get energy MSR
-
-        uint64_t energyCounter = energyStatus & 0xffffffff; // only 32 of 64 bits good
-        if (energyCounter < energySave[sock])
-        {
-            // did I just wrap the counter?
-            energyWrap[sock]++;
-        }
-        energySave[sock] = energyCounter;
-        energyCounter = energyCounter + (energyWrap[sock]<<32);// number of wraps in upper 32 bits
-        PWR_PKG_ENERGY_Core[sock] = energyCounter;
     }
         for (int core=0; core<numOfCores * numOfSockets; core++)
         {
-                INST_RETIRED_CORE[core]=0;
                 LAST_INST_RETIRED[core]=0;
                 TOTAL_INST_RETIRED[core]=0;
-                INST_RETIRED_CORE[core] = readMSR (core, IA32_FIXED_CTR0);
 
                 /////////////////
                 LAST_MPERF[core]=0;
                 LAST_APERF[core]=0;
-                MPERF[core]=readMSR (core, IA32_MPERF);
-                APERF[core]=readMSR (core, IA32_APERF);
+                TOTAL_MPERF[core]=0;
+                TOTAL_APERF[core]=0;
         }
+    read_ns_total = read_ns_max = read_count = 0;
 }
 
 void perfcounters_finalize(){
   //perfcounters_dump();
-  free(energyWrap);
-  free(energySave);
+  profiler_core_close();
 }
 
-void perfcounters_read(){
+void perfcounters_read(profiler_sample_t *sample){
     int sock;
-    int correctedCoreNumber;
     double last_power = 0.0, last_inst = 0.0;
     double total_mperf = 0.0,total_aperf=0.0;
     double total_uncore_freq=  0.0;
-    for (sock = 0; sock < numOfSockets; sock++){
-    //Discover the topology of the system using the physical id and assign correct cores to sockets
-            if (sock == get_physical_package_id(sock)){
-                correctedCoreNumber = sock;
-            }
-            else
-            {
-                correctedCoreNumber = sock * numOfCores;
-                isBlockTopology = 1;
-            }
-
-            uint64_t energyStatus = readMSR(correctedCoreNumber, MSR_PKG_ENERGY_STATUS); // get energy MSR
-            uint64_t energyCounter = energyStatus & 0xffffffff; // only 32 of 64 bits good
-
-            if (energyCounter < energySave[sock]) {
-                // did I just wrap the counter?
-                energyWrap[sock]++;
-            }
+    uint64_t now = nanoclock_now();
+    // MPERF counts at the base frequency while the core is not halted
+    double ref_cycles = (double)(now - last_sample_global) * BASE_FREQ * 0.1;
+    profiler_core_read(&counters);
+    uint64_t read_ns = nanoclock_now() - now;
+    read_ns_total += read_ns;
+    if (read_ns > read_ns_max) read_ns_max = read_ns;
+    read_count++;
 
-            energySave[sock] = energyCounter;
-            energyCounter = energyCounter + (energyWrap[sock]<<32);// number of wraps in upper 32 bits
-
-            LAST_PWR_PKG_ENERGY[sock] = energyCounter - PWR_PKG_ENERGY_Core[sock];
+    for (sock = 0; sock < numOfSockets; sock++){
+            LAST_PWR_PKG_ENERGY[sock] = counters.energy[sock];
             TOTAL_PWR_PKG_ENERGY[sock] += LAST_PWR_PKG_ENERGY[sock];
-            PWR_PKG_ENERGY_Core[sock] = energyCounter;
 
             last_power += (double)LAST_PWR_PKG_ENERGY[sock] * JOULE_UNIT;
 
 
-            LAST_UNCORE[sock] = readMSR(correctedCoreNumber, MSR_UNCORE_READ) & 0xFF;
+            LAST_UNCORE[sock] = counters.uncore[sock];
 
             total_uncore_freq+=LAST_UNCORE[sock];
 
@@ -309,35 +174,76 @@ void perfcounters_read(){
     }
     for (int core=0; core<numOfCores * numOfSockets; core++)
     {
-            uint64_t instruction = readMSR (core, IA32_FIXED_CTR0);
-            uint64_t mperf = readMSR (core, IA32_MPERF); // new code
-            uint64_t aperf = readMSR (core, IA32_APERF);  // new code
-            LAST_INST_RETIRED[core] = instruction - INST_RETIRED_CORE[core];
-            LAST_MPERF[core] = mperf - MPERF[core];  // new code
-            LAST_APERF[core] = aperf - APERF[core];  // new code
+            LAST_INST_RETIRED[core] = counters.inst[core];
+            LAST_MPERF[core] = counters.mperf[core];
+            LAST_APERF[core] = counters.aperf[core];
             TOTAL_INST_RETIRED[core] += LAST_INST_RETIRED[core];
-            INST_RETIRED_CORE[core] = instruction;
-            MPERF[core] = mperf;  // new code
-            APERF[core] = aperf;  // new code
+            TOTAL_MPERF[core] += LAST_MPERF[core];
+            TOTAL_APERF[core] += LAST_APERF[core];
 
             last_inst += (double)LAST_INST_RETIRED[core];
-            total_mperf+=(double)LAST_MPERF[core];
-            total_aperf+=(double)LAST_APERF[core];
+
+            // frequency over the cores the application runs on
+            int active = thread_map_count > 0 ? core_mapped[core]
+                                              : (double)LAST_MPERF[core] >= idle_busy * ref_cycles;
+            if (active) {
+                total_mperf+=(double)LAST_MPERF[core];
+                total_aperf+=(double)LAST_APERF[core];
+            }
     }
 
-    int cf = (int)((total_aperf/total_mperf)*BASE_FREQ);
+    int cf = total_mperf > 0 ? (int)((total_aperf/total_mperf)*BASE_FREQ) : 0;
     int uf = (int)(total_uncore_freq/numOfSockets);
     perflog_counter++;
+
+    // the interval's energy goes to the IP samples taken during it
+    ipsample_drain(last_power);
+
+    // timeline counters hold from the start of the interval they describe
+    if (trace_active() && now > last_sample_global) {
+            static const char *socket_keys[] = { "socket0", "socket1", "socket2", "socket3",
+                                                 "socket4", "socket5", "socket6", "socket7" };
+            static const char *freq_keys[] = { "core", "uncore" };
+            static const char *inst_keys[] = { "GIPS" };
+            double power[8], freq[2], rate[1];
+            double dt = nanoclock_to_sec(now - last_sample_global);
+            int n = numOfSockets < 8 ? (int)numOfSockets : 8;
+            for (sock = 0; sock < n; sock++)
+                    power[sock] = (double)LAST_PWR_PKG_ENERGY[sock] * JOULE_UNIT / dt;
+            freq[0] = cf * 100.0;
+            freq[1] = uf * 100.0;
+            rate[0] = last_inst / dt / 1e9;
+            trace_counter("Package power (W)", last_sample_global, n, socket_keys, power);
+            trace_counter("Frequency (MHz)", last_sample_global, 2, freq_keys, freq);
+            trace_counter("Instruction rate", last_sample_global, 1, inst_keys, rate);
+    }
+
+    uint64_t elapsed = now - start_def_global;
+    double static_energy = idle_watts * nanoclock_to_sec(now - last_sample_global);
+    if (sample != NULL) {
+            sample->index = perflog_counter;
+            sample->t_ns = elapsed;
+            sample->dt_ns = now - last_sample_global;
+            sample->energy = last_power;
+            sample->instructions = last_inst;
+            sample->core_freq = cf;
+            sample->uncore_freq = uf;
+    }
+    last_sample_global = now;
     if (perflog_fd != NULL) {
 
-            fprintf(perflog_fd, "%d\t%f\t%f\t%d\t\t%d\n", perflog_counter, last_power, last_inst,cf,uf);
+            fprintf(perflog_fd, "%d\t%f\t%f\t%d\t\t%d\t\t%" PRIu64 ".%06" PRIu64, perflog_counter, last_power, last_inst,cf,uf,
+                    elapsed / 1000000, elapsed % 1000000);
+            if (idle_baseline.source != IDLE_NONE)
+                    fprintf(perflog_fd, "\t%f\t%f", static_energy, last_power - static_energy);
+            fprintf(perflog_fd, "\n");
             fflush(perflog_fd);
     }
 
 }
 
 void perfcounters_stop(){
-    perfcounters_read();
+    perfcounters_read(NULL);
 }
 
 void perfcounters_dump(){
@@ -349,18 +255,111 @@ void perfcounters_dump(){
     fprintf(current_res_fd,"\n");
     double res=0;
     int i;
-    for(i=0; i<numOfSockets; i++) {
-      res += ((double)TOTAL_PWR_PKG_ENERGY[i])*JOULE_UNIT;
+    if (steady_only && steady_detector.steady_samples > 0) {
+      // totals restricted to the steady-state windows found by the detector
+      fprintf(current_res_fd,"%f\t",steady_detector.steady_energy);
+      fprintf(current_res_fd,"%f\t",steady_detector.steady_instructions);
+      fprintf(current_res_fd,"%f\t",0.0);
+      fprintf(current_res_fd,"%f\t",nanoclock_to_ms(steady_detector.steady_time_ns));
+    } else {
+      for(i=0; i<numOfSockets; i++) {
+        res += ((double)TOTAL_PWR_PKG_ENERGY[i])*JOULE_UNIT;
+      }
+      fprintf(current_res_fd,"%f\t",res);
+        res = 0;
+        for(i=0;i<numOfSockets*numOfCores;i++) {
+             res += ((double)TOTAL_INST_RETIRED[i]);
+        }
+      fprintf(current_res_fd,"%f\t",res);
+      fprintf(current_res_fd,"%f\t",0.0);
+      fprintf(current_res_fd,"%f\t",nanoclock_to_ms(end_def_global-start_def_global)); // return total time
     }
-    fprintf(current_res_fd,"%f\t",res);
-      res = 0;
-      for(i=0;i<numOfSockets*numOfCores;i++) {
-           res += ((double)TOTAL_INST_RETIRED[i]);
+    fprintf(current_res_fd,"\n=============================================================================\n");
+
+    if (idle_baseline.source != IDLE_NONE) {
+      // package energy split into idle (static) and workload (dynamic) parts
+      double elapsed_s = nanoclock_to_sec(end_def_global - start_def_global);
+      double node_total = 0.0;
+      fprintf(current_res_fd,"\n============================ Energy Breakdown ============================\n");
+      if (idle_baseline.source == IDLE_CACHED)
+        fprintf(current_res_fd,"(idle baseline cached for %s)\n",idle_baseline.key);
+      else
+        fprintf(current_res_fd,"(idle baseline measured over %.0f ms on %s)\n",idle_baseline.window_ms,idle_baseline.key);
+      fprintf(current_res_fd,"%s\t","SOCKET");
+      fprintf(current_res_fd,"%s\t","IDLE_POWER(W)");
+      fprintf(current_res_fd,"%s\t","TOTAL_ENERGY");
+      fprintf(current_res_fd,"%s\t","STATIC_ENERGY");
+      fprintf(current_res_fd,"%s\t","DYNAMIC_ENERGY");
+      fprintf(current_res_fd,"\n");
+      for(i=0; i<numOfSockets; i++) {
+        double total = ((double)TOTAL_PWR_PKG_ENERGY[i])*JOULE_UNIT;
+        double static_energy = idle_baseline.watts[i] * elapsed_s;
+        node_total += total;
+        fprintf(current_res_fd,"%d\t%f\t%f\t%f\t%f\n",i,idle_baseline.watts[i],total,static_energy,total-static_energy);
       }
-    fprintf(current_res_fd,"%f\t",res);
-    fprintf(current_res_fd,"%f\t",0.0);
-    fprintf(current_res_fd,"%f\t",(end_def_global-start_def_global)*1000); // return total time
+      fprintf(current_res_fd,"NODE\t%f\t%f\t%f\t%f\n",idle_watts,node_total,
+              idle_watts*elapsed_s,node_total-idle_watts*elapsed_s);
+      if (steady_detector.steady_samples > 0) {
+        double static_energy = idle_watts * nanoclock_to_sec(steady_detector.steady_time_ns);
+        fprintf(current_res_fd,"STEADY\t%f\t%f\t%f\t%f\n",idle_watts,steady_detector.steady_energy,
+                static_energy,steady_detector.steady_energy-static_energy);
+      }
+      fprintf(current_res_fd,"=============================================================================\n");
+    }
+
+    fprintf(current_res_fd,"\n============================ Steady-State Statistics ============================\n");
+    if (steady_only) fprintf(current_res_fd,"(Tabulate Statistics above cover steady-state windows only)\n");
+    fprintf(current_res_fd,"%s\t","RAMP_UP_END");
+    fprintf(current_res_fd,"%s\t","THROTTLE_EVENTS");
+    fprintf(current_res_fd,"%s\t","STEADY_SAMPLES");
+    fprintf(current_res_fd,"%s\t","STEADY_ENERGY");
+    fprintf(current_res_fd,"%s\t","STEADY_INST");
+    fprintf(current_res_fd,"%s\t","STEADY_TIME(ms)");
+    fprintf(current_res_fd,"\n");
+    fprintf(current_res_fd,"%d\t",steady_detector.ramp_up_end);
+    fprintf(current_res_fd,"%d\t",steady_detector.throttle_events);
+    fprintf(current_res_fd,"%d\t",steady_detector.steady_samples);
+    fprintf(current_res_fd,"%f\t",steady_detector.steady_energy);
+    fprintf(current_res_fd,"%f\t",steady_detector.steady_instructions);
+    fprintf(current_res_fd,"%f\t",nanoclock_to_ms(steady_detector.steady_time_ns));
+    fprintf(current_res_fd,"\n=============================================================================\n");
+
+    // cost of one counter read on the sampling thread (all MSRs of the node)
+    fprintf(current_res_fd,"\n============================ Sampler Statistics ============================\n");
+    fprintf(current_res_fd,"%s\t","SAMPLES");
+    fprintf(current_res_fd,"%s\t","READ_MEAN(us)");
+    fprintf(current_res_fd,"%s\t","READ_MAX(us)");
+    fprintf(current_res_fd,"\n");
+    fprintf(current_res_fd,"%" PRIu64 "\t",read_count);
+    fprintf(current_res_fd,"%f\t",read_count > 0 ? (double)read_ns_total / read_count / 1000.0 : 0.0);
+    fprintf(current_res_fd,"%f\t",(double)read_ns_max / 1000.0);
     fprintf(current_res_fd,"\n=============================================================================\n");
+
+    if (thread_map_count > 0) {
+      double elapsed_ref = (double)(end_def_global - start_def_global) * BASE_FREQ * 0.1;
+      fprintf(current_res_fd,"\n============================ Per-Thread Statistics ============================\n");
+      fprintf(current_res_fd,"%s\t","THREAD");
+      fprintf(current_res_fd,"%s\t","CPU");
+      fprintf(current_res_fd,"%s\t","INST_RETIRED");
+      fprintf(current_res_fd,"%s\t","CORE FREQ");
+      fprintf(current_res_fd,"%s\t","BUSY(%)");
+      fprintf(current_res_fd,"\n");
+      for(i=0; i<thread_map_count; i++) {
+        int cpu = thread_map[i];
+        fprintf(current_res_fd,"%d\t%d\t",i,cpu);
+        if (cpu < 0 || cpu >= numOfSockets*numOfCores) {
+          fprintf(current_res_fd,"-\t-\t-\n");
+          continue;
+        }
+        fprintf(current_res_fd,"%f\t",(double)TOTAL_INST_RETIRED[cpu]);
+        fprintf(current_res_fd,"%d\t",TOTAL_MPERF[cpu] > 0 ?
+                (int)(((double)TOTAL_APERF[cpu]/TOTAL_MPERF[cpu])*BASE_FREQ) : 0);
+        fprintf(current_res_fd,"%f\n",elapsed_ref > 0 ? 100.0*TOTAL_MPERF[cpu]/elapsed_ref : 0.0);
+      }
+      fprintf(current_res_fd,"(threads sharing a CPU report the same counters)\n");
+      fprintf(current_res_fd,"=============================================================================\n");
+    }
+    ipsample_dump(current_res_fd);
     fflush(current_res_fd);
 }
 
@@ -373,10 +372,45 @@ void perfcounters_dump(){
 /////////////////////////////
 
 
+// Idle baseline for this run, taken before the worker starts so the window is
+// quiet: the cache entry of this machine ($PROFILER_IDLE_CACHE) if there is one,
+// else a measurement over $PROFILER_IDLE_WINDOW ms (default 2000 with a cache,
+// off without), which is then stored in the cache. PROFILER_IDLE_REFRESH=1
+// skips the lookup.
+static void idle_calibrate(){
+    const char *cache = getenv("PROFILER_IDLE_CACHE");
+    int window_ms;
+    if (cache != NULL && *cache == '\0') cache = NULL;
+    window_ms = profiler_env_int("PROFILER_IDLE_WINDOW", cache != NULL ? 2000 : 0);
+    memset(&idle_baseline, 0, sizeof(idle_baseline));
+    idle_watts = 0.0;
+
+    if (cache != NULL && !profiler_env_int("PROFILER_IDLE_REFRESH", 0)
+        && idle_cache_load(cache, &idle_baseline) == 0) {
+        idle_watts = idle_node_watts(&idle_baseline);
+        fprintf(stderr, "===Idle baseline %.2f W from %s===\n", idle_watts, cache);
+        return;
+    }
+    if (window_ms <= 0) return;
+    fprintf(stderr, "===Measuring idle baseline over %d ms===\n", window_ms);
+    if (idle_measure(&idle_baseline, window_ms, profiler_core_joule_unit()) != 0) {
+        fprintf(stderr, "::Idle baseline measurement failed, reporting package energy only.\n");
+        memset(&idle_baseline, 0, sizeof(idle_baseline));
+        return;
+    }
+    idle_watts = idle_node_watts(&idle_baseline);
+    fprintf(stderr, "===Idle baseline %.2f W===\n", idle_watts);
+    if (cache != NULL) idle_cache_store(cache, &idle_baseline);
+}
+
 void* profiler_worker_routine(void* arg){
-    perfcounters_init();
     perfcounters_start();
-    timer_func(&start_def_global);
+    start_def_global = nanoclock_now();
+    last_sample_global = start_def_global;
+    steady_init(&steady_detector);
+    steady_only = profiler_env_int("PROFILER_STEADY_ONLY", 0);
+    idle_busy = profiler_env_double("PROFILER_IDLE_BUSY", 0.05);
+    ipsample_start();
 
     fprintf(perflog_fd,"\n============================ Unprocessed Statistics ============================\n");
     fprintf(perflog_fd,"\n === DURATION BETWEEN EACH READING :: 100ms ===\n\n");
@@ -385,14 +419,23 @@ void* profiler_worker_routine(void* arg){
     fprintf(perflog_fd,"%s\t","INST_RETIRED");
     fprintf(perflog_fd,"%s\t","CORE FREQ");
     fprintf(perflog_fd,"%s\t","UNCORE FREQ");
+    fprintf(perflog_fd,"%s\t","TIME(ms)");
+    if (idle_baseline.source != IDLE_NONE) {
+        fprintf(perflog_fd,"%s\t","STATIC_ENERGY");
+        fprintf(perflog_fd,"%s\t","DYNAMIC_ENERGY");
+    }
     fprintf(perflog_fd,"\n");
     
+    profiler_sample_t sample;
     while (profiling_active) {
-       perfcounters_read();
+       perfcounters_read(&sample);
+       // a sample that ends after profiler_stop() began holds the wind-down
+       if (profiling_active) steady_update(&steady_detector, &sample, perflog_fd);
        usleep(100000); // Sleep 100ms
     }
-    timer_func(&end_def_global);
+    end_def_global = nanoclock_now();
     perfcounters_stop();
+    ipsample_stop();
     perfcounters_finalize();
     fprintf(perflog_fd,"\n=============================================================================\n");
     
@@ -413,11 +456,20 @@ void profiler_start(){
 	}
 	fprintf(stderr, "===Calling profiler_start()===\n");
 	profiling_active=1;
+	start_def_global = 0;
+	nanoclock_init(); // before the worker thread and the idle window read the clock
 	perflog_fd = fopen("perflog.txt","w");
 	if (perflog_fd==NULL){
 		perror("Can't open perflog.txt");
 		return;
 	}
+	// the MSR core is opened on the caller so the idle window ends before the workload starts
+	perfcounters_init();
+	idle_calibrate();
+	uint64_t now = nanoclock_now();
+	const char *trace_path = getenv("PROFILER_TRACE");
+	if (trace_path != NULL && *trace_path != '\0' && trace_open(trace_path, now) == 0)
+		trace_begin("profiler", "profiler", 0, now);
 	int ret = pthread_create(&profiler_thread_id,NULL,profiler_worker_routine,NULL);
 	if (ret != 0) {
        		fprintf(stderr, "ERROR: Failed to create profiler thread: %s\n", strerror(ret));
@@ -426,6 +478,52 @@ void profiler_start(){
     	}
 }
 
+void profiler_set_thread_map(const int *cpus, int nthreads){
+	if (profiling_active){
+		fprintf(stderr, "::Thread map must be set before profiler_start().\n");
+		return;
+	}
+	if (nthreads > MAX_THREAD_MAP) nthreads = MAX_THREAD_MAP;
+	thread_map_count = nthreads > 0 ? nthreads : 0;
+	memset(core_mapped, 0, sizeof(core_mapped));
+	for (int t = 0; t < thread_map_count; t++) {
+		thread_map[t] = cpus[t];
+		if (cpus[t] >= 0 && cpus[t] < SOCKETSperNODE * CORESperSOCKET) core_mapped[cpus[t]] = 1;
+	}
+}
+
+// no gettid syscall or trace lock in the caller's timed loop without a trace
+void profiler_phase_begin(const char *name){
+	if (!trace_active()) return;
+	trace_begin(name, "phase", trace_tid(), nanoclock_now());
+}
+
+void profiler_phase_end(){
+	if (!trace_active()) return;
+	trace_end(trace_tid(), nanoclock_now());
+}
+
+int profiler_sample_index(){
+	return perflog_counter;
+}
+
+double profiler_elapsed_ms(){
+	uint64_t start = start_def_global;
+	return start != 0 ? nanoclock_to_ms(nanoclock_now() - start) : 0.0;
+}
+
+double profiler_energy(){
+	double res = 0;
+	for (int i = 0; i < numOfSockets; i++) {
+		res += ((double)TOTAL_PWR_PKG_ENERGY[i])*JOULE_UNIT;
+	}
+	return res;
+}
+
+double profiler_window_sec(){
+	return end_def_global > start_def_global ? nanoclock_to_sec(end_def_global - start_def_global) : 0.0;
+}
+
 void profiler_stop(){
 	if (!profiling_active){
 		fprintf(stderr,"Profiler already stopped\n");
@@ -434,13 +532,17 @@ void profiler_stop(){
 	fprintf(stderr, "===Calling profiler_end()===\n");
 	profiling_active = 0;
 	pthread_join(profiler_thread_id,NULL);
+	trace_end(0, nanoclock_now());
+	trace_close();
 
     current_res_fd = fopen("finalRes.txt","w");
     if (current_res_fd == NULL){
         perror("Unable to open finalRes.txt");
+        ipsample_free();
         return;
     }
     perfcounters_dump();
+    ipsample_free();
     fclose(current_res_fd);
     current_res_fd = NULL;
     fprintf(stderr, "===Unproccessed statistics written to perflog.txt===\n");
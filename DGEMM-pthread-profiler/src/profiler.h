@@ -1,11 +1,59 @@
 #ifndef PROFILER_H
 #define PROFILER_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Function to start the profiling thread
 void profiler_start();
 
 // Function to stop the profiling thread and write results
 void profiler_stop();
 
+// Logical CPU each OpenMP thread runs on (cpus[t] for thread t, e.g. from
+// sched_getcpu() in pinned threads); call before profiler_start(). finalRes
+// then gains per-thread instructions and frequency, and the core frequency
+// averages only the mapped cores. nthreads = 0 clears the map.
+void profiler_set_thread_map(const int *cpus, int nthreads);
+
+// Marks a named program phase on the calling thread in the timeline written
+// with PROFILER_TRACE=file.json (no-op otherwise). Phases nest and must end on
+// the thread that began them.
+void profiler_phase_begin(const char *name);
+void profiler_phase_end();
+
+// Index (perflog S.NO) of the most recent sample, 0 before the first one.
+// Cheap enough to call from inside timed loops.
+int profiler_sample_index();
+
+// Milliseconds on the perflog TIME(ms) axis (time since the first sample
+// interval began), 0 until the profiler worker is running.
+double profiler_elapsed_ms();
+
+// Frequency caps written through the profiler's MSR device, in units of
+// 100 MHz: core_ratio is the P-state requested on every CPU (IA32_PERF_CTL),
+// uncore_min/uncore_max bound the uncore ratio of every socket
+// (MSR_UNCORE_RATIO_LIMIT); 0 leaves a setting as it is. The first call saves
+// the original values; profiler_restore_frequency_caps() writes them back and
+// also runs at exit. Returns 0 on success.
+// profiler_restore_frequency_caps_async() is the async-signal-safe variant for
+// SIGINT/SIGTERM handlers: it writes the saved values back without closing.
+int profiler_set_frequency_caps(int core_ratio, int uncore_min, int uncore_max);
+void profiler_restore_frequency_caps();
+void profiler_restore_frequency_caps_async();
+
+// Package energy in joules summed over all sockets for the last
+// profiler_start()/profiler_stop() window; valid after profiler_stop().
+double profiler_energy();
+
+// Length in seconds of that window, the interval profiler_energy() covers
+// (first counter read to last); valid after profiler_stop().
+double profiler_window_sec();
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // PROFILER_H
 
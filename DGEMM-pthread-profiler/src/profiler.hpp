@@ -0,0 +1,57 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+/**
+ * RAII helpers for C++ applications over the libprofiler C API (profiler.h).
+ *
+ *   profiler::Session session;                  // profiler_start() .. profiler_stop()
+ *   {
+ *       profiler::ScopedProfile scope("solve");  // phase in the PROFILER_TRACE timeline
+ *       solve();
+ *       printf("%d samples\n", scope.samples());
+ *   }
+ *
+ * Both are header-only and add no dependency on the C++ runtime to libprofiler.
+ **/
+
+#include "profiler.h"
+
+namespace profiler {
+
+// Profiles the lifetime of the object
+class Session {
+public:
+    Session() { profiler_start(); }
+    ~Session() { profiler_stop(); }
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+};
+
+// Named region: a phase from construction to destruction on the calling
+// thread, with its extent on the perflog axes
+class ScopedProfile {
+public:
+    explicit ScopedProfile(const char *name)
+        : first_sample_(profiler_sample_index()), begin_ms_(profiler_elapsed_ms()){
+        profiler_phase_begin(name);
+    }
+    ~ScopedProfile() { profiler_phase_end(); }
+    ScopedProfile(const ScopedProfile &) = delete;
+    ScopedProfile &operator=(const ScopedProfile &) = delete;
+
+    // perflog S.NO current when the region began, samples completed since
+    int first_sample() const { return first_sample_; }
+    int samples() const { return profiler_sample_index() - first_sample_; }
+
+    // perflog TIME(ms) when the region began, time spent in it so far
+    double begin_ms() const { return begin_ms_; }
+    double elapsed_ms() const { return profiler_elapsed_ms() - begin_ms_; }
+
+private:
+    int first_sample_;
+    double begin_ms_;
+};
+
+} // namespace profiler
+
+#endif // PROFILER_HPP
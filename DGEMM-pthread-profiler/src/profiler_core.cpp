@@ -0,0 +1,133 @@
+/**
+ * Node sampler of libprofiler: the Sampler of profiler_core.hpp instantiated
+ * for the machine configuration in profiler_internal.h, behind the C interface
+ * profiler.c uses. Also home of the frequency caps, written through the same
+ * MSR device.
+ **/
+
+#include <stddef.h>
+#include <signal.h>
+#include "profiler_core.hpp"
+#include "profiler_internal.h"
+#include "profiler.h"
+
+#define IA32_PERF_GLOBAL_CTRL           0x38F // Enables for fixed ctr0,1,and2 here
+#define IA32_FIXED_CTR_CTRL             0x38D // Controls for fixed ctr0, 1, and 2
+#define IA32_PERF_GLOBAL_CTRL_VALUE     0x10000000F // bit {0-3} tells us the number of PMC registers in use
+#define IA32_FIXED_CTR_CTRL_VALUE       0x2   // ctr0 counts user-mode instructions only
+#define MSR_RAPL_POWER_UNIT             0x606
+#define IA32_PERF_CTL                   0x199 // bits 15:8 requested core ratio
+#define MSR_UNCORE_RATIO_LIMIT          0x620 // bits 6:0 max, 14:8 min uncore ratio
+
+#ifndef PROFILER_MSR_DEVICE
+#define PROFILER_MSR_DEVICE             "/dev/cpu/%d/msr_safe"
+#endif
+
+using namespace profiler;
+
+typedef Sampler<PROFILER_CPUS, SOCKETSperNODE,
+                EventList<InstRetired, Mperf, Aperf>,
+                EventList<PkgEnergy, UncoreRatio>> NodeSampler;
+
+// profiler_counters_t is the C view of NodeSampler::Sample
+static_assert(sizeof(NodeSampler::Sample) == sizeof(profiler_counters_t), "counter layout");
+static_assert(offsetof(profiler_counters_t, energy) == offsetof(NodeSampler::Sample, socket), "counter layout");
+
+static NodeSampler node;
+static double joule_unit = 0.0;
+
+extern "C" const char *profiler_msr_device(void){
+    const char *path = getenv("PROFILER_MSR_DEVICE");
+    return (path != NULL && *path != '\0') ? path : PROFILER_MSR_DEVICE;
+}
+
+extern "C" int profiler_core_open(void){
+    if (node.open(profiler_msr_device(), CORESperSOCKET) != 0) return -1;
+    const MsrDevice<PROFILER_CPUS> &dev = node.device();
+    for (int cpu = 0; cpu < PROFILER_CPUS; cpu++) {
+        // fixed counter 0 counts instructions at user level only
+        dev.write(cpu, IA32_PERF_GLOBAL_CTRL, IA32_PERF_GLOBAL_CTRL_VALUE);
+        dev.write(cpu, IA32_FIXED_CTR_CTRL, IA32_FIXED_CTR_CTRL_VALUE);
+    }
+    uint64_t power_unit = dev.read(0, MSR_RAPL_POWER_UNIT);
+    joule_unit = 1.0 / (1 << ((power_unit >> 8) & 0x1F));
+    profiler_counters_t discard;
+    profiler_core_read(&discard);      // baseline after the counters are programmed
+    return 0;
+}
+
+extern "C" void profiler_core_read(profiler_counters_t *counters){
+    node.read(*reinterpret_cast<NodeSampler::Sample *>(counters));
+}
+
+extern "C" double profiler_core_joule_unit(void){
+    return joule_unit;
+}
+
+extern "C" void profiler_core_close(void){
+    node.close();
+}
+
+/************************************************************************/
+// Frequency caps (profiler.h)
+/************************************************************************/
+
+static MsrDevice<PROFILER_CPUS> caps_dev;
+static uint64_t saved_perf_ctl[PROFILER_CPUS];
+static uint64_t saved_uncore_limit[SOCKETSperNODE];
+static int saved_uncore_cpu[SOCKETSperNODE];   // CPU the uncore limit of a socket is written on
+static volatile sig_atomic_t caps_saved = 0;
+static int caps_atexit = 0;
+
+extern "C" int profiler_set_frequency_caps(int core_ratio, int uncore_min, int uncore_max){
+    int cpu, s;
+    if (!caps_dev.is_open() && caps_dev.open(profiler_msr_device()) != 0) return -1;
+    if (!caps_saved) {
+        for (cpu = 0; cpu < PROFILER_CPUS; cpu++) saved_perf_ctl[cpu] = caps_dev.read(cpu, IA32_PERF_CTL);
+        for (s = 0; s < SOCKETSperNODE; s++) {
+            saved_uncore_cpu[s] = socket_cpu(s, CORESperSOCKET);
+            saved_uncore_limit[s] = caps_dev.read(saved_uncore_cpu[s], MSR_UNCORE_RATIO_LIMIT);
+        }
+        caps_saved = 1;
+        if (!caps_atexit) atexit(profiler_restore_frequency_caps);
+        caps_atexit = 1;
+    }
+    int ret = 0;
+    if (core_ratio > 0) {
+        for (cpu = 0; cpu < PROFILER_CPUS; cpu++) {
+            uint64_t v = (saved_perf_ctl[cpu] & ~0xFF00ULL) | ((uint64_t)(core_ratio & 0xFF) << 8);
+            ret |= caps_dev.write(cpu, IA32_PERF_CTL, v);
+        }
+    }
+    if (uncore_min > 0 || uncore_max > 0) {
+        for (s = 0; s < SOCKETSperNODE; s++) {
+            uint64_t v = saved_uncore_limit[s];
+            if (uncore_max > 0) v = (v & ~0x7FULL) | (uint64_t)(uncore_max & 0x7F);
+            if (uncore_min > 0) v = (v & ~0x7F00ULL) | ((uint64_t)(uncore_min & 0x7F) << 8);
+            ret |= caps_dev.write(saved_uncore_cpu[s], MSR_UNCORE_RATIO_LIMIT, v);
+        }
+    }
+    return ret;
+}
+
+extern "C" void profiler_restore_frequency_caps(void){
+    int cpu, s;
+    if (!caps_saved || !caps_dev.is_open()) return;
+    for (cpu = 0; cpu < PROFILER_CPUS; cpu++) caps_dev.write(cpu, IA32_PERF_CTL, saved_perf_ctl[cpu]);
+    for (s = 0; s < SOCKETSperNODE; s++)
+        caps_dev.write(saved_uncore_cpu[s], MSR_UNCORE_RATIO_LIMIT, saved_uncore_limit[s]);
+    caps_saved = 0;
+    caps_dev.close();
+}
+
+// pwrite on the descriptors opened by profiler_set_frequency_caps only: no
+// stdio, no allocation, no sysfs lookups, so a signal handler may call it
+extern "C" void profiler_restore_frequency_caps_async(void){
+    int cpu, s;
+    if (!caps_saved || !caps_dev.is_open()) return;
+    for (cpu = 0; cpu < PROFILER_CPUS; cpu++)
+        (void)!pwrite(caps_dev.fd(cpu), &saved_perf_ctl[cpu], sizeof(uint64_t), caps_dev.offset(IA32_PERF_CTL));
+    for (s = 0; s < SOCKETSperNODE; s++)
+        (void)!pwrite(caps_dev.fd(saved_uncore_cpu[s]), &saved_uncore_limit[s], sizeof(uint64_t),
+                      caps_dev.offset(MSR_UNCORE_RATIO_LIMIT));
+}
@@ -0,0 +1,218 @@
+#ifndef PROFILER_CORE_HPP
+#define PROFILER_CORE_HPP
+
+/**
+ * Compile-time specialized MSR sampling core of libprofiler.
+ *
+ * An event is a type naming its MSR, the counter width and whether it is a
+ * free-running counter (a sample holds the delta since the previous read, the
+ * width mask takes care of wrap-around) or a gauge (a sample holds the masked
+ * current value). Sampler<Cpus, Sockets, CoreEvents, SocketEvents> reads every
+ * core event on each of the Cpus CPUs and every socket event on the CPU that
+ * stands for each socket. Both event lists are template parameters, so the
+ * read of one CPU is an unrolled run of preads straight into a fixed-size
+ * struct: no loop over an event table, no branch on the event kind or the
+ * topology. The MSR device files are opened and the socket-to-CPU map resolved
+ * once, in open(); a sample is preads only. MsrDevice is the same file layer
+ * without events, for writes such as frequency caps.
+ **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <utility>
+
+namespace profiler {
+
+enum class EventKind { Counter, Gauge };
+
+template <uint32_t Address, unsigned Width, EventKind Kind = EventKind::Counter>
+struct MsrEvent {
+    static constexpr uint32_t msr = Address;
+    static constexpr uint64_t mask = Width >= 64 ? ~0ULL : ((1ULL << Width) - 1);
+    static constexpr EventKind kind = Kind;
+};
+
+// Events of the default node sampler
+using InstRetired = MsrEvent<0x309, 48>;                    // IA32_FIXED_CTR0, user-mode INST_RETIRED.ANY
+using Mperf       = MsrEvent<0xE7, 64>;                     // IA32_MPERF
+using Aperf       = MsrEvent<0xE8, 64>;                     // IA32_APERF
+using PkgEnergy   = MsrEvent<0x611, 32>;                    // MSR_PKG_ENERGY_STATUS, 32 valid bits
+using UncoreRatio = MsrEvent<0x621, 8, EventKind::Gauge>;   // MSR_UNCORE_READ, current ratio
+
+template <class... Events>
+struct EventList {
+    static constexpr size_t size = sizeof...(Events);
+};
+
+template <class E>
+inline uint64_t event_value(uint64_t now, uint64_t prev){
+    if constexpr (E::kind == EventKind::Counter) return (now - prev) & E::mask;
+    else return now & E::mask;
+}
+
+// Socket number of a CPU from sysfs, -1 if unknown
+inline int physical_package_id(int cpu){
+    char path[256];
+    int id = -1;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    if (fscanf(f, "%d", &id) != 1) id = -1;
+    fclose(f);
+    return id;
+}
+
+// Per-CPU MSR device files (/dev/cpu/N/msr_safe, or regular files of a
+// simulated device), kept open between accesses. The msr driver takes the MSR
+// address as the file offset; a regular file holds MSR n at offset 8 * n
+// instead, so adjacent addresses (MPERF/APERF) do not overlap.
+template <int Cpus>
+class MsrDevice {
+public:
+    MsrDevice(){
+        for (int cpu = 0; cpu < Cpus; cpu++) fd_[cpu] = -1;
+    }
+
+    // path_format takes the CPU number. Returns 0 on success.
+    int open(const char *path_format){
+        int cpu;
+        for (cpu = 0; cpu < Cpus; cpu++) {
+            char path[256];
+            snprintf(path, sizeof(path), path_format, cpu);
+            fd_[cpu] = ::open(path, O_RDWR);
+            if (fd_[cpu] < 0 && errno == EACCES) fd_[cpu] = ::open(path, O_RDONLY);
+            if (fd_[cpu] < 0) {
+                fprintf(stderr, "%s : open failed: %s\n", path, strerror(errno));
+                close();
+                return -1;
+            }
+        }
+        struct stat st;
+        shift_ = (fstat(fd_[0], &st) == 0 && S_ISREG(st.st_mode)) ? 3 : 0;
+        return 0;
+    }
+
+    void close(){
+        for (int cpu = 0; cpu < Cpus; cpu++) {
+            if (fd_[cpu] >= 0) ::close(fd_[cpu]);
+            fd_[cpu] = -1;
+        }
+    }
+
+    int is_open() const { return fd_[0] >= 0; }
+
+    int fd(int cpu) const { return fd_[cpu]; }
+
+    // File offset of an MSR
+    off_t offset(uint32_t msr) const { return (off_t)msr << shift_; }
+
+    uint64_t read(int cpu, uint32_t msr) const {
+        return pread_msr(fd_[cpu], offset(msr));
+    }
+
+    int write(int cpu, uint32_t msr, uint64_t value) const {
+        if (pwrite(fd_[cpu], &value, sizeof(value), offset(msr)) != (ssize_t)sizeof(value)) {
+            fprintf(stderr, "wrmsr: CPU %d cannot set MSR 0x%08x to 0x%016llx: %s\n",
+                    cpu, (unsigned)msr, (unsigned long long)value, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    static uint64_t pread_msr(int fd, off_t offset){
+        uint64_t value;
+        if (pread(fd, &value, sizeof(value), offset) != (ssize_t)sizeof(value)) {
+            perror("rdmsr:pread");
+            exit(127);
+        }
+        return value;
+    }
+
+private:
+    int fd_[Cpus];
+    int shift_ = 0;
+};
+
+// CPU whose MSRs stand for socket s: s on cyclic numbering, s * cores_per_socket on block numbering
+inline int socket_cpu(int s, int cores_per_socket){
+    return physical_package_id(s) == s ? s : s * cores_per_socket;
+}
+
+template <int Cpus, int Sockets, class CoreList, class SocketList>
+class Sampler;
+
+template <int Cpus, int Sockets, class... CoreEvents, class... SocketEvents>
+class Sampler<Cpus, Sockets, EventList<CoreEvents...>, EventList<SocketEvents...>> {
+public:
+    static constexpr size_t core_events = sizeof...(CoreEvents);
+    static constexpr size_t socket_events = sizeof...(SocketEvents);
+
+    // Event values of one sample, event-major
+    struct Sample {
+        uint64_t core[core_events][Cpus];
+        uint64_t socket[socket_events][Sockets];
+    };
+
+    // Opens the MSR device of every CPU (path_format takes the CPU number),
+    // maps each socket to the CPU that reads it and takes the baseline of all
+    // counters. Returns 0 on success.
+    int open(const char *path_format, int cores_per_socket){
+        if (dev_.open(path_format) != 0) return -1;
+        block_topology_ = 0;
+        for (int s = 0; s < Sockets; s++) {
+            int cpu = socket_cpu(s, cores_per_socket);
+            socket_fd_[s] = dev_.fd(cpu);
+            if (cpu != s) block_topology_ = 1;
+        }
+        Sample discard;
+        read(discard);
+        return 0;
+    }
+
+    void close(){ dev_.close(); }
+
+    // Values since the previous read (counters) or current values (gauges)
+    void read(Sample &out){
+        for (int cpu = 0; cpu < Cpus; cpu++)
+            read_core(cpu, out, std::index_sequence_for<CoreEvents...>{});
+        for (int s = 0; s < Sockets; s++)
+            read_socket(s, out, std::index_sequence_for<SocketEvents...>{});
+    }
+
+    const MsrDevice<Cpus> &device() const { return dev_; }
+
+    int block_topology() const { return block_topology_; }
+
+private:
+    template <class E>
+    void read_event(int fd, uint64_t &last, uint64_t &out) const {
+        uint64_t now = MsrDevice<Cpus>::pread_msr(fd, dev_.offset(E::msr));
+        out = event_value<E>(now, last);
+        last = now;
+    }
+
+    template <size_t... I>
+    void read_core(int cpu, Sample &out, std::index_sequence<I...>){
+        (read_event<CoreEvents>(dev_.fd(cpu), last_.core[I][cpu], out.core[I][cpu]), ...);
+    }
+
+    template <size_t... I>
+    void read_socket(int s, Sample &out, std::index_sequence<I...>){
+        (read_event<SocketEvents>(socket_fd_[s], last_.socket[I][s], out.socket[I][s]), ...);
+    }
+
+    MsrDevice<Cpus> dev_;
+    int socket_fd_[Sockets];
+    int block_topology_ = 0;
+    Sample last_ = {};      // raw register values of the previous read
+};
+
+} // namespace profiler
+
+#endif // PROFILER_CORE_HPP
@@ -0,0 +1,57 @@
+#ifndef PROFILER_INTERNAL_H
+#define PROFILER_INTERNAL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/************************************************************************/
+// Machine configuration  (change according to your machine)
+#define CORESperSOCKET 24
+#define SOCKETSperNODE 2
+#define NNODES 1
+/************************************************************************/
+#define PROFILER_CPUS (SOCKETSperNODE * CORESperSOCKET)
+
+// One reading of the sampling loop, aggregated over the node
+typedef struct {
+    int index;              // perflog S.NO
+    uint64_t t_ns;          // end of the sample, nanoseconds since profiler start
+    uint64_t dt_ns;         // length of the sample in nanoseconds
+    double energy;          // package energy over the sample (J), all sockets
+    double instructions;    // instructions retired over the sample, all cores
+    int core_freq;          // APERF/MPERF based core frequency (x100 MHz)
+    int uncore_freq;        // uncore ratio averaged over sockets (x100 MHz)
+} profiler_sample_t;
+
+// Read an integer / double tuning knob from the environment, falling back to def
+int profiler_env_int(const char *name, int def);
+double profiler_env_double(const char *name, double def);
+
+// Counter values of one node sample, filled by the MSR core (profiler_core.cpp):
+// deltas since the previous read, except the uncore ratio which is current
+typedef struct {
+    uint64_t inst[PROFILER_CPUS];       // IA32_FIXED_CTR0
+    uint64_t mperf[PROFILER_CPUS];
+    uint64_t aperf[PROFILER_CPUS];
+    uint64_t energy[SOCKETSperNODE];    // RAPL package energy units
+    uint64_t uncore[SOCKETSperNODE];    // uncore ratio (x100 MHz)
+} profiler_counters_t;
+
+// Opens the MSR devices, resolves the socket topology and programs the fixed
+// counter once; takes the baseline. Returns 0 on success.
+int profiler_core_open(void);
+void profiler_core_read(profiler_counters_t *counters);
+double profiler_core_joule_unit(void);
+void profiler_core_close(void);
+
+// printf format (CPU number) of the MSR device: $PROFILER_MSR_DEVICE, else /dev/cpu/%d/msr_safe
+const char *profiler_msr_device(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILER_INTERNAL_H
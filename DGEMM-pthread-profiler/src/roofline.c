@@ -0,0 +1,316 @@
+// ------------------------------------------------------- //
+// Roofline probes and IMC traffic counters (see roofline.h)
+// ------------------------------------------------------- //
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+#include "nanoclock.h"
+#include "roofline.h"
+
+#define ROOFLINE_TRIALS         5
+#define ROOFLINE_STREAM_MIN_MB  64
+#define ROOFLINE_FMA_ITERS      20000000L
+#define ROOFLINE_MAX_IMC        64
+
+// ------------------------------------------------------- //
+// Bandwidth probe
+//
+// STREAM triad a = b + s * c over arrays of at least 4x the
+// last level cache (capped so the three arrays take at most a
+// quarter of physical memory), first touched by the same static schedule
+// as the triad. Bytes are counted the STREAM way (24 per
+// element, no write-allocate), so IMC-measured traffic of a
+// store-heavy kernel can exceed the rate this implies.
+// ------------------------------------------------------- //
+static double stream_triad(size_t n) {
+        double* a = (double*) malloc(sizeof(double) * n);
+        double* b = (double*) malloc(sizeof(double) * n);
+        double* c = (double*) malloc(sizeof(double) * n);
+        uint64_t best = UINT64_MAX;
+        const double s = 3.0;
+        size_t i;
+        int t;
+
+        if(a == NULL || b == NULL || c == NULL) {
+                fprintf(stderr, "Error: unable to allocate the bandwidth probe arrays\n");
+                exit(-1);
+        }
+
+        #pragma omp parallel for schedule(static)
+        for(i = 0; i < n; i++) {
+                a[i] = 0.0;
+                b[i] = 1.0;
+                c[i] = 2.0;
+        }
+
+        for(t = 0; t < ROOFLINE_TRIALS; t++) {
+                const uint64_t start = nanoclock_now();
+
+                #pragma omp parallel for schedule(static)
+                for(i = 0; i < n; i++) a[i] = b[i] + s * c[i];
+
+                const uint64_t time = nanoclock_now() - start;
+                if(time < best) best = time;
+        }
+
+        if(a[n / 2] != 7.0) fprintf(stderr, "Warning: triad check failed\n");
+
+        free(a);
+        free(b);
+        free(c);
+        return (3.0 * sizeof(double) * n) / nanoclock_to_sec(best) / 1.0e9;
+}
+
+// ------------------------------------------------------- //
+// Peak FLOP probe
+//
+// Every thread runs independent multiply-add chains on
+// register vectors, enough of them to cover the FMA latency
+// on two pipes. The rate is what this build can issue (FMA
+// only if the compiler targets it), not a datasheet number.
+// ------------------------------------------------------- //
+#if defined(__AVX512F__)
+#define ROOFLINE_VEC 8
+#else
+#define ROOFLINE_VEC 4
+#endif
+#define ROOFLINE_CHAINS 12
+
+typedef double roofline_vec_t __attribute__((vector_size(ROOFLINE_VEC * sizeof(double))));
+
+static double fma_chains(long iters, double seed) {
+        roofline_vec_t acc[ROOFLINE_CHAINS];
+        roofline_vec_t x, y;
+        double sum = 0;
+        long it;
+        int j, l;
+
+        for(l = 0; l < ROOFLINE_VEC; l++) {
+                x[l] = 0.999999 + seed * 1e-12;
+                y[l] = 1e-9;
+        }
+        for(j = 0; j < ROOFLINE_CHAINS; j++) {
+                for(l = 0; l < ROOFLINE_VEC; l++) acc[j][l] = j + l * 0.5;
+        }
+
+        // fully unrolled so the chains live in registers
+        for(it = 0; it < iters; it++) {
+                #pragma GCC unroll 16
+                for(j = 0; j < ROOFLINE_CHAINS; j++) acc[j] = acc[j] * x + y;
+        }
+
+        for(j = 0; j < ROOFLINE_CHAINS; j++) {
+                for(l = 0; l < ROOFLINE_VEC; l++) sum += acc[j][l];
+        }
+        return sum;
+}
+
+static double peak_flops(void) {
+        uint64_t best = UINT64_MAX;
+        volatile double sink = 0;
+        int threads = 1, t;
+
+        for(t = 0; t < ROOFLINE_TRIALS; t++) {
+                double sum = 0;
+                const uint64_t start = nanoclock_now();
+
+                #pragma omp parallel reduction(+:sum)
+                {
+                        sum += fma_chains(ROOFLINE_FMA_ITERS, omp_get_thread_num());
+                        #pragma omp single
+                        threads = omp_get_num_threads();
+                }
+
+                const uint64_t time = nanoclock_now() - start;
+                if(time < best) best = time;
+                sink += sum;
+        }
+        (void) sink;
+
+        const double flops = 2.0 * ROOFLINE_VEC * ROOFLINE_CHAINS * (double) ROOFLINE_FMA_ITERS * threads;
+        return flops / nanoclock_to_sec(best) / 1.0e9;
+}
+
+void roofline_probe(roofline_machine_t* m) {
+        const long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        const double phys = (double) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+        size_t bytes = (size_t) ROOFLINE_STREAM_MIN_MB << 20;
+
+        if(llc > 0 && (size_t) llc * 4 > bytes) bytes = (size_t) llc * 4;
+        if(phys > 0 && bytes > phys / 12) bytes = (size_t) (phys / 12);
+
+        m->stream_mb = (double) bytes / (1024 * 1024);
+        m->stream_gbs = stream_triad(bytes / sizeof(double));
+        m->peak_gflops = peak_flops();
+
+        printf("Roofline STREAM:      %f GB/s (triad, %.0f MB arrays)\n", m->stream_gbs, m->stream_mb);
+        printf("Roofline peak:        %f GF/s (%d-wide multiply-add)\n", m->peak_gflops, ROOFLINE_VEC);
+}
+
+// ------------------------------------------------------- //
+// IMC counters
+//
+// One counter per uncore_imc_* PMU, event and socket (the
+// PMU cpumask names one CPU per socket). cas_count_read and
+// cas_count_write count 64-byte transfers. The event encoding
+// is taken from sysfs (events/ strings placed by format/).
+// Needs perf_event_paranoid <= 0 or CAP_PERFMON.
+// ------------------------------------------------------- //
+static int imc_fd[ROOFLINE_MAX_IMC];
+static int imc_count = 0;
+
+static int read_sysfs(const char* dir, const char* name, char* buf, size_t len) {
+        char path[512];
+        int n = snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if(n < 0 || (size_t) n >= sizeof(path)) return -1;
+        FILE* f = fopen(path, "r");
+        if(f == NULL) return -1;
+        if(fgets(buf, (int) len, f) == NULL) buf[0] = '\0';
+        fclose(f);
+        buf[strcspn(buf, "\n")] = '\0';
+        return 0;
+}
+
+// "event=0x04,umask=0x03" -> config bits, using format/<term> = "config:lo-hi"
+static int imc_config(const char* dir, const char* event, uint64_t* config) {
+        char spec[256], term[64];
+        char* save = NULL;
+        char* tok;
+
+        snprintf(term, sizeof(term), "events/%s", event);
+        if(read_sysfs(dir, term, spec, sizeof(spec)) != 0) return -1;
+
+        *config = 0;
+        for(tok = strtok_r(spec, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+                char* eq = strchr(tok, '=');
+                char format[64];
+                int lo = 0;
+
+                if(eq == NULL) continue;
+                *eq = '\0';
+                snprintf(term, sizeof(term), "format/%s", tok);
+                if(read_sysfs(dir, term, format, sizeof(format)) != 0 ||
+                        sscanf(format, "config:%d", &lo) != 1) return -1;
+                *config |= strtoull(eq + 1, NULL, 0) << lo;
+        }
+        return 0;
+}
+
+static void imc_open_pmu(const char* dir) {
+        static const char* events[] = { "cas_count_read", "cas_count_write" };
+        char buf[256];
+        int type, e;
+
+        if(read_sysfs(dir, "type", buf, sizeof(buf)) != 0) return;
+        type = atoi(buf);
+        if(read_sysfs(dir, "cpumask", buf, sizeof(buf)) != 0) return;
+
+        for(e = 0; e < 2; e++) {
+                struct perf_event_attr attr;
+                uint64_t config;
+                char cpus[256];
+                char* save = NULL;
+                char* tok;
+
+                if(imc_config(dir, events[e], &config) != 0) continue;
+
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = type;
+                attr.config = config;
+                attr.disabled = 1;
+
+                // cpumask is a list like "0,24" (ranges are not used by uncore PMUs)
+                strncpy(cpus, buf, sizeof(cpus) - 1);
+                cpus[sizeof(cpus) - 1] = '\0';
+                for(tok = strtok_r(cpus, ",", &save); tok != NULL && imc_count < ROOFLINE_MAX_IMC;
+                        tok = strtok_r(NULL, ",", &save)) {
+                        const int fd = (int) syscall(SYS_perf_event_open, &attr, -1, atoi(tok), -1, 0);
+                        if(fd >= 0) imc_fd[imc_count++] = fd;
+                }
+        }
+}
+
+int roofline_imc_open(void) {
+        const char* root = "/sys/bus/event_source/devices";
+        DIR* d = opendir(root);
+        struct dirent* ent;
+        char dir[512];
+
+        if(d == NULL) return 0;
+        while((ent = readdir(d)) != NULL) {
+                if(strncmp(ent->d_name, "uncore_imc", 10) != 0) continue;
+                snprintf(dir, sizeof(dir), "%s/%s", root, ent->d_name);
+                imc_open_pmu(dir);
+        }
+        closedir(d);
+        return imc_count;
+}
+
+void roofline_imc_start(void) {
+        int i;
+        for(i = 0; i < imc_count; i++) {
+                ioctl(imc_fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(imc_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+}
+
+double roofline_imc_bytes(void) {
+        double bytes = 0;
+        int i;
+
+        for(i = 0; i < imc_count; i++) {
+                uint64_t value = 0;
+                ioctl(imc_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+                if(read(imc_fd[i], &value, sizeof(value)) == sizeof(value)) bytes += 64.0 * value;
+        }
+        return bytes;
+}
+
+void roofline_imc_close(void) {
+        int i;
+        for(i = 0; i < imc_count; i++) close(imc_fd[i]);
+        imc_count = 0;
+}
+
+void roofline_report(const char* path, const roofline_machine_t* m, const roofline_point_t* p) {
+        const double gflops = (p->seconds > 0) ? p->flops / p->seconds / 1.0e9 : 0;
+        const double ai = (p->bytes > 0) ? p->flops / p->bytes : 0;
+        const double ridge = (m->stream_gbs > 0) ? m->peak_gflops / m->stream_gbs : 0;
+        const double memory_roof = ai * m->stream_gbs;
+        const double roof = (memory_roof < m->peak_gflops) ? memory_roof : m->peak_gflops;
+        const char* bound = (ai < ridge) ? "memory" : "compute";
+
+        printf("Roofline traffic:     %f GB per repeat (%s)\n",
+                p->bytes / p->repeats / 1.0e9, p->traffic);
+        printf("Arithmetic intensity: %f FLOP/byte (ridge %f)\n", ai, ridge);
+        printf("Roofline bound:       %s, %f of %f GF/s attainable (%.1f %%)\n",
+                bound, gflops, roof, (roof > 0) ? 100.0 * gflops / roof : 0);
+
+        if(path == NULL) return;
+
+        FILE* csv = fopen(path, "a");
+        if(csv == NULL) {
+                perror(path);
+                return;
+        }
+        fseek(csv, 0, SEEK_END);
+        if(ftell(csv) == 0) {
+                fprintf(csv, "kernel,M,N,K,threads,repeats,seconds,gflops,bytes,traffic,"
+                        "intensity,stream_gbs,peak_gflops,ridge,attainable_gflops,bound,energy_j\n");
+        }
+        fprintf(csv, "%s,%d,%d,%d,%d,%d,%f,%f,%.0f,%s,%f,%f,%f,%f,%f,%s,%f\n",
+                p->kernel, p->M, p->N, p->K, p->threads, p->repeats, p->seconds, gflops,
+                p->bytes, p->traffic, ai, m->stream_gbs, m->peak_gflops, ridge, roof, bound, p->energy);
+        fclose(csv);
+        printf("Roofline point appended to %s\n", path);
+}
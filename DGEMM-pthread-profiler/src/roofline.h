@@ -0,0 +1,46 @@
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+// ------------------------------------------------------- //
+// Roofline data collection for the dgemm benchmark
+//
+// roofline_probe measures the two roofs of this machine with
+// the threads the run will use: STREAM triad bandwidth and
+// the peak FMA rate of the build. Memory traffic of the timed
+// region comes from the integrated memory controller (uncore
+// IMC CAS counters via perf_event_open) when the kernel
+// exposes them, otherwise the caller supplies an estimate.
+// ------------------------------------------------------- //
+
+typedef struct {
+        double stream_gbs;      // best triad bandwidth, GB/s (24 bytes per element)
+        double peak_gflops;     // best FMA throughput, GFLOP/s
+        double stream_mb;       // size of one triad array, MB
+} roofline_machine_t;
+
+typedef struct {
+        const char* kernel;     // label of the multiply that ran
+        int M, N, K;
+        int threads, repeats;
+        double seconds;         // timed region
+        double flops;           // over all repeats
+        double bytes;           // DRAM traffic over all repeats
+        const char* traffic;    // where bytes came from: imc, model or compulsory
+        double energy;          // J, from libprofiler
+} roofline_point_t;
+
+void roofline_probe(roofline_machine_t* m);
+
+// Opens the IMC read/write counters of every socket, returns
+// the number opened (0 = unavailable, use an estimate)
+int roofline_imc_open(void);
+void roofline_imc_start(void);
+// DRAM bytes read plus written since roofline_imc_start
+double roofline_imc_bytes(void);
+void roofline_imc_close(void);
+
+// Prints the placement of p on the roofline and appends it as
+// one CSV row to path (header written when the file is new)
+void roofline_report(const char* path, const roofline_machine_t* m, const roofline_point_t* p);
+
+#endif // ROOFLINE_H
@@ -0,0 +1,145 @@
+/**
+ * Online steady-state / throttling detector, see steady.h
+ **/
+
+#include <math.h>
+#include "steady.h"
+#include "nanoclock.h"
+#include "trace.h"
+
+#define STEADY_DEFAULT_TOL      0.05
+#define STEADY_DEFAULT_HOLD     5
+#define STEADY_DEFAULT_ALPHA    0.3
+
+void steady_init(steady_detector_t *d){
+    int i;
+    d->tolerance = profiler_env_double("PROFILER_STEADY_TOL", STEADY_DEFAULT_TOL);
+    d->hold = profiler_env_int("PROFILER_STEADY_HOLD", STEADY_DEFAULT_HOLD);
+    d->alpha = STEADY_DEFAULT_ALPHA;
+    if (d->hold < 1) d->hold = 1;
+
+    d->state = STEADY_STATE_RAMP_UP;
+    d->nseen = 0;
+    d->run = 0;
+    for (i = 0; i < STEADY_NUM_SIGNALS; i++) {
+        d->ewma[i] = 0.0;
+        d->ref[i] = 0.0;
+        d->cusum[i] = 0.0;
+    }
+    d->ramp_up_end = -1;
+    d->throttle_events = 0;
+    d->last_throttle_onset = -1;
+    d->pending_onset = -1;
+    d->pending_t_ns = 0;
+    d->last_recovery = -1;
+    d->steady_samples = 0;
+    d->steady_energy = 0.0;
+    d->steady_instructions = 0.0;
+    d->steady_time_ns = 0;
+}
+
+static int within(double x, double ref, double tol){
+    return ref > 0.0 && fabs(x - ref) <= tol * ref;
+}
+
+static int below(double x, double ref, double tol){
+    return x < (1.0 - tol) * ref;
+}
+
+// ago_ns: how long before the end of the current sample the event happened
+static void mark(FILE *log, int index, const char *event, uint64_t ago_ns){
+    // the sample was read just before the update, so now is its end
+    trace_instant(event, 0, nanoclock_now() - ago_ns);
+    if (log == NULL) return;
+    fprintf(log, "# MARK\t%d\t%s\n", index, event);
+    fflush(log);
+}
+
+int steady_update(steady_detector_t *d, const profiler_sample_t *s, FILE *log){
+    double x[STEADY_NUM_SIGNALS];
+    int i, ok;
+
+    if (s->dt_ns == 0) return 0;
+    double dt = nanoclock_to_sec(s->dt_ns);
+    x[STEADY_FREQ] = (double)s->core_freq;
+    x[STEADY_POWER] = s->energy / dt;
+    x[STEADY_IPS] = s->instructions / dt;
+
+    if (d->nseen++ == 0) {
+        for (i = 0; i < STEADY_NUM_SIGNALS; i++) d->ewma[i] = x[i];
+        return 0;
+    }
+    for (i = 0; i < STEADY_NUM_SIGNALS; i++) d->ewma[i] += d->alpha * (x[i] - d->ewma[i]);
+
+    switch (d->state) {
+    case STEADY_STATE_RAMP_UP:
+        ok = 1;
+        for (i = 0; i < STEADY_NUM_SIGNALS; i++) ok &= within(x[i], d->ewma[i], d->tolerance);
+        d->run = ok ? d->run + 1 : 0;
+        if (d->run < d->hold) return 0;
+
+        d->state = STEADY_STATE_STEADY;
+        d->ramp_up_end = s->index;
+        for (i = 0; i < STEADY_NUM_SIGNALS; i++) {
+            d->ref[i] = d->ewma[i];
+            d->cusum[i] = 0.0;
+        }
+        mark(log, s->index, "RAMP_UP_END", 0);
+        break;
+
+    case STEADY_STATE_STEADY: {
+        double h = 2.0 * d->tolerance;
+        for (i = 0; i < STEADY_NUM_SIGNALS; i++) {
+            double c = d->cusum[i] + (d->ref[i] - x[i]) / d->ref[i] - 0.5 * d->tolerance;
+            d->cusum[i] = c > 0.0 ? c : 0.0;
+        }
+        // the CUSUM stays up for a while after a single dip, so the sample
+        // itself must be below the band for the alarm to count towards hold
+        int freq_low = below(x[STEADY_FREQ], d->ref[STEADY_FREQ], d->tolerance);
+        int cap_low = below(x[STEADY_POWER], d->ref[STEADY_POWER], d->tolerance) &&
+                      below(x[STEADY_IPS], d->ref[STEADY_IPS], d->tolerance);
+        if ((d->cusum[STEADY_FREQ] > h && freq_low) ||
+            (d->cusum[STEADY_POWER] > h && d->cusum[STEADY_IPS] > h && cap_low)) {
+            // samples of a pending alarm are left out of the steady totals
+            if (d->pending_onset < 0) {
+                d->pending_onset = s->index;
+                d->pending_t_ns = s->t_ns;
+                d->run = 0;
+            }
+            if (++d->run < d->hold) return 0;
+
+            d->state = STEADY_STATE_THROTTLED;
+            d->run = 0;
+            d->throttle_events++;
+            d->last_throttle_onset = d->pending_onset;
+            mark(log, d->pending_onset, "THROTTLE_ONSET", s->t_ns - d->pending_t_ns);
+            d->pending_onset = -1;
+            return 0;
+        }
+        d->pending_onset = -1;
+        // let the reference follow slow drift while the signal stays in band
+        for (i = 0; i < STEADY_NUM_SIGNALS; i++) {
+            if (within(x[i], d->ref[i], d->tolerance)) d->ref[i] += 0.25 * d->alpha * (x[i] - d->ref[i]);
+        }
+        break;
+    }
+
+    case STEADY_STATE_THROTTLED:
+        ok = within(x[STEADY_FREQ], d->ref[STEADY_FREQ], d->tolerance) &&
+             within(x[STEADY_IPS], d->ref[STEADY_IPS], d->tolerance);
+        d->run = ok ? d->run + 1 : 0;
+        if (d->run < d->hold) return 0;
+
+        d->state = STEADY_STATE_STEADY;
+        d->last_recovery = s->index;
+        for (i = 0; i < STEADY_NUM_SIGNALS; i++) d->cusum[i] = 0.0;
+        mark(log, s->index, "THROTTLE_RECOVERY", 0);
+        break;
+    }
+
+    d->steady_samples++;
+    d->steady_energy += s->energy;
+    d->steady_instructions += s->instructions;
+    d->steady_time_ns += s->dt_ns;
+    return 1;
+}
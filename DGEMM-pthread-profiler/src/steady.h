@@ -0,0 +1,65 @@
+#ifndef STEADY_H
+#define STEADY_H
+
+#include <stdio.h>
+#include "profiler_internal.h"
+
+/**
+ * Online steady-state and throttling detection over the profiler samples.
+ *
+ * Each signal (core frequency, package power, instruction rate) keeps an EWMA.
+ * Ramp-up ends once every signal stayed within the tolerance of its EWMA for
+ * `hold` consecutive samples; the EWMA values at that point become the steady
+ * reference. A one-sided CUSUM on the downward deviation from the reference
+ * flags throttling (frequency alone, or power and instruction rate together
+ * for power-limit capping) once the alarm has held, with the signal below the
+ * band, for `hold` consecutive samples. A short power drop as the workload
+ * winds down before profiler_stop() is therefore not taken for throttling; a
+ * confirmed onset is dated to its first alarming sample. Recovery is declared
+ * once frequency has been back within the tolerance for `hold` samples.
+ **/
+
+enum { STEADY_FREQ = 0, STEADY_POWER, STEADY_IPS, STEADY_NUM_SIGNALS };
+
+typedef enum {
+    STEADY_STATE_RAMP_UP = 0,
+    STEADY_STATE_STEADY,
+    STEADY_STATE_THROTTLED
+} steady_state_t;
+
+typedef struct {
+    // configuration
+    double tolerance;       // relative band around the reference (PROFILER_STEADY_TOL)
+    int hold;               // samples needed to confirm a transition (PROFILER_STEADY_HOLD)
+    double alpha;           // EWMA smoothing factor
+
+    // detector state
+    steady_state_t state;
+    int nseen;
+    int run;                // consecutive samples satisfying the pending transition
+    double ewma[STEADY_NUM_SIGNALS];
+    double ref[STEADY_NUM_SIGNALS];
+    double cusum[STEADY_NUM_SIGNALS];
+
+    // markers
+    int ramp_up_end;        // sample index, -1 if never reached
+    int throttle_events;
+    int last_throttle_onset;
+    int pending_onset;      // first sample of an unconfirmed throttling alarm, -1 if none
+    uint64_t pending_t_ns;  // its end, nanoseconds since profiler start
+    int last_recovery;
+
+    // totals over steady (non ramp-up, non throttled) samples
+    int steady_samples;
+    double steady_energy;
+    double steady_instructions;
+    uint64_t steady_time_ns;
+} steady_detector_t;
+
+void steady_init(steady_detector_t *d);
+
+// Feed one sample; markers are written to log (when non-NULL) as "# MARK" lines.
+// Returns 1 if the sample belongs to a steady-state window.
+int steady_update(steady_detector_t *d, const profiler_sample_t *s, FILE *log);
+
+#endif // STEADY_H
@@ -0,0 +1,121 @@
+/**
+ * Streaming Chrome Trace Event writer, see trace.h
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+static FILE *trace_fd = NULL;
+static uint64_t trace_t0 = 0;
+static int trace_pid = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// JSON string body with quotes, backslashes and control characters escaped
+static void trace_string(const char *s){
+    fputc('"', trace_fd);
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(trace_fd, "\\%c", c);
+        else if (c < 0x20) fprintf(trace_fd, "\\u%04x", c);
+        else fputc(c, trace_fd);
+    }
+    fputc('"', trace_fd);
+}
+
+// Opens an event object up to the end of "ts"; the caller adds the rest and "}"
+static void trace_event_head(const char *name, const char *ph, int tid, uint64_t t_ns){
+    double ts = t_ns > trace_t0 ? (double)(t_ns - trace_t0) / 1000.0 : 0.0;
+    fputs(",\n{\"name\":", trace_fd);
+    trace_string(name);
+    fprintf(trace_fd, ",\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f", ph, trace_pid, tid, ts);
+}
+
+int trace_open(const char *path, uint64_t t0_ns){
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != NULL) fclose(trace_fd);
+    trace_fd = fopen(path, "w");
+    if (trace_fd == NULL) {
+        pthread_mutex_unlock(&trace_lock);
+        perror(path);
+        return -1;
+    }
+    trace_t0 = t0_ns;
+    trace_pid = (int)getpid();
+
+    // the first element carries no leading comma; name the process and the sampler track
+    fprintf(trace_fd, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"libprofiler\"}}", trace_pid);
+    fprintf(trace_fd, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"sampler\"}}", trace_pid);
+    fflush(trace_fd);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+void trace_counter(const char *name, uint64_t t_ns, int n, const char *const *keys, const double *values){
+    int i;
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != NULL) {
+        trace_event_head(name, "C", 0, t_ns);
+        fputs(",\"args\":{", trace_fd);
+        for (i = 0; i < n; i++) {
+            if (i > 0) fputc(',', trace_fd);
+            trace_string(keys[i]);
+            fprintf(trace_fd, ":%.6g", values[i]);
+        }
+        fputs("}}", trace_fd);
+        fflush(trace_fd);   // counters arrive once per sample: keep the file current
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_begin(const char *name, const char *category, int tid, uint64_t t_ns){
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != NULL) {
+        trace_event_head(name, "B", tid, t_ns);
+        fputs(",\"cat\":", trace_fd);
+        trace_string(category);
+        fputc('}', trace_fd);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_end(int tid, uint64_t t_ns){
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != NULL) {
+        double ts = t_ns > trace_t0 ? (double)(t_ns - trace_t0) / 1000.0 : 0.0;
+        fprintf(trace_fd, ",\n{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f}", trace_pid, tid, ts);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_instant(const char *name, int tid, uint64_t t_ns){
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != NULL) {
+        trace_event_head(name, "i", tid, t_ns);
+        fputs(",\"s\":\"p\"}", trace_fd);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_close(void){
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd != NULL) {
+        fputs("\n]\n", trace_fd);
+        fclose(trace_fd);
+        trace_fd = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+int trace_active(void){
+    return trace_fd != NULL;
+}
+
+int trace_tid(void){
+    return (int)syscall(SYS_gettid);
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/**
+ * Streaming Chrome Trace Event writer (PROFILER_TRACE=file.json).
+ *
+ * Events are appended to the file as they happen in the JSON Array Format,
+ * one per line, through the stdio buffer: memory stays bounded however long
+ * the run, and a file cut short by a crash still loads because the closing
+ * bracket is optional in that format. Loads in chrome://tracing and
+ * ui.perfetto.dev. Timestamps are microseconds since trace_open.
+ *
+ * All calls are thread-safe and no-ops while no trace is open.
+ **/
+
+// t0_ns: nanoclock time that becomes ts 0. Returns 0 on success.
+int trace_open(const char *path, uint64_t t0_ns);
+
+// Counter track `name` with n series, valid from t_ns on
+void trace_counter(const char *name, uint64_t t_ns, int n, const char *const *keys, const double *values);
+
+// Duration slice on thread tid (B/E pairs nest per thread)
+void trace_begin(const char *name, const char *category, int tid, uint64_t t_ns);
+void trace_end(int tid, uint64_t t_ns);
+
+// Process-wide instant event, drawn from thread tid (steady-state markers)
+void trace_instant(const char *name, int tid, uint64_t t_ns);
+
+void trace_close(void);
+
+int trace_active(void);
+
+// Kernel thread id of the caller, used as the tid of host phases
+int trace_tid(void);
+
+#endif // TRACE_H
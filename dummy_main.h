@@ -6,42 +6,107 @@
 #include <string.h>
 #include <omp.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
+// Client of the my-profiler daemon: opens a profiling window for this process
+// around user_main and writes the daemon's result for it to
+// currentRes.<pid>.txt (or $MY_PROFILER_RESULT). Several jobs on one node each
+// get their own window and result.
 
 int user_main(int ARGC, char **ARGV);
 
+static int profiler_connect(const char *path) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// reads until the daemon closes the connection or sends END
+static size_t profiler_read_reply(int fd, char *buf, size_t size, const char *until) {
+  size_t len = 0;
+  ssize_t n;
+  buf[0] = '\0';
+  while (len < size - 1 && (n = read(fd, buf + len, size - 1 - len)) > 0) {
+    len += (size_t)n;
+    buf[len] = '\0';
+    if (strstr(buf, until) != NULL) break;
+  }
+  return len;
+}
+
 int main(int argc, char **argv) {
-  
-  char signal_file[100];
-  strcpy(signal_file, "/tmp/hpl.txt");
-
-  // write into daemon fprintf(stdout,"\n-----\nmkdir timedrun fake\n\n");
-
- 
- printf("\n====Starting energy profiler====\n\n");
-
- // Enter the correct path to your profiler
- /////////////////////////////////////////
- int ret = system("/home/shivam2025/freq_check/msr-daemon-new &");
- if (ret == -1){
-	 perror("Failed to run profiler");
-	 exit(EXIT_FAILURE);
- }	 
- /////////////////////////////////////////
- 
- usleep(50000);
-  int x = user_main(argc, argv);
-  //printf("User main executed and ended \n " );
-  FILE *fp  = fopen (signal_file, "a+");
-  if (fp!=NULL){
-  	fprintf(fp,"done\n");
-	fclose(fp);
+
+  const char *socket_path = getenv("MY_PROFILER_SOCKET");
+  if (socket_path == NULL) socket_path = "/tmp/my-profiler.sock";
+
+  printf("\n====Starting energy profiler====\n\n");
+
+  int fd = profiler_connect(socket_path);
+  if (fd < 0) {
+    // no daemon on this node yet: start one, it keeps serving later jobs
+    // Enter the correct path to your profiler
+    /////////////////////////////////////////
+    const char *daemon = getenv("MY_PROFILER_DAEMON");
+    if (daemon == NULL) daemon = "/home/shivam2025/freq_check/msr-daemon-new";
+    /////////////////////////////////////////
+    char command[1024];
+    snprintf(command, sizeof(command), "%s -s %s &", daemon, socket_path);
+    int ret = system(command);
+    if (ret == -1) {
+      perror("Failed to run profiler");
+      exit(EXIT_FAILURE);
+    }
+    for (int tries = 0; tries < 100 && fd < 0; tries++) {
+      usleep(20000);
+      fd = profiler_connect(socket_path);
+    }
+  }
+
+  char reply[4096];
+  if (fd >= 0) {
+    dprintf(fd, "START %d\n", (int)getpid());
+    profiler_read_reply(fd, reply, sizeof(reply), "\n");
+    if (strncmp(reply, "OK", 2) != 0) {
+      fprintf(stderr, "Profiler refused the window: %s", reply);
+      close(fd);
+      fd = -1;
+    }
   }
-  else{
-  	perror("Failure in creating signal file");
+  if (fd < 0) fprintf(stderr, "Profiler daemon unavailable, running without profiling\n");
+
+  int x = user_main(argc, argv);
+
+  if (fd >= 0) {
+    dprintf(fd, "STOP\n");
+    profiler_read_reply(fd, reply, sizeof(reply), "END\n");
+    close(fd);
+    char *end = strstr(reply, "END\n");
+    if (end != NULL) *end = '\0';
+
+    char result_file[256];
+    const char *path = getenv("MY_PROFILER_RESULT");
+    if (path == NULL) {
+      snprintf(result_file, sizeof(result_file), "currentRes.%d.txt", (int)getpid());
+      path = result_file;
+    }
+    FILE *fp = fopen(path, "w");
+    if (fp != NULL) {
+      fputs(reply, fp);
+      fclose(fp);
+      printf("\n====PROFILER RESULT WRITTEN TO %s=====\n", path);
+    } else {
+      perror("Failure in creating result file");
+    }
   }
-  printf("\n====SIGNAL FILE CREATED SUCCESS=====\n");
-  usleep(50000);//500ms
   return x;
 }
 #endif
@@ -7,11 +7,19 @@
  * Written in HiPeC Lab by  
 		Sunil Kumar, sunilk@iiitd.ac.in
 		Akshat Gupta, akshat17014@iiitd.ac.in
+ *
+ * Runs as a long-lived daemon: one sampler per node serves any number of
+ * concurrent clients over a Unix socket (see dummy_main.h for the client
+ * side). Each client opens its own START/STOP window and gets its own result;
+ * the node's package energy of every interval is split across the clients
+ * active in it by their share of the node's busy CPU time (default) or of the
+ * instructions retired on the cores their threads ran on (-a instructions),
+ * both taken from /proc/<pid>/stat and /proc/<pid>/task.
  **/
 
 
 
-#define _XOPEN_SOURCE 500
+#define _GNU_SOURCE // SO_PEERCRED
 #include <unistd.h>
 #include <stdio.h>  // for printf
 #include <stdlib.h>  // for malloc - temp until share memory region allocated
@@ -20,304 +28,93 @@
 #include <fcntl.h>
 #include <errno.h>
 #include<time.h>
-
-/* Haswell Power MSR register addresses  (change according to your machine) */
-// register value for different scope
-#define IA32_PERF_GLOBAL_CTRL_VALUE 0x10000000F // bit {0-3} tells us the number of PMC registers in use (i'th bit implies that PMC[i] is active)
-#define IA32_FIXED_CTR_CTRL_VALUE 0x2 // Control register for Fixed Counter 
-// Fixed CTRL register
-#define IA32_FIXED_CTR_CTRL             0x38D // Controls for fixed ctr0, 1, and 2 
-#define IA32_PERF_GLOBAL_CTRL           0x38F // Enables for fixed ctr0,1,and2 here
-#define IA32_FIXED_CTR0                 0x309 // (R/W) Counts Instr_Retired.Any
-/* RAPL defines */
-#define MSR_RAPL_POWER_UNIT             0x606
-#define MSR_PKG_ENERGY_STATUS           0x611
-
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include "DGEMM-pthread-profiler/src/nanoclock.h"
+// machine configuration (CORESperSOCKET, SOCKETSperNODE) and the MSR sampling core, shared with libprofiler
+#include "DGEMM-pthread-profiler/src/profiler_internal.h"
 
 /*CORE Frequency*/
-#define IA32_MPERF                      0xE7
-#define IA32_APERF                      0xE8
 #define BASE_FREQ                       20 // for orca machine
-/* Uncore Frequency*/
-#define MSR_UNCORE_FREQ                 0x620
-#define MSR_UNCORE_READ                 0x621
-
-/************************************************************************/
-// Machine configuration  (change according to your machine)
-#define CORESperSOCKET 24
-#define SOCKETSperNODE 2
-#define NNODES 1
-/************************************************************************/
 
 
 int64_t numOfNodes = -1;
 int64_t numOfSockets = -1;
 int64_t numOfCores = -1;
 
-uint64_t *energyWrap;
-uint64_t *energySave;
-
-
-static int isBlockTopology = 0; //Assuming non-block (cyclic etc.) topology for the system by default
-
 uint64_t TOTAL_PWR_PKG_ENERGY[SOCKETSperNODE];
-uint64_t LAST_PWR_PKG_ENERGY[SOCKETSperNODE];
-uint64_t PWR_PKG_ENERGY_Core[SOCKETSperNODE];
-
 uint64_t TOTAL_INST_RETIRED[SOCKETSperNODE * CORESperSOCKET];
 uint64_t LAST_INST_RETIRED[SOCKETSperNODE * CORESperSOCKET];
-uint64_t INST_RETIRED_CORE[SOCKETSperNODE * CORESperSOCKET];
 
-//////////////////////////////////////////////////
-uint64_t LAST_APERF[SOCKETSperNODE * CORESperSOCKET];
-uint64_t APERF[SOCKETSperNODE * CORESperSOCKET];
-uint64_t LAST_MPERF[SOCKETSperNODE * CORESperSOCKET];
-uint64_t MPERF[SOCKETSperNODE * CORESperSOCKET];
-
-uint64_t LAST_UNCORE[SOCKETSperNODE];
-uint64_t LAST_UNCORE_DELTA[SOCKETSperNODE];
-//////////////////////////////////////////////////
-
-uint64_t POWER_UNIT = 0;
 double JOULE_UNIT = 0.0;  // convert energy counter in JOULE
 
-
-void timer_func(double *timer){
-  struct timespec currentTime;
-  clock_gettime(CLOCK_MONOTONIC, &currentTime);
-  *timer = (currentTime.tv_sec + (currentTime.tv_nsec * 10e-10));
-}
-
-uint64_t readMSR(uint32_t core , uint32_t name){
-    int fd = -1;
-    char filename[256];
-    sprintf(filename, "/dev/cpu/%d/msr_safe", core);
-    fd = open(filename, O_RDONLY);
-    if(fd < 0){
-    	fprintf (stderr, "\n%s : open failed", filename);
-    	return -1;
-    }
-    uint64_t data;
-    if (pread(fd, &data, sizeof(data), name) != sizeof(data)) {
-        perror("rdmsr:pread");
-        exit(127);
-    }
-    close(fd);
-    return data;
-}
-
-int writeMSR(int cpu, uint32_t reg, uint64_t data)
-{
-  int fd;
-  char msr_file_name[64];
-
-  sprintf(msr_file_name, "/dev/cpu/%d/msr_safe", cpu);
-  fd = open(msr_file_name, O_WRONLY);
-  if (fd < 0) {
-    if (errno == ENXIO) {
-      fprintf(stderr, "wrmsr: No CPU %d\n", cpu);
-      exit(2);
-    } else if (errno == EIO) {
-      fprintf(stderr, "wrmsr: CPU %d doesn't support MSRs\n",
-        cpu);
-      exit(3);
-    } else {
-      perror("wrmsr@: open");
-      exit(127);
-    }
-  }
-
-    if (pwrite(fd, &data, sizeof data, reg) != sizeof data) {
-        if (errno == EIO) {
-            fprintf(stderr,
-                "wrmsr: CPU %d cannot set MSR "
-                "0x%08" PRIx32 " to 0x%016" PRIx64 "\n",
-                cpu, reg, data);
-            return(4);
-        } else {
-            perror("wrmsr: pwrite");
-            return(127);
-        }
-    }
-
-  close(fd);
-
-  return(0);
-}
-
-
-
-/* Function returns the physical package id (socket number) given a cpu */
-int get_physical_package_id (int cpu)
-{
-  char path[256];
-  FILE *fileP;
-  int physicalPackageId;
-
-  sprintf (path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
-
-  fileP = fopen (path, "r");
-  if (!fileP)
-  {
-    fprintf (stderr, "\n%s : open failed", path);
-    return -1;
-  }
-
-  if (fscanf (fileP, "%d", &physicalPackageId) != 1)
-  {
-    fprintf (stderr, "\n%s: failed to parse from file", path);
-    return -1;
-  }
-
-  fclose(fileP);
-  return physicalPackageId;
-}
+// node totals of the most recent perfcounters_read() interval
+double LAST_NODE_ENERGY = 0.0;
+double LAST_NODE_INST = 0.0;
 
 
 void perfcounters_dump();
 void perfcounters_read();
 
+// Opens one MSR device per CPU, resolves the socket-to-CPU map and programs
+// the fixed counter, once for the life of the daemon (profiler_core.cpp)
 void perfcounters_init(){
-
-    int sock;
     //Store local copies of the socket and core counts -- check for previous intialization
     if (numOfNodes == -1) numOfNodes = NNODES;
     if (numOfSockets == -1) numOfSockets = SOCKETSperNODE;
     if (numOfCores == -1) numOfCores = CORESperSOCKET; 
 
-    energyWrap = (uint64_t *) malloc (sizeof (uint64_t) * numOfSockets);
-    energySave = (uint64_t *) malloc (sizeof (uint64_t) * numOfSockets);
-   
-	for (int core = 0; core < numOfCores * numOfSockets; core++)
-	{
-		// set Global Counter to read instruction at user level only
-	    writeMSR (core, IA32_PERF_GLOBAL_CTRL, IA32_PERF_GLOBAL_CTRL_VALUE);
-       	writeMSR (core, IA32_FIXED_CTR_CTRL, IA32_FIXED_CTR_CTRL_VALUE);
-	}
-
+    if (profiler_core_open() != 0) {
+        fprintf(stderr, "my-profiler: cannot open the MSR devices (%s)\n", profiler_msr_device());
+        exit(1);
+    }
+    JOULE_UNIT = profiler_core_joule_unit();
 }
-void perfcounters_start(){
-    //compute power unit
-    int correctedCoreNumber;
-    int sock;
-    POWER_UNIT = readMSR(0, MSR_RAPL_POWER_UNIT); // calculate once
-    JOULE_UNIT = 1.0 / (1 << ((POWER_UNIT >> 8) & 0x1F));
-
-    for (sock = 0; sock < numOfSockets; sock++)
-    { 
-		energyWrap[sock] = 0;
-        energySave[sock] = 0;
-        PWR_PKG_ENERGY_Core[sock] = 0;
-        LAST_PWR_PKG_ENERGY[sock] = 0;
-        TOTAL_PWR_PKG_ENERGY[sock] = 0;
-
-	//
-	
-	//
-        //Discover the topology of the system using the physical id and assign correct cores to sockets 
-        if (sock == get_physical_package_id(sock))
-        {
-            correctedCoreNumber = sock;
-        }
-        else
-        {
-            correctedCoreNumber = sock * numOfCores;
-            isBlockTopology = 1;
-        }
-        uint64_t energyStatus = readMSR(correctedCoreNumber, MSR_PKG_ENERGY_STATUS); // get energy MSR
 
-        uint64_t energyCounter = energyStatus & 0xffffffff; // only 32 of 64 bits good 
-        if (energyCounter < energySave[sock]) 
-        { 
-            // did I just wrap the counter?
-            energyWrap[sock]++;
-        }
-        energySave[sock] = energyCounter;
-        energyCounter = energyCounter + (energyWrap[sock]<<32);// number of wraps in upper 32 bits
-        PWR_PKG_ENERGY_Core[sock] = energyCounter;
-    }
-	for (int core=0; core<numOfCores * numOfSockets; core++)
-	{
-		INST_RETIRED_CORE[core]=0;
-		LAST_INST_RETIRED[core]=0;
-		TOTAL_INST_RETIRED[core]=0;
-		INST_RETIRED_CORE[core] = readMSR (core, IA32_FIXED_CTR0);
-
-		/////////////////
-		LAST_MPERF[core]=0;
-                LAST_APERF[core]=0;
-                MPERF[core]=readMSR (core, IA32_MPERF);
-                APERF[core]=readMSR (core, IA32_APERF);
-	}
+void perfcounters_start(){
+    profiler_counters_t discard;
+    profiler_core_read(&discard);      // new baseline
+    memset(TOTAL_PWR_PKG_ENERGY, 0, sizeof(TOTAL_PWR_PKG_ENERGY));
+    memset(TOTAL_INST_RETIRED, 0, sizeof(TOTAL_INST_RETIRED));
+    memset(LAST_INST_RETIRED, 0, sizeof(LAST_INST_RETIRED));
 }
 
 void perfcounters_finalize(){
   //perfcounters_dump();
-  free(energyWrap);
-  free(energySave);
+  profiler_core_close();
 }
 
 void perfcounters_read(FILE* fd, int* counter){
-	int sock;
-        int correctedCoreNumber;
+	profiler_counters_t c;
 	double last_power = 0.0, last_inst = 0.0;
 	double total_mperf = 0.0,total_aperf=0.0;
 	double total_uncore_freq=  0.0;
-	for (sock = 0; sock < numOfSockets; sock++){
-        //Discover the topology of the system using the physical id and assign correct cores to sockets 
-	        if (sock == get_physical_package_id(sock)){
-	            correctedCoreNumber = sock;
-        	}
-	        else
-        	{
-	            correctedCoreNumber = sock * numOfCores;
-        	    isBlockTopology = 1;
-        	}
-
-		uint64_t energyStatus = readMSR(correctedCoreNumber, MSR_PKG_ENERGY_STATUS); // get energy MSR
-		uint64_t energyCounter = energyStatus & 0xffffffff; // only 32 of 64 bits good 
-
-		if (energyCounter < energySave[sock]) { 
-		  // did I just wrap the counter?
-		  energyWrap[sock]++;
-		}
-
-		energySave[sock] = energyCounter;
-		energyCounter = energyCounter + (energyWrap[sock]<<32);// number of wraps in upper 32 bits
-	   
-        	LAST_PWR_PKG_ENERGY[sock] = energyCounter - PWR_PKG_ENERGY_Core[sock];
-	        TOTAL_PWR_PKG_ENERGY[sock] += LAST_PWR_PKG_ENERGY[sock];
-		PWR_PKG_ENERGY_Core[sock] = energyCounter;
-
-	        last_power += (double)LAST_PWR_PKG_ENERGY[sock] * JOULE_UNIT;
-
-		
-		LAST_UNCORE[sock] = readMSR(correctedCoreNumber, MSR_UNCORE_READ) & 0xFF;
-		
-		total_uncore_freq+=LAST_UNCORE[sock];
-
 
+	profiler_core_read(&c);
+	for (int sock = 0; sock < numOfSockets; sock++){
+		TOTAL_PWR_PKG_ENERGY[sock] += c.energy[sock];
+	        last_power += (double)c.energy[sock] * JOULE_UNIT;
+		total_uncore_freq += c.uncore[sock];
 	}
 	for (int core=0; core<numOfCores * numOfSockets; core++)
 	{
-		uint64_t instruction = readMSR (core, IA32_FIXED_CTR0);
-		uint64_t mperf = readMSR (core, IA32_MPERF); // new code
-                uint64_t aperf = readMSR (core, IA32_APERF);  // new code
-		LAST_INST_RETIRED[core] = instruction - INST_RETIRED_CORE[core];
-		LAST_MPERF[core] = mperf - MPERF[core];  // new code
-                LAST_APERF[core] = aperf - APERF[core];  // new code
-		TOTAL_INST_RETIRED[core] += LAST_INST_RETIRED[core];
-		INST_RETIRED_CORE[core] = instruction;
-		MPERF[core] = mperf;  // new code
-                APERF[core] = aperf;  // new code
-
-		last_inst += (double)LAST_INST_RETIRED[core];
-		total_mperf+=(double)LAST_MPERF[core];
-		total_aperf+=(double)LAST_APERF[core];
+		LAST_INST_RETIRED[core] = c.inst[core];
+		TOTAL_INST_RETIRED[core] += c.inst[core];
+
+		last_inst += (double)c.inst[core];
+		total_mperf+=(double)c.mperf[core];
+		total_aperf+=(double)c.aperf[core];
 	}
 
 	int cf = (int)((total_aperf/total_mperf)*BASE_FREQ);
 	int uf = (int)(total_uncore_freq/numOfSockets);
+	LAST_NODE_ENERGY = last_power;
+	LAST_NODE_INST = last_inst;
 	if (counter!=NULL){*counter+=1;}
 	if (fd != NULL && counter!=NULL) {
               fprintf(fd, "%d\t%f\t%f\t%d\t\t%d\n", *(counter), last_power, last_inst,cf,uf);
@@ -337,7 +134,6 @@ void perfcounters_dump(){
     fprintf(stdout,"%s\t","PWR_PKG_ENERGY");
     fprintf(stdout,"%s\t","INST_RETIRED");
     fprintf(stdout,"\n");
-    //printf("power %f \n", LAST_PWR_PKG_ENERGY[0]*JOULE_UNIT);
     double res=0;
     for(i=0; i<numOfSockets; i++) {
       res += ((double)TOTAL_PWR_PKG_ENERGY[i])*JOULE_UNIT;
@@ -353,76 +149,466 @@ void perfcounters_dump(){
 }
 
 
-//////////////new code///////////////
-// core frequency
-// int cf = (int)((total_aperf/total_mperf)*BASE_FREQ)  //store total value in double format
-// uncore frequency
-// int uf = (int)(LAST_UNCORE)
-/////////////////////////////
 
+/************************************************************************/
+// Daemon
+//
+// Protocol, one text line per request over a SOCK_STREAM Unix socket:
+//   START [pid]   open a window for pid (default: the connecting process)
+//                 -> "OK <window id>"
+//   STOP          close it -> result table, then "END"; the daemon closes
+//                 the connection
+// A client that disconnects without STOP drops its window. The counters are
+// sampled only while at least one window is open; a window's first and last
+// intervals are cut at START/STOP so every window covers exactly its span.
+/************************************************************************/
+#define MAX_CLIENTS 64
+#define MAX_CPUS (SOCKETSperNODE * CORESperSOCKET)
+#define DEFAULT_SOCKET "/tmp/my-profiler.sock"
+#define DEFAULT_INTERVAL_MS 100
+
+enum { ATTRIBUTE_CPUTIME = 0, ATTRIBUTE_INSTRUCTIONS };
+
+typedef struct {
+    pid_t tid;
+    uint64_t ticks;
+} task_ticks_t;
+
+typedef struct {
+    int fd;
+    pid_t pid;
+    int id;
+    int active;             // START received
+    char line[256];         // partial request line
+    size_t len;
+
+    uint64_t start_ns;
+    int samples;
+    double energy;          // attributed package energy (J)
+    double instructions;    // instructions retired by the process's threads (estimate)
+    double cpu_ticks;       // user + system time (clock ticks)
+    double node_energy;     // node totals over the window
+    double node_instructions;
+
+    uint64_t last_ticks;    // /proc/<pid>/stat utime + stime at the last interval
+    task_ticks_t *tasks;    // same per thread
+    int ntasks;
+    double delta_ticks, delta_inst;
+} client_t;
+
+static client_t clients[MAX_CLIENTS];
+static int nclients = 0;
+static int active_clients = 0;
+static int next_window_id = 1;
+static int attribution = ATTRIBUTE_CPUTIME;
+static volatile sig_atomic_t stop_requested = 0;
+
+// busy (non-idle) clock ticks per CPU from /proc/stat, [MAX_CPUS] = whole node
+static uint64_t cpu_busy[MAX_CPUS + 1];
+static double cpu_busy_delta[MAX_CPUS + 1];
+
+static FILE* perflog = NULL;
+static int perflog_counter = 0;
+
+static void on_signal(int sig){
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void read_cpu_busy(){
+    FILE* f = fopen("/proc/stat", "r");
+    char line[512];
+    if (f == NULL) return;
+    while (fgets(line, sizeof(line), f) != NULL && strncmp(line, "cpu", 3) == 0) {
+        unsigned long long user = 0, nice = 0, sys = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+        int cpu = MAX_CPUS;
+        char* p = line + 3;
+        if (*p != ' ') {
+            cpu = (int)strtol(p, &p, 10);
+            if (cpu < 0 || cpu >= MAX_CPUS) continue;
+        }
+        sscanf(p, "%llu %llu %llu %llu %llu %llu %llu %llu",
+               &user, &nice, &sys, &idle, &iowait, &irq, &softirq, &steal);
+        uint64_t busy = user + nice + sys + irq + softirq + steal;
+        cpu_busy_delta[cpu] = (double)(busy - cpu_busy[cpu]);
+        cpu_busy[cpu] = busy;
+    }
+    fclose(f);
+}
+
+// utime + stime and the CPU last run on, from a /proc/<pid>[/task/<tid>]/stat file
+static int read_task_stat(const char* path, uint64_t* ticks, int* cpu){
+    char buf[1024];
+    char* save = NULL;
+    char* tok;
+    unsigned long long utime = 0, stime = 0;
+    int field = 3;
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return -1;
+    if (fgets(buf, sizeof(buf), f) == NULL) buf[0] = '\0';
+    fclose(f);
+
+    // the command name (field 2) may contain spaces: fields restart after its ')'
+    char* p = strrchr(buf, ')');
+    if (p == NULL) return -1;
+    for (tok = strtok_r(p + 1, " ", &save); tok != NULL; tok = strtok_r(NULL, " ", &save), field++) {
+        if (field == 14) utime = strtoull(tok, NULL, 10);
+        else if (field == 15) stime = strtoull(tok, NULL, 10);
+        else if (field == 39) {
+            if (cpu != NULL) *cpu = atoi(tok);
+            break;
+        }
+    }
+    *ticks = utime + stime;
+    return 0;
+}
+
+// CPU time of the process and the instructions of the cores its threads ran
+// on, weighted by each thread's share of that core's busy time
+static void client_update(client_t* c){
+    char path[128];
+    uint64_t ticks;
+    DIR* dir;
+    struct dirent* ent;
+    task_ticks_t* tasks = NULL;
+    int ntasks = 0, i;
+
+    c->delta_ticks = 0.0;
+    c->delta_inst = 0.0;
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)c->pid);
+    if (read_task_stat(path, &ticks, NULL) == 0) {
+        if (ticks >= c->last_ticks) c->delta_ticks = (double)(ticks - c->last_ticks);
+        c->last_ticks = ticks;
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)c->pid);
+    dir = opendir(path);
+    if (dir == NULL) return;
+    while ((ent = readdir(dir)) != NULL) {
+        pid_t tid = (pid_t)atoi(ent->d_name);
+        uint64_t old = 0;
+        int cpu = -1;
+        if (tid <= 0) continue;
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", (int)c->pid, (int)tid);
+        if (read_task_stat(path, &ticks, &cpu) != 0) continue;
+
+        for (i = 0; i < c->ntasks; i++) {
+            if (c->tasks[i].tid == tid) {
+                old = c->tasks[i].ticks;
+                break;
+            }
+        }
+        if (cpu >= 0 && cpu < numOfCores * numOfSockets && cpu_busy_delta[cpu] > 0 && ticks > old) {
+            double frac = (double)(ticks - old) / cpu_busy_delta[cpu];
+            c->delta_inst += (frac < 1.0 ? frac : 1.0) * (double)LAST_INST_RETIRED[cpu];
+        }
+        tasks = realloc(tasks, sizeof(task_ticks_t) * (ntasks + 1));
+        tasks[ntasks].tid = tid;
+        tasks[ntasks].ticks = ticks;
+        ntasks++;
+    }
+    closedir(dir);
+    free(c->tasks);
+    c->tasks = tasks;
+    c->ntasks = ntasks;
+}
+
+// One node reading, split over the open windows
+static void sample_interval(){
+    double share[MAX_CLIENTS];
+    double total = 0.0;
+    int i;
+
+    perfcounters_read(perflog, &perflog_counter);
+    read_cpu_busy();
+
+    for (i = 0; i < nclients; i++) {
+        client_t* c = &clients[i];
+        share[i] = 0.0;
+        if (!c->active) continue;
+        client_update(c);
+        if (attribution == ATTRIBUTE_INSTRUCTIONS)
+            share[i] = LAST_NODE_INST > 0 ? c->delta_inst / LAST_NODE_INST : 0.0;
+        else
+            share[i] = cpu_busy_delta[MAX_CPUS] > 0 ? c->delta_ticks / cpu_busy_delta[MAX_CPUS] : 0.0;
+        total += share[i];
+    }
+
+    for (i = 0; i < nclients; i++) {
+        client_t* c = &clients[i];
+        if (!c->active) continue;
+        // tick granularity can overshoot: never hand out more than the node used
+        if (total > 1.0) share[i] /= total;
+        c->energy += share[i] * LAST_NODE_ENERGY;
+        c->instructions += c->delta_inst;
+        c->cpu_ticks += c->delta_ticks;
+        c->node_energy += LAST_NODE_ENERGY;
+        c->node_instructions += LAST_NODE_INST;
+        c->samples++;
+    }
+}
+
+static void client_reply(client_t* c, const char* text){
+    size_t len = strlen(text), done = 0;
+    while (done < len) {
+        ssize_t n = write(c->fd, text + done, len - done);
+        if (n <= 0) return;
+        done += (size_t)n;
+    }
+}
+
+static void client_close(int i){
+    client_t* c = &clients[i];
+    if (c->active) active_clients--;
+    close(c->fd);
+    free(c->tasks);
+    clients[i] = clients[--nclients];
+}
+
+static void client_start(client_t* c, const char* arg){
+    char reply[64];
+    int pid = atoi(arg);
+    if (c->active) {
+        client_reply(c, "ERR window already open\n");
+        return;
+    }
+    if (pid > 0) c->pid = (pid_t)pid;
+
+    // close the running interval for the other windows (or take a fresh
+    // baseline after an idle period) so this window starts now
+    if (active_clients > 0) sample_interval();
+    else {
+        perfcounters_read(NULL, NULL);
+        read_cpu_busy();
+    }
+
+    c->active = 1;
+    c->id = next_window_id++;
+    c->start_ns = nanoclock_now();
+    c->samples = 0;
+    c->energy = c->instructions = c->cpu_ticks = 0.0;
+    c->node_energy = c->node_instructions = 0.0;
+    c->last_ticks = 0;
+    c->ntasks = 0;
+    client_update(c);   // baseline
+    active_clients++;
+
+    snprintf(reply, sizeof(reply), "OK %d\n", c->id);
+    client_reply(c, reply);
+}
+
+static void client_stop(client_t* c){
+    char result[2048];
+    const double hz = (double)sysconf(_SC_CLK_TCK);
+    if (!c->active) {
+        client_reply(c, "ERR no window open\n");
+        return;
+    }
+    sample_interval();
+    const uint64_t end = nanoclock_now();
+
+    snprintf(result, sizeof(result),
+        "\n============================ Tabulate Statistics ============================\n"
+        "PWR_PKG_ENERGY\tINST_RETIRED\tTIPI\tTIME(ms)\t\n"
+        "%f\t%f\t%f\t%f\t"
+        "\n=============================================================================\n"
+        "\n============================ Attribution ============================\n"
+        "PID\tWINDOW\tSHARE_BY\tCPU_TIME(s)\tNODE_ENERGY\tNODE_INST\tSAMPLES\t\n"
+        "%d\t%d\t%s\t%f\t%f\t%f\t%d\t"
+        "\n=============================================================================\n"
+        "END\n",
+        c->energy, c->instructions, 0.0, nanoclock_to_ms(end - c->start_ns),
+        (int)c->pid, c->id, attribution == ATTRIBUTE_INSTRUCTIONS ? "instructions" : "cputime",
+        c->cpu_ticks / hz, c->node_energy, c->node_instructions, c->samples);
+    client_reply(c, result);
+    c->active = 0;
+    active_clients--;
+}
+
+// Handles every complete line in the client's buffer; returns 0 once the client is done
+static int client_input(client_t* c){
+    ssize_t n = read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+    char* nl;
+    if (n <= 0) return 0;
+    c->len += (size_t)n;
+    c->line[c->len] = '\0';
+
+    while ((nl = strchr(c->line, '\n')) != NULL) {
+        *nl = '\0';
+        if (strncmp(c->line, "START", 5) == 0) client_start(c, c->line + 5);
+        else if (strcmp(c->line, "STOP") == 0) {
+            client_stop(c);
+            return 0;
+        }
+        else client_reply(c, "ERR unknown request\n");
+        c->len -= (size_t)(nl + 1 - c->line);
+        memmove(c->line, nl + 1, c->len + 1);
+    }
+    if (c->len == sizeof(c->line) - 1) return 0;   // overlong request
+    return 1;
+}
+
+// Held for the daemon's lifetime: of several daemons started at once (clients
+// auto-starting one), only the first gets to replace the socket file
+static int socket_lock_fd = -1;
+
+static int open_socket(const char* path){
+    struct sockaddr_un addr;
+    char lock_path[sizeof(addr.sun_path) + 8];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    socket_lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (socket_lock_fd < 0) {
+        perror(lock_path);
+        return -1;
+    }
+    if (flock(socket_lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "A profiler daemon is already serving %s\n", path);
+        close(socket_lock_fd);
+        socket_lock_fd = -1;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    // a socket file nobody answers on is left over from a killed daemon
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "A profiler daemon is already serving %s\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void usage(const char* prog){
+    fprintf(stderr, "Usage: %s [-s socket] [-l perflog] [-a cputime|instructions] [-i interval_ms]\n", prog);
+}
 
 int main(int argc, char* argv[]){
-    FILE* fd = fopen("perflog1.txt","w");
-    if (fd ==NULL){
-     	perror("Unable to open perflog.txt");
+    const char* socket_path = DEFAULT_SOCKET;
+    const char* log_path = "perflog1.txt";
+    int interval_ms = DEFAULT_INTERVAL_MS;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "s:l:a:i:h")) != -1) {
+        switch (opt) {
+        case 's': socket_path = optarg; break;
+        case 'l': log_path = optarg; break;
+        case 'i': interval_ms = atoi(optarg); break;
+        case 'a':
+            if (strcmp(optarg, "cputime") == 0) attribution = ATTRIBUTE_CPUTIME;
+            else if (strcmp(optarg, "instructions") == 0) attribution = ATTRIBUTE_INSTRUCTIONS;
+            else {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (interval_ms < 1) interval_ms = DEFAULT_INTERVAL_MS;
+
+    int listen_fd = open_socket(socket_path);
+    if (listen_fd < 0) exit(EXIT_FAILURE);
+
+    perflog = fopen(log_path,"w");
+    if (perflog ==NULL){
+     	perror("Unable to open perflog");
 	exit(EXIT_FAILURE);
     }
-    double start_def, end_def; 
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    nanoclock_init();
     perfcounters_init();
     perfcounters_start();
-    timer_func(&start_def);
-
-
-    fprintf(fd,"\n============================ Unprocessed Statistics ============================\n");
-    fprintf(fd,"\n === DURATION BETWEEN EACH READING :: 100ms ===\n\n");
-    fprintf(fd,"%s\t","S.NO");
-    fprintf(fd,"%s\t","PWR_PKG_ENERGY");
-    fprintf(fd,"%s\t","INST_RETIRED");
-    fprintf(fd,"%s\t","CORE FREQ");
-    fprintf(fd,"%s\t","UNCORE FREQ");
-    fprintf(fd,"\n");
-    int counter = 0; 
-    while (access("/tmp/hpl.txt", F_OK) != 0) {
-       perfcounters_read(fd,&counter);
-       usleep(100000); // Sleep 100ms
-    }
-    timer_func(&end_def);
-    perfcounters_stop(fd,&counter); 
-    perfcounters_finalize();
-    fprintf(fd,"\n=============================================================================\n");
 
-    FILE* fd2 = fopen("/tmp/currentRes.txt","w");
-    if (fd2 ==NULL){
-        perror("Unable to open /tmp/currentRes.txt");
-        exit(EXIT_FAILURE);
-    }
-    fprintf(fd2,"\n============================ Tabulate Statistics ============================\n");
-    fprintf(fd2,"%s\t","PWR_PKG_ENERGY");
-    fprintf(fd2,"%s\t","INST_RETIRED");
-    fprintf(fd2,"%s\t","TIPI");
-    fprintf(fd2,"%s\t","TIME(ms)");
-    fprintf(fd2,"\n");
-    double res=0;
-    int i;
-    for(i=0; i<numOfSockets; i++) {
-      res += ((double)TOTAL_PWR_PKG_ENERGY[i])*JOULE_UNIT;
+    fprintf(perflog,"\n============================ Unprocessed Statistics ============================\n");
+    fprintf(perflog,"\n === DURATION BETWEEN EACH READING :: %dms (while windows are open) ===\n\n", interval_ms);
+    fprintf(perflog,"%s\t","S.NO");
+    fprintf(perflog,"%s\t","PWR_PKG_ENERGY");
+    fprintf(perflog,"%s\t","INST_RETIRED");
+    fprintf(perflog,"%s\t","CORE FREQ");
+    fprintf(perflog,"%s\t","UNCORE FREQ");
+    fprintf(perflog,"\n");
+    fprintf(stderr, "===Profiler daemon serving %s===\n", socket_path);
+
+    uint64_t next_tick = 0;
+    while (!stop_requested) {
+        struct pollfd fds[MAX_CLIENTS + 1];
+        int timeout = -1;
+
+        fds[0].fd = listen_fd;
+        fds[0].events = nclients < MAX_CLIENTS ? POLLIN : 0;
+        for (i = 0; i < nclients; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (active_clients > 0) {
+            uint64_t now = nanoclock_now();
+            if (next_tick == 0) next_tick = now + (uint64_t)interval_ms * 1000000;
+            timeout = next_tick > now ? (int)((next_tick - now + 999999) / 1000000) : 0;
+        } else {
+            next_tick = 0;
+        }
+
+        int ready = poll(fds, (nfds_t)(nclients + 1), timeout);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        if (active_clients > 0 && nanoclock_now() >= next_tick) {
+            sample_interval();
+            next_tick += (uint64_t)interval_ms * 1000000;
+        }
+        if (ready <= 0) continue;
+
+        // clients first, from the back so closing one does not skip another
+        for (i = nclients - 1; i >= 0; i--) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (!client_input(&clients[i])) client_close(i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                struct ucred cred;
+                socklen_t len = sizeof(cred);
+                client_t* c = &clients[nclients++];
+                memset(c, 0, sizeof(*c));
+                c->fd = fd;
+                if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0) c->pid = cred.pid;
+            }
+        }
     }
-    fprintf(fd2,"%f\t",res);
-      res = 0;
-      for(i=0;i<numOfSockets*numOfCores;i++) {
-           res += ((double)TOTAL_INST_RETIRED[i]);
-      }
-    fprintf(fd2,"%f\t",res);
-    fprintf(fd2,"%f\t",0.0);
-    fprintf(fd2,"%f\t",(end_def-start_def)*1000); // return total time
-    fprintf(fd2,"\n=============================================================================\n");
-    fflush(fd2);
-
-    fclose(fd2); 
-    fclose(fd);
-
-    remove("/tmp/hpl.txt");
 
+    while (nclients > 0) client_close(nclients - 1);
+    close(listen_fd);
+    unlink(socket_path);
+    perfcounters_finalize();
+    fprintf(perflog,"\n=============================================================================\n");
+    fclose(perflog);
+    fprintf(stderr, "===Profiler daemon stopped===\n");
     return 0;
 }
-